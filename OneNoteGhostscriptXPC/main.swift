@@ -2,6 +2,59 @@ import Foundation
 
 final class GhostscriptXPCService: NSObject, GhostscriptXPCProtocol {
     func convertPS(psPath: String, pdfPath: String, reply: @escaping (Bool, String) -> Void) {
+        runGhostscript(arguments: [
+            "-dSAFER",
+            "-dBATCH",
+            "-dNOPAUSE",
+            "-sDEVICE=pdfwrite",
+            "-dCompatibilityLevel=1.4",
+            "-sOutputFile=\(pdfPath)",
+            psPath
+        ], reply: reply)
+    }
+
+    func optimizePDF(inPath: String, outPath: String, downsampleDPI: Int, reply: @escaping (Bool, String) -> Void) {
+        // Keep in sync with Scripts/optimize_pdf_corpus.py (used to measure these settings offline).
+        var args = [
+            "-dSAFER",
+            "-dBATCH",
+            "-dNOPAUSE",
+            "-sDEVICE=pdfwrite",
+            // 1.5 allows object streams + xref streams (written by gs >= 10.02; ignored by older versions).
+            "-dCompatibilityLevel=1.5",
+            "-dWriteObjStms=true",
+            "-dWriteXRefStm=true",
+            // pdfwrite only emits reachable objects; these merge identical images and subset/merge fonts.
+            "-dDetectDuplicateImages=true",
+            "-dCompressFonts=true",
+            "-dSubsetFonts=true",
+            "-dAutoRotatePages=/None"
+        ]
+        if downsampleDPI > 0 {
+            args += [
+                "-dDownsampleColorImages=true",
+                "-dDownsampleGrayImages=true",
+                "-dDownsampleMonoImages=true",
+                "-dColorImageResolution=\(downsampleDPI)",
+                "-dGrayImageResolution=\(downsampleDPI)",
+                "-dMonoImageResolution=\(downsampleDPI * 2)",
+                "-dColorImageDownsampleThreshold=1.5",
+                "-dGrayImageDownsampleThreshold=1.5"
+            ]
+        } else {
+            args += [
+                "-dDownsampleColorImages=false",
+                "-dDownsampleGrayImages=false",
+                "-dDownsampleMonoImages=false",
+                // Keep original JPEGs as-is instead of decoding/re-encoding them.
+                "-dPassThroughJPEGImages=true"
+            ]
+        }
+        args += ["-sOutputFile=\(outPath)", inPath]
+        runGhostscript(arguments: args, reply: reply)
+    }
+
+    private func runGhostscript(arguments: [String], reply: @escaping (Bool, String) -> Void) {
         let fm = FileManager.default
 
         guard let exeURL = Bundle.main.executableURL else {
@@ -19,15 +72,7 @@ final class GhostscriptXPCService: NSObject, GhostscriptXPCProtocol {
 
         let proc = Process()
         proc.executableURL = gsURL
-        proc.arguments = [
-            "-dSAFER",
-            "-dBATCH",
-            "-dNOPAUSE",
-            "-sDEVICE=pdfwrite",
-            "-dCompatibilityLevel=1.4",
-            "-sOutputFile=\(pdfPath)",
-            psPath
-        ]
+        proc.arguments = arguments
 
         let outPipe = Pipe()
         let errPipe = Pipe()
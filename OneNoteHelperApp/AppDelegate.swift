@@ -29,7 +29,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
     private var isScanning: Bool = false
 
     private var interactiveAuthInProgress = false
-    private var interactiveAuthWaiters: [(String?) -> Void] = []
+    private var interactiveAuthWaiters: [(String?, Date?) -> Void] = []
 
     nonisolated private func log(_ message: String) {
         os_log("%{public}@", message)
@@ -185,8 +185,52 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
     func applicationDidFinishLaunching(_ notification: Notification) {
         AppDelegate.shared = self
         OneNoteTargetStore.shared.register(appDelegate: self)
+        GraphTokenCache.shared.refresher = { [weak self] interactive, forceRefresh, completion in
+            Task { @MainActor in
+                guard let self else {
+                    completion(nil, nil)
+                    return
+                }
+                self.acquireGraphTokenFromMSAL(interactive: interactive, forceRefresh: forceRefresh, completion: completion)
+            }
+        }
+        JobScheduler.shared.onChange = { [weak self] event, occupancy in
+            self?.log("Scheduler: \(event); \(occupancy.summary)")
+            Task { @MainActor in
+                LogStore.shared.schedulerSummary = occupancy.summary
+                if occupancy.runningJobs == 0, occupancy.queuedJobs == 0 {
+                    LogStore.shared.activityState = .waiting
+                }
+            }
+        }
+        UploadOutbox.shared.transport = { [weak self] request, url, bodyURL in
+            self?.sendOutboxRequest(request, url: url, bodyURL: bodyURL) ?? .retry("app is quitting")
+        }
+        UploadOutbox.shared.log = { [weak self] message in
+            self?.log(message)
+        }
+        AppendBatcher.shared.sender = { [weak self] request, label, user, sourceFiles in
+            self?.deliverUpload([request], label: label, user: user, sourceFiles: sourceFiles) ?? .failed("app is quitting")
+        }
+        AppendBatcher.shared.pageURL = { [weak self] pageId in
+            self?.graphURL("me/onenote/pages/\(pageId)/content") ?? ""
+        }
+        AppendBatcher.shared.log = { [weak self] message in
+            self?.log(message)
+        }
+        UploadOutbox.shared.onFinished = { [weak self] entry, ok in
+            guard let self else { return }
+            OneNoteHelperWatcherQueue.async {
+                let target = self.folderURL(ok ? "Done" : "Failed")
+                for path in entry.sourceFiles {
+                    let url = URL(fileURLWithPath: path)
+                    try? FileManager.default.moveItem(at: url, to: target.appendingPathComponent(url.lastPathComponent))
+                }
+            }
+        }
         resolveAndStartSecurityScopedAccessIfNeeded()
         startWatchingIncomingFolder()
+        UploadOutbox.shared.start(directory: folderURL("Outbox"))
         Task { @MainActor in
             OneNoteTargetStore.shared.refreshAll()
             self.keychainSanityCheck()
@@ -214,10 +258,17 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         let user = value("user") ?? ""
         let job = value("job") ?? ""
 
-        importFile(filePath: file, title: title, user: user, job: job, completion: nil)
+        JobScheduler.shared.submit(user: user, label: URL(fileURLWithPath: file).lastPathComponent) { finished in
+            Task { @MainActor in
+                self.importFile(filePath: file, title: title, user: user, job: job, releaseWorker: finished) { _ in
+                    finished()
+                }
+            }
+        }
     }
 
-    private func importFile(filePath: String, title: String, user: String, job: String, completion: ((Bool) -> Void)?) {
+    private func importFile(filePath: String, title: String, user: String, job: String, sourceFiles: [URL] = [],
+                            releaseWorker: (() -> Void)? = nil, completion: ((Bool) -> Void)?) {
         log("Preparing upload: file=\(filePath) title=\(title) user=\(user) job=\(job)")
         LogStore.shared.activityState = .processing
 
@@ -238,15 +289,17 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
 
         acquireGraphToken { token in
             guard let token else {
-                LogStore.shared.activityState = .waiting
                 completion?(false)
                 return
             }
             self.log("Graph token acquired (len=\(token.count))")
             LogStore.shared.activityState = .uploading
-            self.uploadSinglePage(token: token, filePath: filePath, title: title, user: user, job: job) { ok in
-                LogStore.shared.activityState = .waiting
-                completion?(ok)
+            // Off the main thread: other jobs render and upload concurrently (see JobScheduler).
+            DispatchQueue.global(qos: .userInitiated).async {
+                self.uploadSinglePage(token: token, filePath: filePath, title: title, user: user, job: job,
+                                      sourceFiles: sourceFiles, releaseWorker: releaseWorker) { ok in
+                    completion?(ok)
+                }
             }
         }
     }
@@ -293,7 +346,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
     }
 
     nonisolated private func ensureFolders() {
-        let dirs = [folderURL("Incoming"), folderURL("Processing"), folderURL("Done"), folderURL("Failed")]
+        let dirs = [folderURL("Incoming"), folderURL("Processing"), folderURL("Done"), folderURL("Failed"), folderURL("Outbox")]
         let fm = FileManager.default
         for d in dirs {
             try? fm.createDirectory(at: d, withIntermediateDirectories: true)
@@ -397,6 +450,13 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                 return
             }
 
+            // Jobs still being written by the CUPS backend: start on page 1 if the PDF is linearized.
+            let spools = items.filter { $0.pathExtension.lowercased() == "spool" }
+            for spool in spools {
+                self.prefetchSpoolingJob(spoolURL: spool)
+            }
+            EarlyPageStore.shared.prune(activeSpoolKeys: Set(spools.map { EarlyPageStore.key(for: $0) }))
+
             // Look for pairs: job-*.(pdf|ps) + job-*.json
             let docs = items.filter {
                 let ext = $0.pathExtension.lowercased()
@@ -417,6 +477,9 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                     try self.stageFile(from: doc, to: procDoc)
                     try self.stageFile(from: json, to: procJson)
                     self.log("Queued job: staged \(doc.lastPathComponent) and \(json.lastPathComponent) to Processing")
+                    // Token acquisition and the Graph connection overlap with conversion instead of following it.
+                    GraphTokenCache.shared.prefetch()
+                    GraphTransport.shared.warmUp(baseURL: self.graphEndpointBase)
                 } catch {
                     self.log("Incoming scan: stage failed for \(doc.lastPathComponent): \(error.localizedDescription)")
                     continue
@@ -427,6 +490,59 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         }
     }
 
+    nonisolated private func prefetchSpoolingJob(spoolURL: URL) {
+        let key = EarlyPageStore.key(for: spoolURL)
+        let reader = EarlyPageStore.shared.reader(for: spoolURL)
+        guard reader.refresh(), let info = reader.info else { return }
+
+        let landed = reader.landedPageCount
+        guard landed > 0, EarlyPageStore.shared.beginProcessing(key) else { return }
+        GraphTokenCache.shared.prefetch()
+        GraphTransport.shared.warmUp(baseURL: self.graphEndpointBase)
+        self.log("Spool: \(spoolURL.lastPathComponent) is linearized; page 1 landed (\(landed)/\(info.pageCount) pages, \(reader.currentSize)/\(info.fileLength) bytes); processing page 1 early")
+
+        // The reader stays on this queue; the early work below only gets a copy of the first page section.
+        guard let data = reader.firstPageDocumentData() else {
+            self.log("Spool: could not read the first page section of \(spoolURL.lastPathComponent); waiting for the full job")
+            return
+        }
+        DispatchQueue.global(qos: .utility).async {
+            let started = Date()
+            guard let doc = PDFDocument(data: data), doc.pageCount == 1 else {
+                self.log("Spool: could not build a standalone first page for \(spoolURL.lastPathComponent); waiting for the full job")
+                return
+            }
+
+            let tmpURL = URL(fileURLWithPath: NSTemporaryDirectory(), isDirectory: true)
+                .appendingPathComponent("onenotehelper-early-\(UUID().uuidString).pdf")
+            guard (try? data.write(to: tmpURL)) != nil else { return }
+            defer { try? FileManager.default.removeItem(at: tmpURL) }
+
+            let renderScale = RenderScaleSelector.jobScale
+            // What renderPDFAsPNGs picks for this page on its own; the job's pixel budget may lower it later.
+            var pageScale = renderScale
+            if RenderScaleSelector.isEnabled, let page = CGPDFDocument(tmpURL as CFURL)?.page(at: 1) {
+                let features = PDFPageFeatureExtractor.extract(page: page, pageIndex: 0)
+                pageScale = RenderScaleSelector.scales(for: [features], maxScale: renderScale)[0] ?? renderScale
+            }
+            var entry = EarlyPageStore.Entry(fileLength: info.fileLength, renderScale: renderScale, pageScale: pageScale, createdAt: Date())
+            // Blank detection on, so the job can tell a blank page 1 from one it still has to render.
+            if let part = self.renderPDFAsPNGs(fileURL: tmpURL, maxPages: 1, scale: renderScale, detectBlank: true)?.first {
+                if part.isBlank {
+                    entry.isBlank = true
+                } else {
+                    entry.rendered = (part.mimeType, part.data)
+                    entry.displayWidth = part.displayWidth
+                }
+            }
+            entry.html = self.extractPDFPagesAsHTMLBodies(fileURL: tmpURL, maxPages: 1)?.first
+            EarlyPageStore.shared.store(entry, for: key)
+
+            let ms = Int(Date().timeIntervalSince(started) * 1000)
+            self.log("Spool: page 1 of \(key) rendered/extracted early in \(ms) ms (\(landed)/\(info.pageCount) pages had landed)")
+        }
+    }
+
     private struct QueueMeta: Decodable {
         let file: String
         let title: String
@@ -475,15 +591,26 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             }
             // (meta)
 
-            Task { @MainActor in
-                // (import start)
-                self.importFile(filePath: pdfURL.path, title: meta.title, user: meta.user, job: meta.job) { ok in
-                    // (import completed)
-                    OneNoteHelperWatcherQueue.async {
-                        let fm = FileManager.default
-                        let target = ok ? done : failed
-                        try? fm.moveItem(at: pdfURL, to: target.appendingPathComponent(pdfURL.lastPathComponent))
-                        try? fm.moveItem(at: jsonURL, to: target.appendingPathComponent(jsonURL.lastPathComponent))
+            // Queued per user; runs when a worker is free (see JobScheduler).
+            JobScheduler.shared.submit(user: meta.user, label: pdfURL.lastPathComponent) { finished in
+                Task { @MainActor in
+                    // (import start)
+                    self.importFile(filePath: pdfURL.path, title: meta.title, user: meta.user, job: meta.job,
+                                    sourceFiles: [pdfURL, jsonURL], releaseWorker: finished) { ok in
+                        // (import completed)
+                        EarlyPageStore.shared.remove(EarlyPageStore.key(for: pdfURL))
+                        OneNoteHelperWatcherQueue.async {
+                            // Upload waiting for a retry: the outbox moves the files when it finishes.
+                            if !ok, UploadOutbox.shared.isPending(sourceFile: pdfURL.path) {
+                                finished()
+                                return
+                            }
+                            let fm = FileManager.default
+                            let target = ok ? done : failed
+                            try? fm.moveItem(at: pdfURL, to: target.appendingPathComponent(pdfURL.lastPathComponent))
+                            try? fm.moveItem(at: jsonURL, to: target.appendingPathComponent(jsonURL.lastPathComponent))
+                            finished()
+                        }
                     }
                 }
             }
@@ -637,7 +764,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         request.httpMethod = "GET"
         request.setValue("Bearer \(token)", forHTTPHeaderField: "Authorization")
 
-        URLSession.shared.dataTask(with: request) { data, response, error in
+        GraphTransport.shared.session.dataTask(with: request) { data, response, error in
             if let error = error {
                 self.log("Graph GET failed: \(error.localizedDescription)")
                 completion(.failure(error))
@@ -661,7 +788,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         }
 
         log("Starting interactive sign-in…")
-        acquireGraphTokenInteractive(application: application) { token in
+        acquireGraphTokenInteractive(application: application) { token, _ in
             if let token {
                 self.log("Sign-in OK (token len=\(token.count))")
                 completion?(true)
@@ -672,14 +799,22 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         }
     }
 
+    /// Current access token from GraphTokenCache (acquired through MSAL only when the cached one is missing or
+    /// about to expire; interactively if silent acquisition fails). Called back on the main queue.
     private func acquireGraphToken(completion: @escaping (String?) -> Void) {
+        GraphTokenCache.shared.get(interactive: true, completion: completion)
+    }
+
+    /// GraphTokenCache's refresher: silent acquisition (bypassing MSAL's token cache when `forceRefresh` is
+    /// set), falling back to interactive sign-in when allowed.
+    private func acquireGraphTokenFromMSAL(interactive: Bool, forceRefresh: Bool, completion: @escaping (String?, Date?) -> Void) {
         guard let application = msalApplication else {
             let bundleId = Bundle.main.bundleIdentifier ?? "(nil)"
             log("MSAL is not configured. bundleId=\(bundleId)")
             log("MSALClientId (settings) = \(self.msalClientId ?? "")")
             log("MSALRedirectUri (settings) = \(self.msalRedirectUri ?? "")")
             log("TIP: Add a URL type in Info.plist with scheme 'msauth.\(Bundle.main.bundleIdentifier ?? "")' so MSAL can handle the redirect.")
-            completion(nil)
+            completion(nil, nil)
             return
         }
 
@@ -692,16 +827,21 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             self.log("MSAL accounts count: \(accounts.count)")
             if let account = accounts.first {
                 let parameters = MSALSilentTokenParameters(scopes: graphScopes, account: account)
+                parameters.forceRefresh = forceRefresh
                 application.acquireTokenSilent(with: parameters) { result, error in
                     self.log("Attempting silent token acquisition…")
                     if let result = result {
-                        completion(result.accessToken)
+                        completion(result.accessToken, result.expiresOn)
                         return
                     }
                     if let error = error {
                         let nserr = error as NSError
                         self.log("MSAL silent token error: domain=\(nserr.domain) code=\(nserr.code) desc=\(nserr.localizedDescription)")
                     }
+                    guard interactive else {
+                        completion(nil, nil)
+                        return
+                    }
                     Task { @MainActor in
                         self.acquireGraphTokenInteractive(application: application, completion: completion)
                     }
@@ -712,10 +852,14 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             log("MSAL failed to load accounts: \(error.localizedDescription)")
         }
 
+        guard interactive else {
+            completion(nil, nil)
+            return
+        }
         acquireGraphTokenInteractive(application: application, completion: completion)
     }
 
-    private func acquireGraphTokenInteractive(application: MSALPublicClientApplication, completion: @escaping (String?) -> Void) {
+    private func acquireGraphTokenInteractive(application: MSALPublicClientApplication, completion: @escaping (String?, Date?) -> Void) {
         // Coalesce concurrent interactive auth requests; MSAL allows only one at a time.
         if interactiveAuthInProgress {
             log("MSAL interactive auth already in progress; queuing request…")
@@ -737,7 +881,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             self.interactiveAuthWaiters.removeAll()
             self.interactiveAuthInProgress = false
             for waiter in waiters {
-                waiter(nil)
+                waiter(nil, nil)
             }
             return
         }
@@ -753,6 +897,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         application.acquireToken(with: parameters) { result, error in
             Task { @MainActor in
                 let token = result?.accessToken
+                let expiresOn = result?.expiresOn
                 if let error = error {
                     let nserr = error as NSError
                     self.log("MSAL interactive token error: domain=\(nserr.domain) code=\(nserr.code) desc=\(nserr.localizedDescription)")
@@ -761,17 +906,21 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                 self.interactiveAuthWaiters.removeAll()
                 self.interactiveAuthInProgress = false
                 for waiter in waiters {
-                    waiter(token)
+                    waiter(token, expiresOn)
                 }
             }
         }
     }
 
-    nonisolated private func uploadSinglePage(token: String, filePath: String, title: String, user: String, job: String, completion: @escaping (Bool) -> Void) {
+    nonisolated private func uploadSinglePage(token: String, filePath: String, title: String, user: String, job: String,
+                                              sourceFiles: [URL] = [], releaseWorker: (() -> Void)? = nil,
+                                              completion: @escaping (Bool) -> Void) {
         // Target page title for all print jobs.
         let pageTitle = "Sent To OneNote"
         let jobTitle = title.isEmpty ? "Printed Document" : title
         let fileURL = URL(fileURLWithPath: filePath)
+        // Conversion, extraction and rendering run under a CPU slot; released before the upload.
+        let cpuSlot = JobScheduler.shared.enter(.cpu)
 
         // Print system may provide PostScript content even if the file is named .pdf.
         // Detect and convert to real PDF first.
@@ -791,10 +940,18 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             effectiveURL = fileURL
         }
 
+        // Intermediate files of this job. Removed when it returns: by then the body is in the outbox, or the job failed.
+        var temporaryFiles: [URL] = []
+        defer {
+            for url in temporaryFiles { try? FileManager.default.removeItem(at: url) }
+        }
+
         enum ImportMode: String {
             case image
             case text
             case hybrid
+            case auto
+            case server
         }
 
         let importModeRaw = (UserDefaults.standard.string(forKey: "ImportMode") ?? "hybrid").trimmingCharacters(in: .whitespacesAndNewlines).lowercased()
@@ -803,53 +960,40 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         // Prefer selectable text: extract attributed text from the PDF and convert to HTML.
         // Depending on ImportMode, we may force images-only or text-only.
         // If extraction fails (e.g. scanned PDF), Hybrid can fall back to rendering pages as images.
-        let maxPages = 200
-        let renderScale: CGFloat = 2.0
+        // No small fixed caps: a job too large for one request is split into several (see JobSplitter).
+        let maxPages = 2000
+        let maxImages = 10000
+        let renderScale = RenderScaleSelector.jobScale
 
         let boundary = "----onenote-\(UUID().uuidString)"
-        var body = Data()
+        let body = MultipartBody(boundary: boundary)
 
         let targetSectionId = UserDefaults.standard.string(forKey: targetSectionIdKey)
         let targetPageId = UserDefaults.standard.string(forKey: targetPageIdKey)
         let shouldAppendToPage = (targetPageId?.isEmpty == false)
 
-        struct OneNotePatchCommand: Encodable {
-            let target: String
-            let action: String
-            let content: String
-        }
-
         func appendMainPartForCreate(htmlDocument: String) {
-            appendMultipartPart(&body, boundary: boundary,
-                                contentType: "text/html; charset=utf-8",
-                                contentDisposition: "form-data; name=\"Presentation\"",
-                                data: Data(htmlDocument.utf8))
+            OneNoteRequestBuilder.appendPage(html: htmlDocument, appending: false, to: body)
         }
 
         func appendMainPartForAppend(htmlFragment: String) {
             // Use OneNote patch commands to append HTML fragment to the end of the page.
-            let commands = [OneNotePatchCommand(target: "body", action: "append", content: htmlFragment)]
-            let data = (try? JSONEncoder().encode(commands)) ?? Data("[]".utf8)
-            appendMultipartPart(&body, boundary: boundary,
-                                contentType: "application/json; charset=utf-8",
-                                contentDisposition: "form-data; name=\"commands\"",
-                                data: data)
+            OneNoteRequestBuilder.appendPage(html: htmlFragment, appending: true, to: body)
         }
 
-        func fallbackToImages() -> Bool {
-            guard let images = self.renderPDFAsPNGs(fileURL: effectiveURL, maxPages: min(maxPages, 30), scale: renderScale), !images.isEmpty else {
-                self.log("Failed to extract text or render PDF at \(filePath)")
-                return false
-            }
-
-            self.log("Upload: preparing IMAGE page for sectionId=\(UserDefaults.standard.string(forKey: targetSectionIdKey) ?? "(default)") title=\(pageTitle) renderedPages=\(images.count)")
+        /// Binary parts of the job by token. Sections reference them by token, so duplicate pages share one.
+        var attachmentsByToken: [String: PartAttachment] = [:]
+        /// The job's page sections, set by `submit`; checked and packed into requests before the upload.
+        var jobSections: [JobSection]?
+        var sectionSeparator = ""
+        var sectionRule = false
 
-            var imgHTML = ""
-            for (idx, item) in images.enumerated() {
-                imgHTML += "<div style=\"margin: 12px 0;\"><img src=\"name:\(item.token)\" alt=\"Page \(idx + 1)\" /></div>\n"
-            }
+        func register(token: String, filename: String, mimeType: String, data: Data) {
+            attachmentsByToken[token] = PartAttachment(filename: filename, mimeType: mimeType, data: data)
+        }
 
-            let html = """
+        func documentHTML(_ content: String, rule: Bool) -> String {
+            """
             <!DOCTYPE html>
             <html>
               <head>
@@ -861,40 +1005,183 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                 <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
                 <p>Imported by OneNote Helper.</p>
                 <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                \(imgHTML)
+                \(rule ? "<hr />" : "")
+                \(content)
               </body>
             </html>
             """
+        }
+
+        func fragmentHTML(_ content: String, rule: Bool) -> String {
+            """
+            <div>
+              <h2>\(escapeHTML(jobTitle))</h2>
+              <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
+              <p>Imported by OneNote Helper.</p>
+              <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
+              \(rule ? "<hr />" : "")
+              \(content)
+            </div>
+            """
+        }
+
+        /// Adds the parts for `tokens` (each once, in order) to `batch`.
+        func appendAttachments(_ tokens: [String], to batch: MultipartBody) {
+            var added: Set<String> = []
+            for token in tokens where added.insert(token).inserted {
+                guard let a = attachmentsByToken[token] else { continue }
+                batch.append(contentType: a.mimeType,
+                             contentDisposition: "form-data; name=\"\(token)\"; filename=\"\(a.filename)\"",
+                             data: a.data)
+            }
+        }
 
-            if shouldAppendToPage {
-                let fragment = """
-                <div>
-                  <h2>\(escapeHTML(jobTitle))</h2>
-                  <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
-                  <p>Imported by OneNote Helper.</p>
-                  <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                  \(imgHTML)
-                </div>
-                """
-                appendMainPartForAppend(htmlFragment: fragment)
+        func submit(_ sections: [JobSection], separator: String, rule: Bool) {
+            jobSections = sections
+            sectionSeparator = separator
+            sectionRule = rule
+        }
+
+        /// Brings the attachments within the payload limits (see PayloadTargeting). Returns the sections with
+        /// their HTML adjusted to re-encoded images, or nil (after logging why) when the job can't fit.
+        func preflight(_ sections: [JobSection]) -> [JobSection]? {
+            var parts = attachmentsByToken.mapValues { PayloadTargeting.Part(mimeType: $0.mimeType, data: $0.data) }
+            let estimate: PayloadTargeting.Estimate
+            switch PayloadTargeting.fit(&parts, htmlBytes: sections.map { $0.html.utf8.count }, tokens: sections.map(\.tokens)) {
+            case .failure(let failure):
+                self.log("ERROR: preflight: \(failure)")
+                return nil
+            case .success(let fitted):
+                estimate = fitted
+            }
+
+            var sections = sections
+            var steps: [String: Int] = [:]
+            for (token, part) in parts {
+                guard let step = part.step, let original = attachmentsByToken[token] else { continue }
+                let base = (original.filename as NSString).deletingPathExtension
+                attachmentsByToken[token] = PartAttachment(filename: base + ".jpg", mimeType: part.mimeType, data: part.data)
+                steps[step.summary, default: 0] += 1
+                // Downscaled images without an explicit width would otherwise show smaller than the other pages.
+                if step.scale < 1, let width = part.originalPixelWidth {
+                    let tag = "<img src=\"name:\(token)\" alt="
+                    for i in sections.indices where sections[i].tokens.contains(token) {
+                        sections[i].html = sections[i].html.replacingOccurrences(of: tag, with: "<img src=\"name:\(token)\" width=\"\(width)\" alt=")
+                    }
+                }
+            }
+            let budget = PayloadTargeting.budgetBytes.map { ", budget \($0 >> 20) MB" } ?? ""
+            let reduced = steps.isEmpty ? "" : "; re-encoded " + steps.keys.sorted().map { "\(steps[$0]!) as \($0)" }.joined(separator: ", ")
+            self.log("Preflight: estimated \(estimate.summary) (limits \(PayloadTargeting.partLimit >> 20) MB/part, \(JobSplitter.maxRequestBytes >> 20) MB/request\(budget))\(reduced)")
+            return sections
+        }
+
+        func createPageURL() -> String {
+            if let targetSectionId, !targetSectionId.isEmpty {
+                return self.graphURL("me/onenote/sections/\(targetSectionId)/pages")
+            }
+            return self.graphURL("me/onenote/pages")
+        }
+
+        func commandsBody(_ commands: [OneNotePatchCommand]) -> Data {
+            (try? JSONEncoder().encode(commands)) ?? Data("[]".utf8)
+        }
+
+        /// The requests for a job split into `chunks`: the first creates the page (or appends to the target page) with one
+        /// empty placeholder per later chunk; later chunks are appended into their placeholders, so they can be
+        /// sent concurrently.
+        func splitRequests(_ chunks: [[JobSection]]) -> [UploadOutbox.PreparedRequest] {
+            let splitId = JobSplitter.makeSplitID()
+            let placeholders = (1..<chunks.count)
+                .map { "<div data-id=\"\(JobSplitter.placeholderID($0, splitId: splitId))\"></div>" }
+                .joined(separator: "\n")
+            let firstContent = chunks[0].map(\.html).joined(separator: sectionSeparator) + "\n" + placeholders
+            let first = MultipartBody(boundary: "----onenote-\(UUID().uuidString)")
+            var requests: [UploadOutbox.PreparedRequest] = []
+            let pagePath: String
+            if shouldAppendToPage, let targetPageId {
+                let commands = [OneNotePatchCommand(target: "body", action: "append", content: fragmentHTML(firstContent, rule: sectionRule))]
+                first.append(contentType: "application/json; charset=utf-8",
+                             contentDisposition: "form-data; name=\"commands\"",
+                             data: commandsBody(commands))
+                appendAttachments(chunks[0].flatMap(\.tokens), to: first)
+                first.finish()
+                pagePath = self.graphURL("me/onenote/pages/\(targetPageId)/content")
+                requests.append(UploadOutbox.PreparedRequest(method: "PATCH", url: pagePath, body: first, splitId: splitId))
             } else {
-                appendMainPartForCreate(htmlDocument: html)
+                first.append(contentType: "text/html; charset=utf-8",
+                             contentDisposition: "form-data; name=\"Presentation\"",
+                             data: Data(documentHTML(firstContent, rule: sectionRule).utf8))
+                appendAttachments(chunks[0].flatMap(\.tokens), to: first)
+                first.finish()
+                // Later requests append to the page this one creates; the outbox fills in its id.
+                pagePath = self.graphURL("me/onenote/pages/\(UploadOutbox.pagePlaceholder)/content")
+                requests.append(UploadOutbox.PreparedRequest(method: "POST", url: createPageURL(), body: first, createsPage: true,
+                                                             splitId: splitId))
             }
+            self.log("Upload: request 1/\(chunks.count) \(requests[0].method) \(first.partCount) part(s), \(first.contentLength) bytes")
+
+            for k in 1..<chunks.count {
+                let content = sectionSeparator + chunks[k].map(\.html).joined(separator: sectionSeparator)
+                let batch = MultipartBody(boundary: "----onenote-\(UUID().uuidString)")
+                let commands = [OneNotePatchCommand(target: "#\(JobSplitter.placeholderID(k, splitId: splitId))", action: "append",
+                                                    content: content)]
+                batch.append(contentType: "application/json; charset=utf-8",
+                             contentDisposition: "form-data; name=\"commands\"",
+                             data: commandsBody(commands))
+                appendAttachments(chunks[k].flatMap(\.tokens), to: batch)
+                batch.finish()
+                self.log("Upload: request \(k + 1)/\(chunks.count) PATCH \(batch.partCount) part(s), \(batch.contentLength) bytes")
+                requests.append(UploadOutbox.PreparedRequest(method: "PATCH", url: pagePath, body: batch, splitId: splitId))
+            }
+            return requests
+        }
+
+        let blankAction = BlankPageDetector.action(forMode: importMode.rawValue)
+
+        /// HTML for one rendered page; blank pages become a placeholder line or nothing, per `blankAction`.
+        func renderedPageHTML(_ item: RenderedPart) -> String {
+            if item.isBlank {
+                return blankAction == .placeholder ? BlankPageDetector.placeholderHTML(pageIndex: item.pageIndex) : ""
+            }
+            return "<div style=\"margin: 12px 0;\"><img src=\"name:\(item.token)\"\(item.widthAttribute) alt=\"Page \(item.pageIndex + 1)\" /></div>\n"
+        }
+
+        func fallbackToImages() -> Bool {
+            guard let images = self.renderPDFAsPNGs(fileURL: effectiveURL, maxPages: maxPages, scale: renderScale,
+                                                    detectBlank: blankAction != .keep), !images.isEmpty else {
+                self.log("Failed to extract text or render PDF at \(filePath)")
+                return false
+            }
+
+            self.log("Upload: preparing IMAGE page for sectionId=\(UserDefaults.standard.string(forKey: targetSectionIdKey) ?? "(default)") title=\(pageTitle) renderedPages=\(images.count)")
 
-            for item in images {
-                appendMultipartPart(&body,
-                                    boundary: boundary,
-                                    contentType: "image/png",
-                                    contentDisposition: "form-data; name=\"\(item.token)\"; filename=\"\(item.filename)\"",
-                                    data: item.data)
+            for item in images where item.needsAttachment {
+                register(token: item.token, filename: item.filename, mimeType: item.mimeType, data: item.data)
             }
+            submit(images.map { JobSection(html: renderedPageHTML($0), tokens: $0.isBlank ? [] : [$0.token]) },
+                   separator: "", rule: false)
 
             return true
         }
 
+        // Set by ImportMode=auto so the upload completion can log estimated vs actual cost.
+        var autoPlan: ImportPlan?
+        // Set by ImportMode=image for a job long enough to render and upload in overlapping batches (see uploadPipelined).
+        var pipelinedPageCount: Int?
+        let pipelineBatchPages: Int = {
+            let v = UserDefaults.standard.integer(forKey: "PipelinedUploadBatchPages")
+            return v > 0 ? v : 6
+        }()
+
         switch importMode {
         case .image:
-            self.log("Import mode=Image; forcing rendered pages as PNGs")
+            self.log("Import mode=Image; forcing rendered pages as images")
+            if UserDefaults.standard.object(forKey: "PipelinedUpload") as? Bool ?? true,
+               let pageCount = PDFDocument(url: effectiveURL)?.pageCount, min(pageCount, maxPages) > pipelineBatchPages {
+                pipelinedPageCount = min(pageCount, maxPages)
+                break
+            }
             if !fallbackToImages() {
                 completion(false)
                 return
@@ -922,49 +1209,141 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             self.log("Extracted HTML preview: \(preview)")
 
             // Text-only mode: upload just the extracted text. Do not embed images and do not fall back to rendered pages.
-            var pageSections = ""
-            for (idx, pageHTMLBody) in pagesHTMLRaw.enumerated() {
-                pageSections += "<h2>Page \(idx + 1)</h2>\n"
-                pageSections += pageHTMLBody
-                if idx < pagesHTMLRaw.count - 1 {
-                    pageSections += "\n<hr />\n"
+            let sections = pagesHTMLRaw.enumerated().map { idx, pageHTMLBody in
+                JobSection(html: "<h2>Page \(idx + 1)</h2>\n" + pageHTMLBody)
+            }
+            submit(sections, separator: "\n<hr />\n", rule: true)
+
+        case .server:
+            // OneNote renders the attached PDF into page images itself: no local rasterization/encoding,
+            // and a single binary part instead of one image part per page.
+            let attachURL: URL
+            if UserDefaults.standard.object(forKey: "OptimizeAttachedPDF") as? Bool ?? true {
+                attachURL = self.optimizePDFForAttachment(fileURL: effectiveURL)
+                if attachURL != effectiveURL { temporaryFiles.append(attachURL) }
+            } else {
+                attachURL = effectiveURL
+            }
+            guard let pdfSize = (try? FileManager.default.attributesOfItem(atPath: attachURL.path)[.size] as? NSNumber)?.intValue,
+                  pdfSize > 0, FileManager.default.isReadableFile(atPath: attachURL.path) else {
+                self.log("ERROR: could not read PDF for server-side rendering: \(effectiveURL.path)")
+                completion(false)
+                return
+            }
+            self.log("Import mode=Server; attaching PDF (\(pdfSize) bytes) for OneNote-side rendering")
+
+            // The PDF is copied from disk when the body is written to the outbox, not read into memory here.
+            let attachFile = UserDefaults.standard.object(forKey: "ServerRenderAttachFile") as? Bool ?? true
+            guard OneNoteRequestBuilder.appendServerRender(pdfURL: attachURL, title: jobTitle, attachFile: attachFile,
+                                                           appending: shouldAppendToPage,
+                                                           page: { shouldAppendToPage ? fragmentHTML($0, rule: false)
+                                                                                      : documentHTML($0, rule: false) },
+                                                           to: body) else {
+                self.log("ERROR: could not attach PDF for server-side rendering: \(attachURL.path)")
+                completion(false)
+                return
+            }
+
+        case .auto:
+            guard var plan = ImportPlanner.plan(fileURL: effectiveURL, maxPages: maxPages, renderScale: renderScale) else {
+                self.log("Import mode=Auto; no page features available; falling back to images")
+                if !fallbackToImages() {
+                    completion(false)
+                    return
                 }
+                break
             }
 
-            let html = """
-            <!DOCTYPE html>
-            <html>
-              <head>
-                <meta charset="utf-8" />
-                <title>\(escapeHTML(jobTitle))</title>
-              </head>
-              <body>
-                <h1>\(escapeHTML(jobTitle))</h1>
-                <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
-                <p>Imported by OneNote Helper.</p>
-                <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                <hr />
-                \(pageSections)
-              </body>
-            </html>
-            """
+            // Text is extracted for every page the plan does not render; PS-converted output that turns out to be
+            // gibberish is re-planned as rendered images (same heuristic as hybrid, but per page).
+            var pagesHTMLRaw: [String] = []
+            if plan.pages.contains(where: { $0.strategy != .image }) {
+                pagesHTMLRaw = self.extractPDFPagesAsHTMLBodies(fileURL: effectiveURL, maxPages: maxPages) ?? []
+            }
+            let model = ImportCostModel.load()
+            for i in plan.pages.indices where plan.pages[i].strategy != .image {
+                let idx = plan.pages[i].pageIndex
+                let pageHTML = idx < pagesHTMLRaw.count ? pagesHTMLRaw[idx] : ""
+                let unusable = pageHTML.trimmingCharacters(in: .whitespacesAndNewlines).isEmpty
+                    || (psConverted && self.textLooksGibberish(self.plainTextFromHTML(pageHTML)))
+                if unusable {
+                    plan.demoteToImage(i, model: model)
+                }
+            }
+            autoPlan = plan
 
-            if shouldAppendToPage {
-                let fragment = """
-                <div>
-                  <h2>\(escapeHTML(jobTitle))</h2>
-                  <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
-                  <p>Imported by OneNote Helper.</p>
-                  <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                  <hr />
-                  \(pageSections)
-                </div>
-                """
-                appendMainPartForAppend(htmlFragment: fragment)
-            } else {
-                appendMainPartForCreate(htmlDocument: html)
+            let perPage = plan.pages.map { "p\($0.pageIndex + 1)=\($0.strategy.rawValue)(q=\(String(format: "%.2f", $0.estimatedQuality)))" }
+            self.log("Import mode=Auto; plan: \(plan.summary) threshold=\(ImportPlanner.qualityThreshold) estimated=\(String(format: "%.2f", plan.estimatedSeconds))s [\(perPage.joined(separator: " "))]")
+
+            let imagePages = plan.pageIndices(.image)
+            let hybridPages = plan.pageIndices(.hybrid)
+
+            var rendered: [RenderedPart] = []
+            if !imagePages.isEmpty {
+                guard let parts = self.renderPDFAsPNGs(fileURL: effectiveURL, maxPages: maxPages, scale: renderScale,
+                                                       pageIndices: imagePages, detectBlank: blankAction != .keep) else {
+                    self.log("Failed to render PDF at \(filePath)")
+                    completion(false)
+                    return
+                }
+                rendered = parts
+            }
+            var renderedByPage: [Int: RenderedPart] = [:]
+            for item in rendered {
+                renderedByPage[item.pageIndex] = item
+            }
+
+            var imagesByPage: [Int: [EmbeddedImagePart]] = [:]
+            var xobjImages: [EmbeddedImagePart] = []
+            if !hybridPages.isEmpty {
+                xobjImages = self.extractPDFImageXObjects(fileURL: effectiveURL, maxPages: maxPages, maxImages: maxImages)
+                    .filter { hybridPages.contains($0.pageIndex) }
+                for img in xobjImages {
+                    imagesByPage[img.pageIndex, default: []].append(img)
+                }
             }
 
+            for item in rendered where item.needsAttachment {
+                register(token: item.token, filename: item.filename, mimeType: item.mimeType, data: item.data)
+            }
+            for item in xobjImages {
+                register(token: item.token, filename: item.filename, mimeType: item.mimeType, data: item.data)
+            }
+
+            var sections: [JobSection] = []
+            for planned in plan.pages {
+                let idx = planned.pageIndex
+                if let item = renderedByPage[idx], item.isBlank {
+                    if blankAction == .placeholder {
+                        sections.append(JobSection(html: BlankPageDetector.placeholderHTML(pageIndex: idx)))
+                    }
+                    continue
+                }
+                var section = JobSection(html: "<h2>Page \(idx + 1)</h2>\n")
+                switch planned.strategy {
+                case .image:
+                    if let item = renderedByPage[idx] {
+                        section.html += renderedPageHTML(item)
+                        section.tokens.append(item.token)
+                    }
+                case .text:
+                    section.html += pagesHTMLRaw[idx]
+                case .hybrid:
+                    section.html += pagesHTMLRaw[idx]
+                    let imgs = imagesByPage[idx] ?? []
+                    if !imgs.isEmpty {
+                        section.html += "\n<div style=\"margin-top: 12px;\">\n"
+                        for (j, item) in imgs.enumerated() {
+                            section.html += "<div style=\"margin: 10px 0;\"><img src=\"name:\(item.token)\" alt=\"Image \(j + 1)\" /></div>\n"
+                            section.tokens.append(item.token)
+                        }
+                        section.html += "</div>\n"
+                    }
+                }
+                sections.append(section)
+            }
+            submit(sections, separator: "\n<hr />\n", rule: true)
+
         case .hybrid:
             if let pagesHTMLRaw = self.extractPDFPagesAsHTMLBodies(fileURL: effectiveURL, maxPages: maxPages) {
                 // Join to run heuristics + logs.
@@ -989,7 +1368,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                     self.log("Upload: preparing HYBRID (per-page) page for sectionId=\(UserDefaults.standard.string(forKey: targetSectionIdKey) ?? "(default)") title=\(pageTitle)")
 
                     // Hybrid mode: include extracted text + embedded PDF image XObjects, placed after the page text.
-                    let xobjImages = self.extractPDFImageXObjects(fileURL: effectiveURL, maxPages: min(maxPages, 200), maxImages: 400)
+                    let xobjImages = self.extractPDFImageXObjects(fileURL: effectiveURL, maxPages: maxPages, maxImages: maxImages)
                     var imagesByPage: [Int: [EmbeddedImagePart]] = [:]
                     for img in xobjImages {
                         imagesByPage[img.pageIndex, default: []].append(img)
@@ -999,68 +1378,25 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                         self.log("Found \(xobjImages.count) PDF image XObject(s); embedding as attachments")
                     }
 
-                    var pageSections = ""
+                    // Embedded images are attached as parts referenced by name:<token>.
+                    for item in xobjImages {
+                        register(token: item.token, filename: item.filename, mimeType: item.mimeType, data: item.data)
+                    }
+
+                    var sections: [JobSection] = []
                     for (idx, pageHTMLBody) in effectivePagesHTML.enumerated() {
                         let imgs = imagesByPage[idx] ?? []
-                        var imgsHTML = ""
+                        var section = JobSection(html: "<h2>Page \(idx + 1)</h2>\n" + pageHTMLBody, tokens: imgs.map(\.token))
                         if !imgs.isEmpty {
-                            imgsHTML += "\n<div style=\"margin-top: 12px;\">\n"
+                            section.html += "\n<div style=\"margin-top: 12px;\">\n"
                             for (j, item) in imgs.enumerated() {
-                                imgsHTML += "<div style=\"margin: 10px 0;\"><img src=\"name:\(item.token)\" alt=\"Image \(j + 1)\" /></div>\n"
+                                section.html += "<div style=\"margin: 10px 0;\"><img src=\"name:\(item.token)\" alt=\"Image \(j + 1)\" /></div>\n"
                             }
-                            imgsHTML += "</div>\n"
+                            section.html += "</div>\n"
                         }
-
-                        pageSections += "<h2>Page \(idx + 1)</h2>\n"
-                        pageSections += pageHTMLBody
-                        pageSections += imgsHTML
-                        if idx < pagesHTMLRaw.count - 1 {
-                            pageSections += "\n<hr />\n"
-                        }
-                    }
-
-                    let html = """
-                    <!DOCTYPE html>
-                    <html>
-                      <head>
-                        <meta charset="utf-8" />
-                        <title>\(escapeHTML(jobTitle))</title>
-                      </head>
-                      <body>
-                        <h1>\(escapeHTML(jobTitle))</h1>
-                        <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
-                        <p>Imported by OneNote Helper.</p>
-                        <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                        <hr />
-                        \(pageSections)
-                      </body>
-                    </html>
-                    """
-
-                    if shouldAppendToPage {
-                        let fragment = """
-                        <div>
-                          <h2>\(escapeHTML(jobTitle))</h2>
-                          <p><b>Source:</b> \(escapeHTML(pageTitle))</p>
-                          <p>Imported by OneNote Helper.</p>
-                          <p>User: \(escapeHTML(user)) &nbsp; Job: \(escapeHTML(job))</p>
-                          <hr />
-                          \(pageSections)
-                        </div>
-                        """
-                        appendMainPartForAppend(htmlFragment: fragment)
-                    } else {
-                        appendMainPartForCreate(htmlDocument: html)
-                    }
-
-                    // Attach embedded images referenced by name:<token>.
-                    for item in xobjImages {
-                        appendMultipartPart(&body,
-                                            boundary: boundary,
-                                            contentType: item.mimeType,
-                                            contentDisposition: "form-data; name=\"\(item.token)\"; filename=\"\(item.filename)\"",
-                                            data: item.data)
+                        sections.append(section)
                     }
+                    submit(sections, separator: "\n<hr />\n", rule: true)
                 } else {
                     self.log("Extracted HTML empty; falling back to images")
                     if !fallbackToImages() {
@@ -1079,58 +1415,361 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
             }
         }
 
-        body.append("--\(boundary)--\r\n".data(using: .utf8)!)
+        let executedPlan = autoPlan
+        func logPlanOutcome(ok: Bool) {
+            guard let executedPlan else { return }
+            let actual = Date().timeIntervalSince(executedPlan.startedAt)
+            self.log("Auto plan cost: estimated=\(String(format: "%.2f", executedPlan.estimatedSeconds))s actual=\(String(format: "%.2f", actual))s (\(executedPlan.summary))")
+            if ok {
+                ImportPlanner.recordActual(plan: executedPlan, actualSeconds: actual)
+            }
+        }
 
-        let urlString: String
-        let method: String
-        if shouldAppendToPage, let targetPageId, !targetPageId.isEmpty {
-            urlString = self.graphURL("me/onenote/pages/\(targetPageId)/content")
-            method = "PATCH"
-        } else if let targetSectionId, !targetSectionId.isEmpty {
-            urlString = self.graphURL("me/onenote/sections/\(targetSectionId)/pages")
-            method = "POST"
-        } else {
-            // Fallback to default notebook/section behavior.
-            urlString = self.graphURL("me/onenote/pages")
-            method = "POST"
+        func singleRequest() -> UploadOutbox.PreparedRequest {
+            body.finish()
+            self.log("Upload: multipart body \(body.partCount) part(s), \(body.contentLength) bytes")
+            if shouldAppendToPage, let targetPageId, !targetPageId.isEmpty {
+                return UploadOutbox.PreparedRequest(method: "PATCH", url: self.graphURL("me/onenote/pages/\(targetPageId)/content"), body: body)
+            }
+            // Falls back to the default notebook/section when no section is selected.
+            return UploadOutbox.PreparedRequest(method: "POST", url: createPageURL(), body: body)
+        }
+
+        func report(_ attempt: UploadOutbox.Attempt, requestCount: Int) {
+            switch attempt {
+            case .sent:
+                let count = requestCount > 1 ? " (\(requestCount) requests)" : ""
+                self.log("Graph upload succeeded\(count) [transport: \(GraphTransport.shared.stats.summary)]")
+                logPlanOutcome(ok: true)
+                completion(true)
+            case .failed(let reason):
+                self.log("Graph upload failed: \(reason)")
+                logPlanOutcome(ok: false)
+                completion(false)
+            case .deferred(let delay):
+                self.log("Graph upload deferred: kept in the outbox, retry in \(Int(delay))s")
+                logPlanOutcome(ok: false)
+                completion(false)
+            }
         }
 
-        guard let url = URL(string: urlString) else {
-            log("Invalid Graph URL")
-            completion(false)
-            return
+        /// Image mode for long jobs: pages are rendered in batches on another thread while this one stores and sends
+        /// the batches already encoded, so rendering and the network overlap. The first request creates the page (or
+        /// appends to the target page) with one empty placeholder per later page, and later requests fill the
+        /// placeholders of their pages: a batch can be split like any job (see JobSplitter) and its requests sent
+        /// concurrently. Each batch is preflighted on its own and added to an open outbox entry, which gets the
+        /// usual retries once the last batch is in; a failed send stops sending, not rendering.
+        func uploadPipelined(pageCount total: Int) {
+            let batches: [Set<Int>] = stride(from: 0, to: total, by: pipelineBatchPages)
+                .map { Set($0..<min($0 + pipelineBatchPages, total)) }
+            self.log("Upload: pipelined IMAGE import, \(total) page(s) in \(batches.count) batch(es) of \(pipelineBatchPages)")
+
+            let splitId = JobSplitter.makeSplitID()
+            let entry: UploadOutbox.Entry
+            do {
+                entry = try UploadOutbox.shared.open(label: fileURL.lastPathComponent, user: user,
+                                                     sourceFiles: sourceFiles.map(\.path), splitId: splitId)
+            } catch {
+                report(.failed("could not write upload to the outbox: \(error.localizedDescription)"), requestCount: 0)
+                return
+            }
+
+            // One batch rendered ahead of the one being sent.
+            let channel = BoundedChannel<[RenderedPart]>(capacity: 1)
+            DispatchQueue.global(qos: .userInitiated).async {
+                for pages in batches {
+                    let slot = JobScheduler.shared.enter(.cpu)
+                    let rendered = self.renderPDFAsPNGs(fileURL: effectiveURL, maxPages: total, scale: renderScale,
+                                                        pageIndices: pages, detectBlank: blankAction != .keep)
+                    slot.leave()
+                    guard let parts = rendered else {
+                        self.log("Failed to render pages \(pages.min()! + 1)-\(pages.max()! + 1) of \(filePath)")
+                        break
+                    }
+                    guard channel.send(parts) else { return }
+                }
+                channel.close()
+            }
+
+            let pagePath: String
+            if shouldAppendToPage, let targetPageId {
+                pagePath = self.graphURL("me/onenote/pages/\(targetPageId)/content")
+            } else {
+                // Later requests append to the page the first one creates; the outbox fills in its id.
+                pagePath = self.graphURL("me/onenote/pages/\(UploadOutbox.pagePlaceholder)/content")
+            }
+            var requestCount = 0
+            var batchesDone = 0
+            var failure: String?
+            var sendError: String?
+            while failure == nil, let parts = channel.receive() {
+                // Only this batch's parts are kept in memory.
+                attachmentsByToken = [:]
+                for item in parts where item.needsAttachment {
+                    register(token: item.token, filename: item.filename, mimeType: item.mimeType, data: item.data)
+                }
+                let pages = parts.map(\.pageIndex)
+                guard let sections = preflight(parts.map { JobSection(html: renderedPageHTML($0), tokens: $0.isBlank ? [] : [$0.token]) }) else {
+                    failure = "batch \(batchesDone + 1)/\(batches.count) does not fit the payload limits"
+                    break
+                }
+
+                var requests: [UploadOutbox.PreparedRequest] = []
+                let ranges = JobSplitter.partition(htmlBytes: sections.map { $0.html.utf8.count },
+                                                   tokens: sections.map(\.tokens),
+                                                   partBytes: attachmentsByToken.mapValues { $0.data.count })
+                for range in ranges {
+                    let batch = MultipartBody(boundary: "----onenote-\(UUID().uuidString)")
+                    if requestCount == 0, requests.isEmpty {
+                        let placeholders = ((pages[range.upperBound - 1] + 1)..<total)
+                            .map { "<div data-id=\"\(JobSplitter.placeholderID($0 + 1, splitId: splitId))\"></div>" }
+                            .joined(separator: "\n")
+                        let content = sections[range].map(\.html).joined() + "\n" + placeholders
+                        OneNoteRequestBuilder.appendPage(html: shouldAppendToPage ? fragmentHTML(content, rule: false)
+                                                                                  : documentHTML(content, rule: false),
+                                                         appending: shouldAppendToPage, to: batch)
+                        appendAttachments(sections[range].flatMap(\.tokens), to: batch)
+                        batch.finish()
+                        requests.append(shouldAppendToPage
+                            ? UploadOutbox.PreparedRequest(method: "PATCH", url: pagePath, body: batch, splitId: splitId)
+                            : UploadOutbox.PreparedRequest(method: "POST", url: createPageURL(), body: batch, createsPage: true,
+                                                           splitId: splitId))
+                    } else {
+                        // Skipped blank pages leave their placeholder empty.
+                        let commands = range.filter { !sections[$0].html.isEmpty }.map {
+                            OneNotePatchCommand(target: "#\(JobSplitter.placeholderID(pages[$0] + 1, splitId: splitId))",
+                                                action: "append", content: sections[$0].html)
+                        }
+                        guard !commands.isEmpty else { continue }
+                        batch.append(contentType: "application/json; charset=utf-8",
+                                     contentDisposition: "form-data; name=\"commands\"",
+                                     data: commandsBody(commands))
+                        appendAttachments(sections[range].flatMap(\.tokens), to: batch)
+                        batch.finish()
+                        requests.append(UploadOutbox.PreparedRequest(method: "PATCH", url: pagePath, body: batch, splitId: splitId))
+                    }
+                    self.log("Upload: request \(requestCount + requests.count) \(requests.last!.method) pages \(pages[range.lowerBound] + 1)-\(pages[range.upperBound - 1] + 1), \(batch.partCount) part(s), \(batch.contentLength) bytes")
+                }
+
+                do {
+                    try UploadOutbox.shared.add(requests, to: entry.id)
+                } catch {
+                    failure = "could not write upload to the outbox: \(error.localizedDescription)"
+                    break
+                }
+                requestCount += requests.count
+                batchesDone += 1
+
+                guard sendError == nil else { continue }
+                switch UploadOutbox.shared.sendAdded(entry.id) {
+                case nil, .sent?:
+                    break
+                case .retry(let reason)?:
+                    sendError = reason
+                    self.log("Graph upload interrupted (\(reason)); storing the remaining pages for a retry")
+                case .failed(let reason)?:
+                    failure = reason
+                }
+            }
+            channel.cancel()
+            attachmentsByToken = [:]
+
+            if failure == nil, batchesDone < batches.count {
+                failure = "rendering stopped after \(batchesDone)/\(batches.count) batch(es)"
+            }
+            if let failure {
+                UploadOutbox.shared.discard(entry.id)
+                report(.failed(failure), requestCount: requestCount)
+                return
+            }
+            UploadOutbox.shared.close(entry.id)
+            report(UploadOutbox.shared.run(entry.id, firstAttempt: true), requestCount: requestCount)
         }
 
-        var request = URLRequest(url: url)
-        request.httpMethod = method
-        request.setValue("Bearer \(token)", forHTTPHeaderField: "Authorization")
-        request.setValue("multipart/form-data; boundary=\(boundary)", forHTTPHeaderField: "Content-Type")
-        request.setValue("application/json", forHTTPHeaderField: "Accept")
-        request.httpBody = body
+        if let pageCount = pipelinedPageCount {
+            cpuSlot.leave()
+            uploadPipelined(pageCount: pageCount)
+            return
+        }
 
-        let task = URLSession.shared.dataTask(with: request) { data, response, error in
-            if let error = error {
-                self.log("Graph upload failed: \(error.localizedDescription)")
+        // Checked before anything is sent: a job that can't fit the limits fails now, with the reason.
+        let requests: [UploadOutbox.PreparedRequest]
+        if let submitted = jobSections {
+            guard let sections = preflight(submitted) else {
+                logPlanOutcome(ok: false)
                 completion(false)
                 return
             }
-
-            if let http = response as? HTTPURLResponse, http.statusCode >= 300 {
-                let payload = data.flatMap { String(data: $0, encoding: .utf8) } ?? ""
-                self.log("Graph upload failed (\(http.statusCode)): \(payload)")
+            let ranges = JobSplitter.partition(htmlBytes: sections.map { $0.html.utf8.count },
+                                               tokens: sections.map(\.tokens),
+                                               partBytes: attachmentsByToken.mapValues { $0.data.count })
+            if ranges.count > 1 {
+                self.log("Upload: \(sections.count) section(s) split into \(ranges.count) requests (limits \(JobSplitter.maxRequestBytes >> 20) MB, \(JobSplitter.maxParts) parts)")
+                requests = splitRequests(ranges.map { Array(sections[$0]) })
+            } else if shouldAppendToPage, let targetPageId, AppendBatcher.isEnabled {
+                // Other append jobs for the same page arriving within a short window share one PATCH.
+                var seen: Set<String> = []
+                let attachments = sections.flatMap(\.tokens).filter { seen.insert($0).inserted }.compactMap { token in
+                    attachmentsByToken[token].map {
+                        AppendBatcher.Attachment(token: token, filename: $0.filename, mimeType: $0.mimeType, data: $0.data)
+                    }
+                }
+                let content = sections.map(\.html).joined(separator: sectionSeparator)
+                let job = AppendBatcher.Job(label: fileURL.lastPathComponent, user: user, sourceFiles: sourceFiles.map(\.path),
+                                            fragment: fragmentHTML(content, rule: sectionRule), attachments: attachments) {
+                    report($0, requestCount: 1)
+                }
+                cpuSlot.leave()
+                // Waiting for the batch needs no worker: let the next job start converting meanwhile.
+                releaseWorker?()
+                AppendBatcher.shared.add(job, pageId: targetPageId)
+                return
+            } else {
+                let content = sections.map(\.html).joined(separator: sectionSeparator)
+                if shouldAppendToPage {
+                    appendMainPartForAppend(htmlFragment: fragmentHTML(content, rule: sectionRule))
+                } else {
+                    appendMainPartForCreate(htmlDocument: documentHTML(content, rule: sectionRule))
+                }
+                appendAttachments(sections.flatMap(\.tokens), to: body)
+                requests = [singleRequest()]
+            }
+        } else {
+            // Server mode: one body with the attached PDF, which can be neither split nor re-encoded.
+            let request = singleRequest()
+            if let failure = PayloadTargeting.check(requestBytes: body.contentLength) {
+                self.log("ERROR: preflight: \(failure)")
+                logPlanOutcome(ok: false)
                 completion(false)
                 return
             }
+            requests = [request]
+        }
 
-            self.log("Graph upload succeeded")
-            completion(true)
+        cpuSlot.leave()
+        report(self.deliverUpload(requests, label: fileURL.lastPathComponent, user: user, sourceFiles: sourceFiles.map(\.path)),
+               requestCount: requests.count)
+    }
+
+    /// Stores the prepared requests in the outbox and makes the first attempt. They are kept on disk until
+    /// sent, so a failed upload is retried without redoing the conversion (see UploadOutbox).
+    nonisolated private func deliverUpload(_ requests: [UploadOutbox.PreparedRequest], label: String, user: String,
+                                           sourceFiles: [String]) -> UploadOutbox.Attempt {
+        let entry: UploadOutbox.Entry
+        do {
+            entry = try UploadOutbox.shared.enqueue(label: label, user: user, sourceFiles: sourceFiles, requests: requests)
+        } catch {
+            return .failed("could not write upload to the outbox: \(error.localizedDescription)")
         }
-        task.resume()
+        return UploadOutbox.shared.run(entry.id, firstAttempt: true)
+    }
+
+    /// Sends one outbox request, uploading its body file as-is. Connection errors, throttling that outlasted
+    /// `sendGraphRequest`'s retries, 401 and server errors are worth retrying later; other errors are final.
+    nonisolated private func sendOutboxRequest(_ request: UploadOutbox.Request, url urlString: String, bodyURL: URL) -> UploadOutbox.SendResult {
+        guard let url = URL(string: urlString), !urlString.contains(UploadOutbox.pagePlaceholder) else {
+            return .failed("invalid Graph URL \(urlString)")
+        }
+        guard let length = (try? FileManager.default.attributesOfItem(atPath: bodyURL.path)[.size] as? NSNumber)?.intValue else {
+            return .failed("request body missing: \(bodyURL.lastPathComponent)")
+        }
+
+        // Retries can run long after the job (or in a later session): take the current token from the cache. Never
+        // interactively: a retry must not pop up a sign-in window; without a token it waits for the next attempt.
+        final class TokenBox {
+            var token: String?
+        }
+        let box = TokenBox()
+        let got = DispatchSemaphore(value: 0)
+        GraphTokenCache.shared.get(interactive: false) { token in
+            box.token = token
+            got.signal()
+        }
+        got.wait()
+        guard let token = box.token else { return .retry("no Graph token") }
+
+        // A page that was just created can briefly 404 on PATCH, so those are retried a few times.
+        for attempt in 1...4 {
+            let result = self.sendGraphRequest(token: token, bodyFile: bodyURL) {
+                var r = URLRequest(url: url)
+                r.httpMethod = request.method
+                r.setValue("Bearer \(token)", forHTTPHeaderField: "Authorization")
+                r.setValue(request.contentType, forHTTPHeaderField: "Content-Type")
+                r.setValue("application/json", forHTTPHeaderField: "Accept")
+                r.setValue(String(length), forHTTPHeaderField: "Content-Length")
+                return r
+            }
+
+            if let error = result.error {
+                return .retry(error.localizedDescription)
+            }
+            let status = result.response?.statusCode ?? 0
+            if status == 404, request.method == "PATCH", attempt < 4 {
+                Thread.sleep(forTimeInterval: Double(attempt) * 2)
+                continue
+            }
+            if status >= 300 {
+                let payload = result.data.flatMap { String(data: $0, encoding: .utf8) } ?? ""
+                self.log("Graph request failed (\(status)): \(payload)")
+                let retryable = status == 401 || status == 408 || GraphRateController.isThrottled(status) || status >= 500
+                return retryable ? .retry("HTTP \(status)") : .failed("HTTP \(status)")
+            }
+            return .sent(result.data ?? Data())
+        }
+        return .retry("page not found")
+    }
+
+    /// Sends a Graph request synchronously (call from a background thread) through the account's
+    /// GraphRateController, which retries throttled (429/503) responses after their Retry-After instead of failing.
+    /// Each attempt also takes a network slot. `makeRequest` is called per attempt; a `bodyFile` is sent as an
+    /// upload task.
+    nonisolated private func sendGraphRequest(token: String, bodyFile: URL? = nil, _ makeRequest: () -> URLRequest)
+        -> (data: Data?, response: HTTPURLResponse?, error: Error?) {
+        let controller = GraphRateController.shared
+        let key = GraphRateController.key(forAccessToken: token)
+        let result = controller.send(key: key, session: GraphTransport.shared.session, bodyFile: bodyFile,
+                                     slot: { JobScheduler.shared.enter(.network).leave },
+                                     onThrottled: { status, retry, delay in
+            self.log("Graph throttled (\(status)); retry \(retry)/\(GraphRateController.maxRetries) in \(String(format: "%.1f", delay))s [\(controller.summary(key: key))]")
+        }, makeRequest)
+        if result.response?.statusCode == 401 {
+            // Revoked or expired early: make the next job acquire a fresh token.
+            GraphTokenCache.shared.invalidate()
+        }
+        return result
     }
 
     private struct RenderedPart {
+        let pageIndex: Int
         let token: String
         let filename: String
+        let mimeType: String
+        let data: Data
+        /// Display width (px) when the page was rendered below the job scale, so every page shows at the same size.
+        var displayWidth: Int? = nil
+        /// Blank page detected: nothing to attach (see BlankPageDetector).
+        var isBlank: Bool = false
+        /// Same content as an earlier page of the job: `token` is that page's part, nothing to attach.
+        var isDuplicate: Bool = false
+
+        var needsAttachment: Bool {
+            !isBlank && !isDuplicate
+        }
+
+        var widthAttribute: String {
+            displayWidth.map { " width=\"\($0)\"" } ?? ""
+        }
+    }
+
+    /// One page's share of a job's OneNote content: its HTML and the tokens of the parts it references.
+    private struct JobSection {
+        var html: String
+        var tokens: [String] = []
+    }
+
+    private struct PartAttachment {
+        let filename: String
+        let mimeType: String
         let data: Data
     }
 
@@ -1188,6 +1827,33 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         return nil
     }
 
+    /// Size-optimizes a PDF that is going to be attached as-is (via the Ghostscript XPC service).
+    /// Returns the optimized copy if it is smaller, otherwise the original URL.
+    nonisolated private func optimizePDFForAttachment(fileURL: URL) -> URL {
+        let tmpURL = URL(fileURLWithPath: NSTemporaryDirectory(), isDirectory: true)
+            .appendingPathComponent("onenotehelper-opt-\(UUID().uuidString).pdf")
+        let downsampleDPI = UserDefaults.standard.integer(forKey: "OptimizeDownsampleDPI")
+        let fm = FileManager.default
+        let before = (try? fm.attributesOfItem(atPath: fileURL.path)[.size] as? NSNumber)?.intValue ?? 0
+
+        let started = Date()
+        let res = GhostscriptXPCClient.optimizePDF(inPath: fileURL.path, outPath: tmpURL.path, downsampleDPI: downsampleDPI, timeoutSeconds: 90)
+        let ms = Int(Date().timeIntervalSince(started) * 1000)
+
+        guard res.ok else {
+            self.log("PDF optimize failed after \(ms) ms; attaching original. \(res.logs)")
+            return fileURL
+        }
+        let after = (try? fm.attributesOfItem(atPath: tmpURL.path)[.size] as? NSNumber)?.intValue ?? 0
+        guard after > 0, after < before, PDFDocument(url: tmpURL) != nil else {
+            self.log("PDF optimize: before=\(before) after=\(after) bytes in \(ms) ms; keeping original")
+            try? fm.removeItem(at: tmpURL)
+            return fileURL
+        }
+        let saved = before > 0 ? Double(before - after) * 100 / Double(before) : 0
+        self.log("PDF optimize: before=\(before) after=\(after) bytes (-\(String(format: "%.1f", saved))%) in \(ms) ms, downsampleDPI=\(downsampleDPI)")
+        return tmpURL
+    }
 
     nonisolated private func plainTextFromHTML(_ html: String) -> String {
         // Very small HTML stripper for heuristic purposes.
@@ -1233,7 +1899,7 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         return false
     }
 
-    nonisolated private func renderPDFAsPNGs(fileURL: URL, maxPages: Int, scale: CGFloat) -> [RenderedPart]? {
+    nonisolated private func renderPDFAsPNGs(fileURL: URL, maxPages: Int, scale: CGFloat, pageIndices: Set<Int>? = nil, detectBlank: Bool = false) -> [RenderedPart]? {
         // Prefer dataRepresentation load to avoid file coordination/sandbox oddities.
         let doc: PDFDocument?
         if let data = try? Data(contentsOf: fileURL) {
@@ -1245,35 +1911,246 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         let pageCount = min(doc.pageCount, maxPages)
         if pageCount <= 0 { return [] }
 
+        let selected = (0..<pageCount).filter { pageIndices?.contains($0) ?? true }
+
+        // Content features drive the blank-page precheck and the adaptive render scale.
+        var features: [Int: PDFPageFeatures] = [:]
+        if detectBlank || RenderScaleSelector.isEnabled || RasterCrop.isEnabled, let cgDoc = CGPDFDocument(fileURL as CFURL) {
+            for i in selected {
+                if let page = cgDoc.page(at: i + 1) {
+                    features[i] = PDFPageFeatureExtractor.extract(page: page, pageIndex: i)
+                }
+            }
+        }
+
         var parts: [RenderedPart] = []
-        parts.reserveCapacity(pageCount)
+        parts.reserveCapacity(selected.count)
+        var passthroughCount = 0
+        var blankCount = 0
+        var toRender: [Int] = []
+        let early = EarlyPageStore.shared.entry(for: fileURL, renderScale: scale)
 
-        for i in 0..<pageCount {
+        func blankPart(_ i: Int) -> RenderedPart {
+            blankCount += 1
+            return RenderedPart(pageIndex: i, token: "img\(i + 1)", filename: "", mimeType: "", data: Data(), isBlank: true)
+        }
+
+        for i in selected {
             guard let page = doc.page(at: i) else { continue }
-            let bounds = page.bounds(for: .mediaBox)
-            let targetSize = CGSize(width: max(1, bounds.width * scale), height: max(1, bounds.height * scale))
-
-            let image = NSImage(size: targetSize)
-            image.lockFocusFlipped(false)
-            if let ctx = NSGraphicsContext.current?.cgContext {
-                ctx.setFillColor(NSColor.white.cgColor)
-                ctx.fill(CGRect(origin: .zero, size: targetSize))
-                ctx.saveGState()
-                ctx.scaleBy(x: scale, y: scale)
-                page.draw(with: .mediaBox, to: ctx)
-                ctx.restoreGState()
-            }
-            image.unlockFocus()
-
-            guard let tiff = image.tiffRepresentation,
-                  let rep = NSBitmapImageRep(data: tiff),
-                  let png = rep.representation(using: .png, properties: [:]) else {
+
+            // The scan found nothing that paints: a low-resolution render is enough to confirm the page is blank.
+            if detectBlank, features[i]?.paintsNothing == true, let cgPage = page.pageRef, BlankPageDetector.isBlank(page: cgPage) {
+                parts.append(blankPart(i))
+                continue
+            }
+
+            // Scanned pages: attach the original JPEG instead of rendering + PNG-encoding it.
+            if JPEGPassthrough.isEnabled, let cgPage = page.pageRef,
+               let jpeg = JPEGPassthrough.fullPageJPEG(page: cgPage, pageIndex: i) {
+                if detectBlank, BlankPageDetector.isBlank(jpeg: jpeg) {
+                    parts.append(blankPart(i))
+                    continue
+                }
+                parts.append(RenderedPart(pageIndex: i,
+                                          token: "img\(i + 1)",
+                                          filename: String(format: "page-%03d.jpg", i + 1),
+                                          mimeType: "image/jpeg",
+                                          data: jpeg))
+                passthroughCount += 1
                 continue
             }
 
-            let token = "img\(i + 1)"
-            let filename = String(format: "page-%03d.png", i + 1)
-            parts.append(RenderedPart(token: token, filename: filename, data: png))
+            toRender.append(i)
+        }
+
+        // Per-page scales from the content (smallest text, vector density, image DPI), within the job pixel budget.
+        var pageScales: [Int: CGFloat] = [:]
+        if RenderScaleSelector.isEnabled, !toRender.isEmpty {
+            let renderFeatures = toRender.compactMap { features[$0] }
+            pageScales = RenderScaleSelector.scales(for: renderFeatures, maxScale: scale)
+            let atMax = RenderScaleSelector.megapixels(renderFeatures, scales: Dictionary(uniqueKeysWithValues: renderFeatures.map { ($0.pageIndex, scale) }))
+            let chosen = RenderScaleSelector.megapixels(renderFeatures, scales: pageScales)
+            var histogram: [CGFloat: Int] = [:]
+            for s in pageScales.values { histogram[s, default: 0] += 1 }
+            let desc = histogram.keys.sorted().map { "\($0)x=\(histogram[$0]!)" }.joined(separator: " ")
+            self.log("Render: adaptive scale \(desc); \(String(format: "%.1f", chosen)) MP vs \(String(format: "%.1f", atMax)) MP at \(scale)x (budget \(Int(RenderScaleSelector.pixelBudgetMegapixels)) MP)")
+        }
+
+        // Page 1 may already have been rendered while the job was spooling. It is reused only at the scale this
+        // job picks for it, and a blank result only when this job skips blank pages too; otherwise it is rendered again.
+        if let early, toRender.first == 0 {
+            let pageScale = pageScales[0] ?? scale
+            if pageScale != early.pageScale {
+                self.log("Render: page 1 was rendered early at \(early.pageScale)x, this job renders it at \(pageScale)x; rendering again")
+            } else if early.isBlank, detectBlank {
+                toRender.removeFirst()
+                parts.insert(blankPart(0), at: 0)
+            } else if !early.isBlank, let rendered = early.rendered {
+                toRender.removeFirst()
+                let ext = rendered.mimeType == "image/jpeg" ? "jpg" : "png"
+                parts.insert(RenderedPart(pageIndex: 0,
+                                          token: "img1",
+                                          filename: "page-001.\(ext)",
+                                          mimeType: rendered.mimeType,
+                                          data: rendered.data,
+                                          displayWidth: early.displayWidth), at: 0)
+            }
+        }
+
+        // Cross-job cache and in-job dedupe, keyed by a hash of the page content + resources + render parameters.
+        let cache = RenderedPageCache.isEnabled ? RenderedPageCache.shared : nil
+        var cacheKeys: [Int: String] = [:]
+        var duplicateOf: [Int: Int] = [:]
+        var cached: [EncodedPage] = []
+        if let cache, !toRender.isEmpty, let cgDoc = CGPDFDocument(fileURL as CFURL) {
+            let parameters = [
+                "crop=\(RasterCrop.isEnabled ? RasterCrop.paddingPoints : -1)",
+                "reduce=\(PNGColorReduction.isEnabled)/\(PNGColorReduction.ditherEnabled)",
+                "photo=\(PageFormatClassifier.isEnabled ? "\(PageFormatClassifier.jpegQuality)/\(PageFormatClassifier.entropyThreshold)" : "off")",
+                "level=\(PNGStreamEncoder.Level.configured.rawValue)",
+                "blank=\(detectBlank ? "\(BlankPageDetector.inkThreshold)/\(BlankPageDetector.maxInkFraction)" : "off")",
+                "band=\(PDFKitRasterBackend.bandedThresholdPixels)"
+            ].joined(separator: "|")
+            var firstWithKey: [String: Int] = [:]
+            let digestMemo = PDFDigestMemo()
+            toRender.removeAll { i in
+                guard let page = cgDoc.page(at: i + 1),
+                      let key = RenderedPageCache.key(page: page, parameters: "\(parameters)|scale=\(pageScales[i] ?? scale)",
+                                                      memo: digestMemo) else { return false }
+                if let first = firstWithKey[key] {
+                    duplicateOf[i] = first
+                    return true
+                }
+                firstWithKey[key] = i
+                if let hit = cache.lookup(key, pageIndex: i) {
+                    cached.append(hit)
+                    return true
+                }
+                cacheKeys[i] = key
+                return false
+            }
+            if !cached.isEmpty || !duplicateOf.isEmpty {
+                self.log("Render: page cache \(cached.count) hit(s), \(duplicateOf.count) duplicate page(s) within the job")
+            }
+        }
+
+        // White margins: pages whose content extent is known up front render only that region; every
+        // rendered page is then cropped to its ink bounding box before encoding.
+        let autoCrop = RasterCrop.isEnabled
+        let paddingPoints = CGFloat(RasterCrop.paddingPoints)
+        var regionHints: [Int: PDFKitRasterBackend.RegionHint] = [:]
+        if autoCrop {
+            for i in toRender {
+                // Only when the scan saw everything: annotations and shadings aren't in graphicsBounds, an incomplete
+                // scan may have missed content, Type3 glyphs can draw past the text layout, and text is only
+                // trusted when every font maps to Unicode.
+                guard let f = features[i], f.annotationCount == 0, !f.hasUnboundedPaint, !f.scanIncomplete, !f.usesType3Font,
+                      f.visibleTextRunCount == 0 || f.textFidelity >= 1,
+                      doc.page(at: i)?.rotation == 0 else { continue }
+                regionHints[i] = PDFKitRasterBackend.RegionHint(graphics: f.graphicsBounds, hasText: f.visibleTextRunCount > 0)
+            }
+        }
+
+        // Oversized pages (posters, plots) are rendered in bands, one at a time, after the parallel batch.
+        var banded: [Int] = []
+        toRender.removeAll { i in
+            guard let bounds = doc.page(at: i)?.bounds(for: .mediaBox) else { return false }
+            let s = pageScales[i] ?? scale
+            let oversized = Double(bounds.width * s * bounds.height * s) > PDFKitRasterBackend.bandedThresholdPixels
+            if oversized { banded.append(i) }
+            return oversized
+        }
+
+        // Everything else is rasterized + encoded concurrently, one PDFKit document per worker.
+        if !toRender.isEmpty || !banded.isEmpty || !cached.isEmpty {
+            guard let backend = PDFKitRasterBackend(fileURL: fileURL, scale: scale, pageScales: pageScales,
+                                                    regionHints: regionHints, paddingPoints: paddingPoints) else { return nil }
+            let started = Date()
+            let scales = pageScales
+            let imageCoverage = features.mapValues { $0.imageCoverage }
+            let renderer = ParallelPageRenderer(backend: backend) { pageIndex, raster in
+                // Near-blank after rendering (white fills, specks): skip the encode too.
+                if detectBlank, BlankPageDetector.isBlank(raster) {
+                    return EncodedPage(pageIndex: pageIndex, mimeType: "", fileExtension: "", data: Data(), isBlank: true)
+                }
+                let pagePadding = Int((paddingPoints * (scales[pageIndex] ?? scale)).rounded())
+                let region = autoCrop ? RasterCrop.contentRegion(raster, padding: pagePadding) : nil
+                return PDFKitRasterBackend.encodePage(pageIndex: pageIndex, raster: raster, region: region,
+                                                      imageCoverage: imageCoverage[pageIndex] ?? 0)
+            }
+            var encoded: [EncodedPage] = []
+            renderer.run(pageIndices: toRender) { _, page in
+                // Called serially, in page order.
+                if let page { encoded.append(page) }
+                return true
+            }
+            for i in banded {
+                guard let page = doc.page(at: i),
+                      let result = PDFKitRasterBackend.encodeBanded(pageIndex: i, page: page, scale: pageScales[i] ?? scale,
+                                                                    detectBlank: detectBlank) else { continue }
+                encoded.append(result)
+            }
+            if let cache {
+                for page in encoded {
+                    if let key = cacheKeys[page.pageIndex] { cache.store(page, for: key) }
+                }
+            }
+            let renderedCount = encoded.count
+            encoded += cached
+            for page in encoded {
+                if page.isBlank {
+                    parts.append(blankPart(page.pageIndex))
+                    continue
+                }
+                var part = RenderedPart(pageIndex: page.pageIndex,
+                                        token: "img\(page.pageIndex + 1)",
+                                        filename: String(format: "page-%03d.\(page.fileExtension)", page.pageIndex + 1),
+                                        mimeType: page.mimeType,
+                                        data: page.data)
+                if let pageScale = pageScales[page.pageIndex], pageScale != scale, page.pixelWidth > 0 {
+                    part.displayWidth = Int((CGFloat(page.pixelWidth) * scale / pageScale).rounded())
+                }
+                parts.append(part)
+            }
+            parts.sort { $0.pageIndex < $1.pageIndex }
+            let ms = Int(Date().timeIntervalSince(started) * 1000)
+            self.log("Render: \(renderedCount)/\(toRender.count + banded.count) page(s) (\(banded.count) banded) rendered+encoded in \(ms) ms with \(ParallelPageRenderer.defaultWorkerCount) worker(s)"
+                     + (autoCrop ? "; \(regionHints.count) page(s) eligible for content-region rendering" : ""))
+            var formats: [String: Int] = [:]
+            for page in encoded where !page.isBlank {
+                self.log("Render: p\(page.pageIndex + 1) \(page.format) \(page.data.count) bytes")
+                let kind = page.format.split(separator: " ").first.map(String.init) ?? page.format
+                formats[kind, default: 0] += 1
+            }
+            if !formats.isEmpty {
+                let bytes = encoded.reduce(0) { $0 + $1.data.count }
+                self.log("Render: formats \(formats.keys.sorted().map { "\($0)=\(formats[$0]!)" }.joined(separator: " ")); \(bytes) bytes total")
+            }
+        }
+
+        // Repeated pages point at the first copy's part instead of being attached again.
+        if !duplicateOf.isEmpty {
+            var byPage: [Int: RenderedPart] = [:]
+            for part in parts { byPage[part.pageIndex] = part }
+            for (i, first) in duplicateOf {
+                guard let original = byPage[first] else { continue }
+                if original.isBlank {
+                    parts.append(blankPart(i))
+                    continue
+                }
+                parts.append(RenderedPart(pageIndex: i, token: original.token, filename: original.filename,
+                                          mimeType: original.mimeType, data: Data(),
+                                          displayWidth: original.displayWidth, isDuplicate: true))
+            }
+            parts.sort { $0.pageIndex < $1.pageIndex }
+        }
+        cache?.prune()
+
+        if passthroughCount > 0 {
+            self.log("Render: attached original JPEG for \(passthroughCount) scanned page(s) (no render/PNG encode)")
+        }
+        if blankCount > 0 {
+            self.log("Render: \(blankCount) blank page(s) skipped (not encoded or uploaded)")
         }
 
         return parts
@@ -1318,36 +2195,6 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                     let rawData = cfData as Data
                     if rawData.isEmpty { return }
 
-                    func intValue(_ key: String) -> Int? {
-                        var v: CGPDFInteger = 0
-                        if CGPDFDictionaryGetInteger(dict, key, &v) {
-                            return Int(v)
-                        }
-                        return nil
-                    }
-
-                    func colorSpaceName() -> String? {
-                        // ColorSpace can be a name or an array (first element is name)
-                        var csObj: CGPDFObjectRef?
-                        if CGPDFDictionaryGetObject(dict, "ColorSpace", &csObj), let csObj {
-                            var namePtr: UnsafePointer<Int8>?
-                            if CGPDFObjectGetValue(csObj, .name, &namePtr), let namePtr {
-                                return String(cString: namePtr)
-                            }
-                            var arr: CGPDFArrayRef?
-                            if CGPDFObjectGetValue(csObj, .array, &arr), let arr {
-                                var firstObj: CGPDFObjectRef?
-                                if CGPDFArrayGetObject(arr, 0, &firstObj), let firstObj {
-                                    var n2: UnsafePointer<Int8>?
-                                    if CGPDFObjectGetValue(firstObj, .name, &n2), let n2 {
-                                        return String(cString: n2)
-                                    }
-                                }
-                            }
-                        }
-                        return nil
-                    }
-
                     let token = String(format: "xobj_p%03d_%03d", box.pageIndex + 1, box.images.count + 1)
 
                     // 1) JPEG / JP2 images: embed as-is.
@@ -1366,61 +2213,13 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
                         return
                     }
 
-                    // 2) FlateDecode (or no filter): raw bitmap data. Try to decode and re-encode as PNG.
-                    if filter == "FlateDecode" || filter == nil {
-                        guard let w = intValue("Width"), let h = intValue("Height"), w > 0, h > 0 else { return }
-                        let bpc = intValue("BitsPerComponent") ?? 8
-                        guard bpc == 8 else {
-                            // Keep scope small: implement 1-bit/16-bit later if needed.
-                            return
-                        }
-
-                        let cs = colorSpaceName() ?? "DeviceRGB"
-                        let components: Int
-                        let cgColorSpace: CGColorSpace
-                        if cs == "DeviceGray" {
-                            components = 1
-                            cgColorSpace = CGColorSpaceCreateDeviceGray()
-                        } else if cs == "DeviceRGB" {
-                            components = 3
-                            cgColorSpace = CGColorSpaceCreateDeviceRGB()
-                        } else {
-                            // Unsupported color space for now.
-                            return
-                        }
-
-                        let expectedMin = w * h * components
-                        if rawData.count < expectedMin {
-                            // Data is smaller than expected: likely needs predictors/extra decoding.
-                            return
-                        }
-
-                        let bytesPerRow = w * components
-                        guard let provider = CGDataProvider(data: rawData as CFData) else { return }
-                        let bitmapInfo: CGBitmapInfo = cs == "DeviceGray" ? [] : CGBitmapInfo(rawValue: CGImageAlphaInfo.none.rawValue)
-
-                        if let cgImage = CGImage(width: w,
-                                                 height: h,
-                                                 bitsPerComponent: 8,
-                                                 bitsPerPixel: components * 8,
-                                                 bytesPerRow: bytesPerRow,
-                                                 space: cgColorSpace,
-                                                 bitmapInfo: bitmapInfo,
-                                                 provider: provider,
-                                                 decode: nil,
-                                                 shouldInterpolate: true,
-                                                 intent: .defaultIntent) {
-                            let outData = NSMutableData()
-                            if let dest = CGImageDestinationCreateWithData(outData, UTType.png.identifier as CFString, 1, nil) {
-                                CGImageDestinationAddImage(dest, cgImage, nil)
-                                if CGImageDestinationFinalize(dest) {
-                                    let filename = "\(token).png"
-                                    if box.images.count < maxImages {
-                                        box.images.append(EmbeddedImagePart(pageIndex: box.pageIndex, token: token, filename: filename, mimeType: "image/png", data: outData as Data))
-                                    }
-                                    return
-                                }
-                            }
+                    // 2) Everything Quartz fully decoded (Flate, LZW, RunLength, no filter...): raw samples. Convert
+                    //    Gray/RGB/CMYK/Indexed/Lab at 1-16 bits per component straight into a PNG.
+                    if format == .raw {
+                        guard let descriptor = PDFImageDescriptor(dict: dict),
+                              let png = PDFImageConverter.encodePNG(descriptor, data: rawData) else { return }
+                        if box.images.count < maxImages {
+                            box.images.append(EmbeddedImagePart(pageIndex: box.pageIndex, token: token, filename: "\(token).png", mimeType: "image/png", data: png))
                         }
                         return
                     }
@@ -1516,8 +2315,13 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
 
         var out: [String] = []
         out.reserveCapacity(pageCount)
+        let early = EarlyPageStore.shared.entry(for: fileURL)
 
         for i in 0..<pageCount {
+            if i == 0, let html = early?.html {
+                out.append(html)
+                continue
+            }
             guard let page = doc.page(at: i) else {
                 out.append("")
                 continue
@@ -1586,26 +2390,8 @@ final class AppDelegate: NSObject, NSApplicationDelegate {
         return html
     }
 
-    nonisolated private func appendMultipartPart(_ body: inout Data,
-                                     boundary: String,
-                                     contentType: String,
-                                     contentDisposition: String,
-                                     data: Data) {
-        body.append("--\(boundary)\r\n".data(using: .utf8)!)
-        body.append("Content-Disposition: \(contentDisposition)\r\n".data(using: .utf8)!)
-        body.append("Content-Type: \(contentType)\r\n\r\n".data(using: .utf8)!)
-        body.append(data)
-        body.append("\r\n".data(using: .utf8)!)
-    }
-
     nonisolated private func escapeHTML(_ value: String) -> String {
-        var escaped = value
-        escaped = escaped.replacingOccurrences(of: "&", with: "&amp;")
-        escaped = escaped.replacingOccurrences(of: "<", with: "&lt;")
-        escaped = escaped.replacingOccurrences(of: ">", with: "&gt;")
-        escaped = escaped.replacingOccurrences(of: "\"", with: "&quot;")
-        escaped = escaped.replacingOccurrences(of: "'", with: "&#39;")
-        return escaped
+        OneNoteRequestBuilder.escapeHTML(value)
     }
 }
 
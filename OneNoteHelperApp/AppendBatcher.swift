@@ -0,0 +1,180 @@
+import Foundation
+
+/// Merges append-mode jobs for the same target page into one PATCH.
+///
+/// When the target page is set, every job is a `PATCH …/pages/{id}/content`. A burst of small jobs then
+/// hits throttling and queues on that page. Jobs for the same page that finish converting within
+/// `AppendBatchWindowMilliseconds` (default 500) of the first one are sent together instead: one commands
+/// array (an `append` per job, in arrival order) and each job's parts, renamed so tokens can't collide.
+/// A batch is closed early at `AppendBatchMaxJobs` (default 20) jobs or at JobSplitter's request limits.
+///
+/// If a merged request is rejected on its first attempt, its jobs are sent again one by one, so one bad job
+/// doesn't fail the others. A merged request that is deferred stays a single outbox entry: when it later
+/// succeeds or finally fails, the files of all its jobs move to Done or Failed together.
+/// `AppendBatching` (default on) turns this off.
+final class AppendBatcher {
+    static let enabledKey = "AppendBatching"
+    static let windowKey = "AppendBatchWindowMilliseconds"
+    static let maxJobsKey = "AppendBatchMaxJobs"
+
+    static let shared = AppendBatcher()
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var window: TimeInterval {
+        let v = UserDefaults.standard.integer(forKey: windowKey)
+        return Double(v > 0 ? v : 500) / 1000
+    }
+
+    static var maxJobs: Int {
+        let v = UserDefaults.standard.integer(forKey: maxJobsKey)
+        return v > 0 ? v : 20
+    }
+
+    struct Attachment {
+        let token: String
+        let filename: String
+        let mimeType: String
+        let data: Data
+    }
+
+    struct Job {
+        let label: String
+        let user: String
+        let sourceFiles: [String]
+        /// HTML appended to the page; references its parts as `name:<token>`.
+        let fragment: String
+        let attachments: [Attachment]
+        /// Called once with the job's outcome.
+        let completion: (UploadOutbox.Attempt) -> Void
+
+        var bytes: Int {
+            fragment.utf8.count + attachments.reduce(0) { $0 + $1.data.count + JobSplitter.partOverheadBytes }
+        }
+    }
+
+    /// Stores and sends one request (see UploadOutbox); called on a background thread.
+    var sender: ((UploadOutbox.PreparedRequest, _ label: String, _ user: String, _ sourceFiles: [String]) -> UploadOutbox.Attempt)?
+    /// Graph URL of a page's content endpoint.
+    var pageURL: ((String) -> String)?
+    var log: ((String) -> Void)?
+
+    private struct Batch {
+        var jobs: [Job] = []
+        var bytes = JobSplitter.requestOverheadBytes
+        var parts = 1
+        /// Distinguishes this batch from a later one for the same page when its timer fires.
+        let serial: Int
+    }
+
+    private let lock = NSLock()
+    private var open: [String: Batch] = [:]
+    private var nextSerial = 0
+
+    /// Queues `job` for `pageId`; it is sent when its batch closes.
+    func add(_ job: Job, pageId: String) {
+        lock.lock()
+        var full: Batch?
+        if let batch = open[pageId],
+           batch.jobs.count >= Self.maxJobs
+            || batch.bytes + job.bytes > JobSplitter.maxRequestBytes
+            || batch.parts + job.attachments.count > JobSplitter.maxParts {
+            full = batch
+            open[pageId] = nil
+        }
+        let isNew = open[pageId] == nil
+        if isNew {
+            nextSerial += 1
+            open[pageId] = Batch(serial: nextSerial)
+        }
+        open[pageId]!.jobs.append(job)
+        open[pageId]!.bytes += job.bytes
+        open[pageId]!.parts += job.attachments.count
+        let serial = open[pageId]!.serial
+        lock.unlock()
+
+        if let full {
+            DispatchQueue.global(qos: .utility).async {
+                self.send(full.jobs, pageId: pageId)
+            }
+        }
+        if isNew {
+            DispatchQueue.global(qos: .utility).asyncAfter(deadline: .now() + Self.window) {
+                self.close(pageId: pageId, serial: serial)
+            }
+        }
+    }
+
+    private func close(pageId: String, serial: Int) {
+        lock.lock()
+        guard let batch = open[pageId], batch.serial == serial else {
+            // Already closed because it was full.
+            lock.unlock()
+            return
+        }
+        open[pageId] = nil
+        lock.unlock()
+        send(batch.jobs, pageId: pageId)
+    }
+
+    private func send(_ jobs: [Job], pageId: String) {
+        guard let sender, let pageURL else {
+            jobs.forEach { $0.completion(.failed("append batching is not configured")) }
+            return
+        }
+        let url = pageURL(pageId)
+        if jobs.count == 1 {
+            let job = jobs[0]
+            job.completion(sender(UploadOutbox.PreparedRequest(method: "PATCH", url: url, body: Self.body(for: [job])),
+                                  job.label, job.user, job.sourceFiles))
+            return
+        }
+
+        let body = Self.body(for: jobs)
+        log?("Append batch: \(jobs.count) job(s) for one page in one PATCH (\(body.partCount) part(s), \(body.contentLength) bytes)")
+        let label = "\(jobs.count) jobs (\(jobs.map(\.label).joined(separator: ", ")))"
+        let attempt = sender(UploadOutbox.PreparedRequest(method: "PATCH", url: url, body: body),
+                             label, jobs[0].user, jobs.flatMap(\.sourceFiles))
+        if case .failed(let reason) = attempt {
+            log?("Append batch rejected (\(reason)); sending its \(jobs.count) job(s) one by one")
+            for job in jobs {
+                job.completion(sender(UploadOutbox.PreparedRequest(method: "PATCH", url: url, body: Self.body(for: [job])),
+                                      job.label, job.user, job.sourceFiles))
+            }
+            return
+        }
+        jobs.forEach { $0.completion(attempt) }
+    }
+
+    /// One `append` command per job, in order, and every job's parts. Tokens get a per-job prefix, since
+    /// each job numbers its parts from 1.
+    private static func body(for jobs: [Job]) -> MultipartBody {
+        let body = MultipartBody(boundary: "----onenote-\(UUID().uuidString)")
+        let prefixed = jobs.count > 1
+        var commands: [OneNotePatchCommand] = []
+        for (k, job) in jobs.enumerated() {
+            var fragment = job.fragment
+            if prefixed {
+                for a in job.attachments {
+                    fragment = fragment.replacingOccurrences(of: "name:\(a.token)\"", with: "name:j\(k + 1)_\(a.token)\"")
+                }
+            }
+            commands.append(OneNotePatchCommand(target: "body", action: "append", content: fragment))
+        }
+        body.append(contentType: "application/json; charset=utf-8",
+                    contentDisposition: "form-data; name=\"commands\"",
+                    data: (try? JSONEncoder().encode(commands)) ?? Data("[]".utf8))
+        for (k, job) in jobs.enumerated() {
+            for a in job.attachments {
+                let name = prefixed ? "j\(k + 1)_\(a.token)" : a.token
+                body.append(contentType: a.mimeType,
+                            contentDisposition: "form-data; name=\"\(name)\"; filename=\"\(a.filename)\"",
+                            data: a.data)
+            }
+        }
+        body.finish()
+        return body
+    }
+}
@@ -0,0 +1,144 @@
+import Foundation
+import CoreGraphics
+import ImageIO
+
+/// Finds blank and near-blank pages (typically the back sides of duplex jobs) so the image pipeline
+/// doesn't render, encode and upload them.
+///
+/// A SIMD ink count on the rendered bitmap, which also catches pages that paint only white or a few specks.
+/// Pages whose content stream scan found nothing to paint (`PDFPageFeatures.paintsNothing`) get the same count
+/// on a cheap low-resolution render first (`isBlank(page:)`), instead of the full render; a page is never
+/// dropped on the scan alone.
+enum BlankPageDetector {
+    /// What to do with a blank page in the generated HTML.
+    enum Action: String {
+        /// Detection off: render and upload the page like any other.
+        case keep
+        /// Don't attach the page; leave a one-line note in its place.
+        case placeholder
+        /// Don't attach the page and leave no trace of it.
+        case drop
+    }
+
+    /// Global setting; `BlankPageHandling.<mode>` (e.g. `BlankPageHandling.image`) overrides it per import mode.
+    static let actionKey = "BlankPageHandling"
+    /// A channel value below this (0...255) counts as ink.
+    static let inkThresholdKey = "BlankPageInkThreshold"
+    /// A page is blank when the share of ink samples is at most this.
+    static let maxInkFractionKey = "BlankPageMaxInkFraction"
+
+    static func action(forMode mode: String) -> Action {
+        let d = UserDefaults.standard
+        if let raw = d.string(forKey: "\(actionKey).\(mode)"), let a = Action(rawValue: raw) { return a }
+        if let raw = d.string(forKey: actionKey), let a = Action(rawValue: raw) { return a }
+        return .placeholder
+    }
+
+    static var inkThreshold: UInt8 {
+        let v = UserDefaults.standard.integer(forKey: inkThresholdKey)
+        return (1...255).contains(v) ? UInt8(v) : 200
+    }
+
+    static var maxInkFraction: Double {
+        let v = UserDefaults.standard.double(forKey: maxInkFractionKey)
+        return v > 0 ? v : 0.0002
+    }
+
+    /// One-line stand-in for a skipped page.
+    static func placeholderHTML(pageIndex: Int) -> String {
+        "<p style=\"color: #888888;\"><i>Page \(pageIndex + 1): blank page skipped</i></p>\n"
+    }
+
+    /// Counts samples (R, G, B; alpha is always opaque here) darker than the threshold, 16 at a time, and stops
+    /// as soon as the page has more ink than a blank page may have.
+    static func isBlank(_ raster: RasterImage) -> Bool {
+        let total = raster.width * raster.height
+        guard total > 0 else { return true }
+        let limit = Int(Double(total) * maxInkFraction)
+        let threshold = SIMD16<UInt8>(repeating: inkThreshold)
+        let scalarThreshold = inkThreshold
+        let rowLength = raster.width * 4
+
+        var ink = 0
+        return raster.pixels.withUnsafeBytes { buf -> Bool in
+            guard let base = buf.baseAddress else { return true }
+            for y in 0..<raster.height {
+                let row = base + y * raster.bytesPerRow
+                var acc = SIMD16<UInt16>()
+                var i = 0
+                while i + 16 <= rowLength {
+                    let v = row.loadUnaligned(fromByteOffset: i, as: SIMD16<UInt8>.self)
+                    acc &+= SIMD16<UInt16>(truncatingIfNeeded: SIMD16<UInt8>().replacing(with: 1, where: v .< threshold))
+                    i += 16
+                }
+                while i < rowLength {
+                    if row.load(fromByteOffset: i, as: UInt8.self) < scalarThreshold { ink += 1 }
+                    i += 1
+                }
+                ink += Int(acc.wrappedSum())
+                if ink > limit { return false }
+            }
+            return true
+        }
+    }
+
+    /// Same check on `page` drawn at no more than 1 pixel per point and `maxPixelSize` pixels on the long side.
+    /// False when the page can't be drawn.
+    static func isBlank(page: CGPDFPage, maxPixelSize: CGFloat = 1024) -> Bool {
+        let box = page.getBoxRect(.mediaBox)
+        guard box.width > 0, box.height > 0 else { return false }
+        let scale = min(1, maxPixelSize / max(box.width, box.height))
+        let width = max(1, Int((box.width * scale).rounded(.up)))
+        let height = max(1, Int((box.height * scale).rounded(.up)))
+        let bytesPerRow = width * 4
+        var pixels = [UInt8](repeating: 0, count: bytesPerRow * height)
+        let ok = pixels.withUnsafeMutableBytes { buf -> Bool in
+            guard let ctx = CGContext(data: buf.baseAddress,
+                                      width: width,
+                                      height: height,
+                                      bitsPerComponent: 8,
+                                      bytesPerRow: bytesPerRow,
+                                      space: CGColorSpaceCreateDeviceRGB(),
+                                      bitmapInfo: CGImageAlphaInfo.premultipliedLast.rawValue) else { return false }
+            ctx.setFillColor(CGColor(red: 1, green: 1, blue: 1, alpha: 1))
+            ctx.fill(CGRect(x: 0, y: 0, width: width, height: height))
+            ctx.scaleBy(x: scale, y: scale)
+            ctx.translateBy(x: -box.minX, y: -box.minY)
+            ctx.drawPDFPage(page)
+            return true
+        }
+        guard ok else { return false }
+        return isBlank(RasterImage(width: width, height: height, bytesPerRow: bytesPerRow, pixels: pixels))
+    }
+
+    /// Same check on a (scanned) JPEG, using a small ImageIO thumbnail instead of the full image.
+    static func isBlank(jpeg: Data, maxPixelSize: Int = 512) -> Bool {
+        guard let src = CGImageSourceCreateWithData(jpeg as CFData, nil) else { return false }
+        let opts: [CFString: Any] = [
+            kCGImageSourceCreateThumbnailFromImageAlways: true,
+            kCGImageSourceThumbnailMaxPixelSize: maxPixelSize,
+            kCGImageSourceCreateThumbnailWithTransform: true
+        ]
+        guard let thumb = CGImageSourceCreateThumbnailAtIndex(src, 0, opts as CFDictionary) else { return false }
+
+        let width = thumb.width
+        let height = thumb.height
+        let bytesPerRow = width * 4
+        var pixels = [UInt8](repeating: 0, count: bytesPerRow * height)
+        let ok = pixels.withUnsafeMutableBytes { buf -> Bool in
+            guard let ctx = CGContext(data: buf.baseAddress,
+                                      width: width,
+                                      height: height,
+                                      bitsPerComponent: 8,
+                                      bytesPerRow: bytesPerRow,
+                                      space: CGColorSpaceCreateDeviceRGB(),
+                                      bitmapInfo: CGImageAlphaInfo.premultipliedLast.rawValue) else { return false }
+            ctx.setFillColor(CGColor(red: 1, green: 1, blue: 1, alpha: 1))
+            ctx.fill(CGRect(x: 0, y: 0, width: width, height: height))
+            ctx.draw(thumb, in: CGRect(x: 0, y: 0, width: width, height: height))
+            return true
+        }
+        guard ok else { return false }
+        return isBlank(RasterImage(width: width, height: height, bytesPerRow: bytesPerRow, pixels: pixels))
+    }
+}
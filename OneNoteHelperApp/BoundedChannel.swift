@@ -0,0 +1,63 @@
+import Foundation
+
+/// Blocking hand-off between one producer and one consumer thread, holding at most `capacity` items.
+///
+/// The producer blocks in `send` while the channel is full, which bounds how far rendering can run ahead of
+/// uploading (and so how many encoded pages sit in memory). Either side can stop early: `close()` from the
+/// producer ends the stream after the buffered items, `cancel()` from the consumer drops them and makes
+/// further `send`s return false.
+final class BoundedChannel<Element> {
+    private let capacity: Int
+    private let condition = NSCondition()
+    private var items: [Element] = []
+    private var closed = false
+    private var cancelled = false
+
+    init(capacity: Int) {
+        self.capacity = max(1, capacity)
+    }
+
+    /// Blocks while full. Returns false if the consumer cancelled (the item is dropped).
+    @discardableResult
+    func send(_ item: Element) -> Bool {
+        condition.lock()
+        defer { condition.unlock() }
+        while items.count >= capacity, !cancelled {
+            condition.wait()
+        }
+        guard !cancelled, !closed else { return false }
+        items.append(item)
+        condition.broadcast()
+        return true
+    }
+
+    /// No more items will be sent; `receive` returns nil once the buffer is drained.
+    func close() {
+        condition.lock()
+        closed = true
+        condition.broadcast()
+        condition.unlock()
+    }
+
+    /// The consumer gives up: buffered items are dropped and the producer is unblocked.
+    func cancel() {
+        condition.lock()
+        cancelled = true
+        items.removeAll()
+        condition.broadcast()
+        condition.unlock()
+    }
+
+    /// Blocks until an item is available; nil when the channel is closed and empty, or cancelled.
+    func receive() -> Element? {
+        condition.lock()
+        defer { condition.unlock() }
+        while items.isEmpty, !closed, !cancelled {
+            condition.wait()
+        }
+        guard !cancelled, !items.isEmpty else { return nil }
+        let item = items.removeFirst()
+        condition.broadcast()
+        return item
+    }
+}
@@ -14,6 +14,8 @@ struct ContentView: View {
     /// - image: render pages as PNGs and upload as <img> attachments.
     /// - text: upload extracted text only.
     /// - hybrid: current default (text + embedded images when found; falls back to rendered pages if needed).
+    /// - auto: per-page choice between the above, driven by a cost model (see ImportPlanner).
+    /// - server: attach the PDF and let OneNote render the pages (data-render-src).
     @AppStorage("ImportMode") private var importMode: String = "hybrid"
 
     // MARK: - Theme
@@ -141,7 +143,8 @@ struct ContentView: View {
                     Text(logs.activityState == .waiting ? "Waiting for print jobs…" : "\(logs.activityState.label)…")
                         .font(.callout)
                         .foregroundStyle(secondaryText)
-                        .help("Current activity: \(logs.activityState.label)")
+                        .help(logs.schedulerSummary.isEmpty ? "Current activity: \(logs.activityState.label)"
+                                                           : "Current activity: \(logs.activityState.label) (\(logs.schedulerSummary))")
                 }
             }
             panel(title: "Import mode") {
@@ -150,10 +153,12 @@ struct ContentView: View {
                         Text("Image").tag("image")
                         Text("Text").tag("text")
                         Text("Hybrid").tag("hybrid")
+                        Text("Auto").tag("auto")
+                        Text("Server").tag("server")
                     }
                     .pickerStyle(.segmented)
                     .controlSize(.regular)
-                    .help("Choose how pages are generated in OneNote: images only, text only, or hybrid.")
+                    .help("Choose how pages are generated in OneNote: images only, text only, hybrid, auto (cheapest per-page strategy that keeps quality), or server (OneNote renders the attached PDF).")
                 }
             }
                 panel(title: "Target") {
@@ -0,0 +1,89 @@
+import Foundation
+import CoreGraphics
+
+/// Results for the first page of a job, produced while the job was still spooling
+/// (see LinearizedPDFReader). Keyed by the job base name, e.g. "job-42-1700000000".
+final class EarlyPageStore {
+    struct Entry {
+        /// /L of the linearized file; results are only reused if the final file has exactly this size.
+        let fileLength: Int
+        let renderScale: CGFloat
+        /// Scale page 1 was rendered at (RenderScaleSelector on that page alone); reused only if the job picks the same.
+        let pageScale: CGFloat
+        var rendered: (mimeType: String, data: Data)?
+        var displayWidth: Int?
+        /// Page 1 was found blank, so there is no `rendered` image.
+        var isBlank = false
+        var html: String?
+        let createdAt: Date
+    }
+
+    static let shared = EarlyPageStore()
+
+    private let lock = NSLock()
+    private var entries: [String: Entry] = [:]
+    private var readers: [String: LinearizedPDFReader] = [:]
+    private var started: Set<String> = []
+
+    static func key(for fileURL: URL) -> String {
+        fileURL.deletingPathExtension().lastPathComponent
+    }
+
+    /// Returns the reader tracking `spoolURL`, creating it on first sight.
+    func reader(for spoolURL: URL) -> LinearizedPDFReader {
+        let key = Self.key(for: spoolURL)
+        lock.lock()
+        defer { lock.unlock() }
+        if let r = readers[key] { return r }
+        let r = LinearizedPDFReader(url: spoolURL)
+        readers[key] = r
+        return r
+    }
+
+    /// True exactly once per key: the caller then owns the early processing for that job.
+    func beginProcessing(_ key: String) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return started.insert(key).inserted
+    }
+
+    func store(_ entry: Entry, for key: String) {
+        lock.lock()
+        entries[key] = entry
+        lock.unlock()
+    }
+
+    /// Early results for `fileURL`, if they were produced from the same bytes and at the same scale.
+    func entry(for fileURL: URL, renderScale: CGFloat? = nil) -> Entry? {
+        lock.lock()
+        let e = entries[Self.key(for: fileURL)]
+        lock.unlock()
+        guard let e else { return nil }
+        let size = (try? FileManager.default.attributesOfItem(atPath: fileURL.path)[.size] as? NSNumber)?.intValue ?? -1
+        guard size == e.fileLength else { return nil }
+        if let renderScale, renderScale != e.renderScale { return nil }
+        return e
+    }
+
+    func remove(_ key: String) {
+        lock.lock()
+        entries[key] = nil
+        readers[key] = nil
+        started.remove(key)
+        lock.unlock()
+    }
+
+    /// Drops readers whose spool file vanished without a job (cancelled prints) and stale results.
+    func prune(activeSpoolKeys: Set<String>, maxAge: TimeInterval = 3600) {
+        lock.lock()
+        defer { lock.unlock() }
+        for key in readers.keys where !activeSpoolKeys.contains(key) {
+            readers[key] = nil
+        }
+        let cutoff = Date().addingTimeInterval(-maxAge)
+        for (key, e) in entries where e.createdAt < cutoff {
+            entries[key] = nil
+            started.remove(key)
+        }
+    }
+}
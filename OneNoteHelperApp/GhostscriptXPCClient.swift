@@ -17,6 +17,19 @@ final class GhostscriptXPCClient {
     }
 
     static func convertPS(psPath: String, pdfPath: String, timeoutSeconds: TimeInterval = 60) -> (ok: Bool, logs: String) {
+        call(timeoutSeconds: timeoutSeconds) { proxy, reply in
+            proxy.convertPS(psPath: psPath, pdfPath: pdfPath, reply: reply)
+        }
+    }
+
+    static func optimizePDF(inPath: String, outPath: String, downsampleDPI: Int, timeoutSeconds: TimeInterval = 60) -> (ok: Bool, logs: String) {
+        call(timeoutSeconds: timeoutSeconds) { proxy, reply in
+            proxy.optimizePDF(inPath: inPath, outPath: outPath, downsampleDPI: downsampleDPI, reply: reply)
+        }
+    }
+
+    private static func call(timeoutSeconds: TimeInterval,
+                             _ body: (GhostscriptXPCProtocol, @escaping (Bool, String) -> Void) -> Void) -> (ok: Bool, logs: String) {
         let sem = DispatchSemaphore(value: 0)
         var result: (Bool, String) = (false, "")
 
@@ -35,7 +48,7 @@ final class GhostscriptXPCClient {
             return (false, "XPC: failed to get proxy. Expected embedded service at: \(embeddedServicePathHint())")
         }
 
-        proxy.convertPS(psPath: psPath, pdfPath: pdfPath) { ok, logs in
+        body(proxy) { ok, logs in
             result = (ok, logs)
             sem.signal()
         }
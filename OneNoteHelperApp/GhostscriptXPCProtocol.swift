@@ -5,4 +5,9 @@ import Foundation
     /// Convert PostScript at `psPath` to PDF at `pdfPath`.
     /// - Returns: (ok, logs) where logs is combined stdout/stderr.
     func convertPS(psPath: String, pdfPath: String, reply: @escaping (Bool, String) -> Void)
+
+    /// Rewrite the PDF at `inPath` to a smaller PDF at `outPath` (object/xref streams, unused objects
+    /// dropped, duplicate images/fonts merged). Images are downsampled to `downsampleDPI` when > 0.
+    /// - Returns: (ok, logs) where logs is combined stdout/stderr.
+    func optimizePDF(inPath: String, outPath: String, downsampleDPI: Int, reply: @escaping (Bool, String) -> Void)
 }
@@ -0,0 +1,221 @@
+import Foundation
+
+/// Client-side pacing of Graph OneNote requests, so throttling (429/503) delays an upload instead of failing
+/// the job and throwing its conversion and render work away.
+///
+/// Per Graph account (tenant + user, read from the access token):
+/// - a token bucket: `GraphRequestsPerMinute` (default 120, OneNote's documented per-user rate) with bursts of
+///   up to `GraphRequestBurst` (default 10);
+/// - an AIMD concurrency window: +1/window per success, halved on throttling, between 1 and
+///   `GraphMaxConcurrentRequests` (default 4);
+/// - a pause until `Retry-After` (or an exponential backoff when the response has none) after 429/503.
+///
+/// `acquire` blocks the calling (background) thread until all three allow a request.
+final class GraphRateController {
+    static let requestsPerMinuteKey = "GraphRequestsPerMinute"
+    static let burstKey = "GraphRequestBurst"
+    static let maxConcurrentKey = "GraphMaxConcurrentRequests"
+    static let maxRetriesKey = "GraphThrottleMaxRetries"
+
+    static let shared = GraphRateController()
+
+    static var requestsPerMinute: Double {
+        let v = UserDefaults.standard.double(forKey: requestsPerMinuteKey)
+        return v > 0 ? v : 120
+    }
+
+    static var burst: Double {
+        let v = UserDefaults.standard.double(forKey: burstKey)
+        return v >= 1 ? v : 10
+    }
+
+    static var maxConcurrent: Double {
+        let v = UserDefaults.standard.integer(forKey: maxConcurrentKey)
+        return Double(v > 0 ? v : 4)
+    }
+
+    /// Throttled responses retried per request before the upload is given up.
+    static var maxRetries: Int {
+        let d = UserDefaults.standard
+        return d.object(forKey: maxRetriesKey) == nil ? 6 : max(0, d.integer(forKey: maxRetriesKey))
+    }
+
+    enum Outcome {
+        case success
+        /// 429/503; `retryAfter` from the response, if any.
+        case throttled(retryAfter: TimeInterval?)
+        /// Any other failure: releases the slot without changing the window.
+        case failed
+    }
+
+    /// A granted request slot; pass it back to `finish` exactly once.
+    struct Permit {
+        let key: String
+    }
+
+    private final class Account {
+        var tokens: Double
+        var refilledAt = Date()
+        var window = 2.0
+        var inFlight = 0
+        var pausedUntil = Date.distantPast
+        var consecutiveThrottles = 0
+
+        init(tokens: Double) {
+            self.tokens = tokens
+        }
+    }
+
+    private let condition = NSCondition()
+    private var accounts: [String: Account] = [:]
+
+    /// Blocks until `key` may send a request.
+    func acquire(key: String) -> Permit {
+        condition.lock()
+        defer { condition.unlock() }
+        let account = accounts[key] ?? Account(tokens: Self.burst)
+        accounts[key] = account
+
+        while true {
+            let now = Date()
+            let rate = Self.requestsPerMinute / 60
+            account.tokens = min(Self.burst, account.tokens + now.timeIntervalSince(account.refilledAt) * rate)
+            account.refilledAt = now
+
+            if now < account.pausedUntil {
+                condition.wait(until: account.pausedUntil)
+            } else if account.inFlight >= Int(account.window) {
+                condition.wait()
+            } else if account.tokens < 1 {
+                condition.wait(until: now.addingTimeInterval((1 - account.tokens) / rate))
+            } else {
+                account.tokens -= 1
+                account.inFlight += 1
+                return Permit(key: key)
+            }
+        }
+    }
+
+    /// Records the result of a request. For throttled responses, returns how long the account is now paused.
+    @discardableResult
+    func finish(_ permit: Permit, _ outcome: Outcome) -> TimeInterval {
+        condition.lock()
+        defer {
+            condition.broadcast()
+            condition.unlock()
+        }
+        guard let account = accounts[permit.key] else { return 0 }
+        account.inFlight = max(0, account.inFlight - 1)
+
+        switch outcome {
+        case .success:
+            account.window = min(Self.maxConcurrent, account.window + 1 / account.window)
+            account.consecutiveThrottles = 0
+            return 0
+        case .throttled(let retryAfter):
+            account.window = max(1, account.window / 2)
+            account.consecutiveThrottles += 1
+            // Exponential backoff with jitter when the server doesn't say.
+            let backoff = min(120, pow(2, Double(account.consecutiveThrottles))) * Double.random(in: 0.75...1.25)
+            let delay = retryAfter ?? backoff
+            account.pausedUntil = max(account.pausedUntil, Date().addingTimeInterval(delay))
+            return delay
+        case .failed:
+            return 0
+        }
+    }
+
+    func summary(key: String) -> String {
+        condition.lock()
+        defer { condition.unlock() }
+        guard let a = accounts[key] else { return "idle" }
+        let paused = max(0, a.pausedUntil.timeIntervalSinceNow)
+        return "window \(String(format: "%.1f", a.window)), in flight \(a.inFlight), tokens \(String(format: "%.1f", a.tokens))"
+            + (paused > 0 ? ", paused \(Int(paused.rounded(.up)))s" : "")
+    }
+
+    /// Sends a request synchronously (call from a background thread): waits for a permit for `key`, sends it on
+    /// `session`, and retries throttled (429/503) responses after the pause `finish` returns, up to `maxRetries`
+    /// times; the last throttled response is returned as is. `makeRequest` is called per attempt. A `bodyFile` is
+    /// sent as an upload task: unlike a body stream, URLSession can read it again when it has to resend the
+    /// request (e.g. on a dropped reused connection). `slot` is entered around each attempt's I/O and returns its
+    /// release; `onThrottled` gets the status, the retry number and the pause before each retry.
+    func send(key: String, session: URLSession, bodyFile: URL? = nil, maxRetries: Int = GraphRateController.maxRetries,
+              slot: () -> () -> Void = { {} },
+              onThrottled: ((_ status: Int, _ retry: Int, _ delay: TimeInterval) -> Void)? = nil,
+              _ makeRequest: () -> URLRequest) -> (data: Data?, response: HTTPURLResponse?, error: Error?) {
+        final class Result {
+            var data: Data?
+            var response: URLResponse?
+            var error: Error?
+        }
+
+        var attempt = 0
+        while true {
+            let permit = acquire(key: key)
+            let leave = slot()
+            let result = Result()
+            let done = DispatchSemaphore(value: 0)
+            let handler = { (data: Data?, response: URLResponse?, error: Error?) in
+                result.data = data
+                result.response = response
+                result.error = error
+                done.signal()
+            }
+            if let bodyFile {
+                session.uploadTask(with: makeRequest(), fromFile: bodyFile, completionHandler: handler).resume()
+            } else {
+                session.dataTask(with: makeRequest(), completionHandler: handler).resume()
+            }
+            done.wait()
+            leave()
+
+            let http = result.response as? HTTPURLResponse
+            let status = http?.statusCode ?? 0
+            if let http, Self.isThrottled(status) {
+                let delay = finish(permit, .throttled(retryAfter: Self.retryAfter(http)))
+                attempt += 1
+                if attempt <= maxRetries {
+                    onThrottled?(status, attempt, delay)
+                    continue
+                }
+            } else {
+                finish(permit, result.error == nil && status < 300 ? .success : .failed)
+            }
+            return (result.data, http, result.error)
+        }
+    }
+
+    // MARK: - Helpers
+
+    static func isThrottled(_ status: Int) -> Bool {
+        status == 429 || status == 503
+    }
+
+    /// `Retry-After` as seconds; accepts both delta-seconds and an HTTP date.
+    static func retryAfter(_ response: HTTPURLResponse) -> TimeInterval? {
+        guard let value = response.value(forHTTPHeaderField: "Retry-After")?.trimmingCharacters(in: .whitespaces) else {
+            return nil
+        }
+        if let seconds = TimeInterval(value) { return max(0, seconds) }
+        let df = DateFormatter()
+        df.locale = Locale(identifier: "en_US_POSIX")
+        df.timeZone = TimeZone(identifier: "GMT")
+        df.dateFormat = "EEE, dd MMM yyyy HH:mm:ss zzz"
+        return df.date(from: value).map { max(0, $0.timeIntervalSinceNow) }
+    }
+
+    /// Rate-limit key of the account an access token belongs to: its `tid` + `oid` claims (unverified - only
+    /// used for bucketing), or a shared key when the token isn't a readable JWT.
+    static func key(forAccessToken token: String) -> String {
+        let segments = token.split(separator: ".")
+        guard segments.count >= 2 else { return "default" }
+        var b64 = segments[1].replacingOccurrences(of: "-", with: "+").replacingOccurrences(of: "_", with: "/")
+        b64 += String(repeating: "=", count: (4 - b64.count % 4) % 4)
+        guard let data = Data(base64Encoded: b64),
+              let claims = (try? JSONSerialization.jsonObject(with: data)) as? [String: Any] else { return "default" }
+        let tid = claims["tid"] as? String ?? ""
+        let oid = claims["oid"] as? String ?? ""
+        return tid.isEmpty && oid.isEmpty ? "default" : "\(tid)/\(oid)"
+    }
+}
@@ -0,0 +1,162 @@
+import Foundation
+
+/// The current Graph access token and its expiry, shared by all jobs.
+///
+/// Jobs get the cached token immediately while it is valid; when it isn't, concurrent callers share a single
+/// acquisition. After each acquisition a silent refresh is scheduled `TokenRefreshLeadSeconds` (default 300)
+/// before expiry, so jobs normally never wait on MSAL. `prefetch()` starts an acquisition early - when a job
+/// is discovered - so sign-in overlaps with conversion and rendering.
+///
+/// The scheduled refresh, and the first acquisition after `invalidate()`, ask for a forced refresh: a plain
+/// silent acquisition would hand back MSAL's cached token with the same expiry.
+///
+/// Only callers acting for a job that just arrived may cause a sign-in window (`get(interactive: true)`);
+/// background work such as outbox retries asks with `interactive: false` and gets nil when silent acquisition fails.
+final class GraphTokenCache {
+    static let refreshLeadKey = "TokenRefreshLeadSeconds"
+
+    static let shared = GraphTokenCache()
+
+    /// Acquires a token: silently, or interactively when `interactive` is true and silent acquisition fails.
+    /// `forceRefresh` asks for a new token from the server instead of MSAL's cached one.
+    /// Must call its completion exactly once, with the token and its expiry (nil: unknown).
+    typealias Refresher = (_ interactive: Bool, _ forceRefresh: Bool,
+                           _ completion: @escaping (String?, Date?) -> Void) -> Void
+
+    var refresher: Refresher?
+
+    static var refreshLead: TimeInterval {
+        let v = UserDefaults.standard.double(forKey: refreshLeadKey)
+        return v > 0 ? v : 300
+    }
+
+    /// Tokens are considered expired this long before `expiresOn`, so a request doesn't leave with a token
+    /// that expires in flight.
+    private static let safetyMargin: TimeInterval = 60
+    /// Assumed lifetime when MSAL doesn't report an expiry.
+    private static let defaultLifetime: TimeInterval = 50 * 60
+    /// Shortest wait before a scheduled refresh, so a refresh that returns a token already inside the lead
+    /// time doesn't start the next one right away.
+    private static let minimumRefreshDelay: TimeInterval = 60
+
+    private let lock = NSLock()
+    private var token: String?
+    private var expiresOn = Date.distantPast
+    private var waiters: [(interactive: Bool, completion: (String?) -> Void)] = []
+    private var acquiring = false
+    private var acquiringInteractively = false
+    /// The next acquisition must bypass MSAL's cache (set by the refresh timer and `invalidate()`).
+    private var forceRefresh = false
+    private var refreshTimer: DispatchSourceTimer?
+
+    /// Called with `lock` held.
+    private var validToken: String? {
+        guard let token, expiresOn.timeIntervalSinceNow > Self.safetyMargin else { return nil }
+        return token
+    }
+
+    /// Delivers a valid token (or nil when acquisition failed) on the main queue. Unless `interactive`, a failed
+    /// silent acquisition is not followed by a sign-in for this caller.
+    func get(interactive: Bool, completion: @escaping (String?) -> Void) {
+        lock.lock()
+        if let token = validToken {
+            lock.unlock()
+            DispatchQueue.main.async { completion(token) }
+            return
+        }
+        waiters.append((interactive, completion))
+        let start = beginAcquiring(interactive: interactive)
+        lock.unlock()
+        if start { acquire(interactive: interactive) }
+    }
+
+    /// Starts acquiring a token in the background if there is no valid one; nobody waits on the result.
+    /// Never prompts: an interactive sign-in only happens for a job that actually needs the token.
+    func prefetch() {
+        lock.lock()
+        let start = validToken == nil && beginAcquiring(interactive: false)
+        lock.unlock()
+        if start { acquire(interactive: false) }
+    }
+
+    /// Drops the cached token (e.g. after a 401), so the next `get` acquires a new one.
+    func invalidate() {
+        lock.lock()
+        token = nil
+        expiresOn = .distantPast
+        forceRefresh = true
+        lock.unlock()
+    }
+
+    /// Called with `lock` held. False when an acquisition is already running (its result will be shared).
+    private func beginAcquiring(interactive: Bool) -> Bool {
+        guard !acquiring else { return false }
+        acquiring = true
+        acquiringInteractively = interactive
+        return true
+    }
+
+    private func acquire(interactive: Bool) {
+        guard let refresher else {
+            finish(token: nil, expiresOn: nil)
+            return
+        }
+        lock.lock()
+        let force = forceRefresh
+        lock.unlock()
+        DispatchQueue.main.async {
+            refresher(interactive, force) { [weak self] token, expiresOn in
+                self?.finish(token: token, expiresOn: expiresOn)
+            }
+        }
+    }
+
+    private func finish(token newToken: String?, expiresOn newExpiry: Date?) {
+        lock.lock()
+        if let newToken {
+            forceRefresh = false
+            token = newToken
+            expiresOn = newExpiry ?? Date().addingTimeInterval(Self.defaultLifetime)
+            scheduleRefresh(at: expiresOn.addingTimeInterval(-Self.refreshLead))
+        }
+        // A silent attempt failed while jobs were waiting for it: they still get an interactive attempt. Callers
+        // that must not prompt get nil now instead of waiting for the sign-in.
+        if newToken == nil, !acquiringInteractively, waiters.contains(where: \.interactive) {
+            let silent = waiters.filter { !$0.interactive }
+            waiters.removeAll { !$0.interactive }
+            acquiringInteractively = true
+            lock.unlock()
+            for waiter in silent {
+                DispatchQueue.main.async { waiter.completion(nil) }
+            }
+            acquire(interactive: true)
+            return
+        }
+        let pending = waiters
+        waiters.removeAll()
+        acquiring = false
+        let delivered = newToken ?? validToken
+        lock.unlock()
+
+        for waiter in pending {
+            DispatchQueue.main.async { waiter.completion(delivered) }
+        }
+    }
+
+    /// Called with `lock` held.
+    private func scheduleRefresh(at date: Date) {
+        refreshTimer?.cancel()
+        let timer = DispatchSource.makeTimerSource(queue: .global(qos: .utility))
+        timer.schedule(deadline: .now() + max(Self.minimumRefreshDelay, date.timeIntervalSinceNow))
+        timer.setEventHandler { [weak self] in
+            guard let self else { return }
+            self.lock.lock()
+            let start = self.beginAcquiring(interactive: false)
+            if start { self.forceRefresh = true }
+            self.lock.unlock()
+            if start { self.acquire(interactive: false) }
+        }
+        refreshTimer = timer
+        timer.resume()
+    }
+}
@@ -0,0 +1,126 @@
+import Foundation
+
+/// Dedicated URLSession for Graph calls, instead of `URLSession.shared` with default settings.
+///
+/// One session means one connection pool: after the first request, later requests reuse warm TLS connections,
+/// and concurrent uploads are multiplexed as HTTP/2 streams on one connection (Graph negotiates h2 via ALPN;
+/// the per-host limit only matters if it falls back to HTTP/1.1). `warmUp(baseURL:)` opens the connection
+/// when a job is discovered, so the handshake overlaps with conversion instead of delaying the upload.
+///
+/// Per-request metrics (reused connection, protocol, connect/TLS time) are aggregated in `stats`. Warm-up
+/// requests are only counted in `warmUps`, so they don't inflate the request count or the handshake averages.
+final class GraphTransport {
+    static let maxConnectionsKey = "GraphMaxConnectionsPerHost"
+
+    static let shared = GraphTransport()
+
+    struct Stats {
+        var warmUps = 0
+        var requests = 0
+        var reusedConnections = 0
+        var http2Requests = 0
+        var connectMilliseconds = 0.0
+        var tlsMilliseconds = 0.0
+
+        var summary: String {
+            let fresh = requests - reusedConnections
+            let avgConnect = fresh > 0 ? connectMilliseconds / Double(fresh) : 0
+            let avgTLS = fresh > 0 ? tlsMilliseconds / Double(fresh) : 0
+            return "\(requests) request(s) (+\(warmUps) warm-up), \(reusedConnections) on reused connections, "
+                + "\(http2Requests) over h2; "
+                + "new connections avg connect \(Int(avgConnect)) ms, TLS \(Int(avgTLS)) ms"
+        }
+    }
+
+    /// Connection details of one finished request, from its URLSessionTaskMetrics.
+    struct Sample {
+        var reusedConnection: Bool
+        var protocolName: String?
+        var connectSeconds: TimeInterval?
+        var tlsSeconds: TimeInterval?
+    }
+
+    /// Marks warm-up tasks, whose metrics are kept out of the request stats.
+    static let warmUpTaskDescription = "warmup"
+
+    let session: URLSession
+
+    init(configuration config: URLSessionConfiguration = .default) {
+        let v = UserDefaults.standard.integer(forKey: Self.maxConnectionsKey)
+        config.httpMaximumConnectionsPerHost = v > 0 ? v : 4
+        config.requestCachePolicy = .reloadIgnoringLocalCacheData
+        config.urlCache = nil
+        config.timeoutIntervalForRequest = 120
+        let delegate = MetricsDelegate()
+        session = URLSession(configuration: config, delegate: delegate, delegateQueue: nil)
+        delegate.transport = self
+    }
+
+    private let lock = NSLock()
+    private var _stats = Stats()
+    private var lastWarmUp = Date.distantPast
+
+    var stats: Stats {
+        lock.lock()
+        defer { lock.unlock() }
+        return _stats
+    }
+
+    /// Opens (or keeps alive) a connection to the Graph host with a cheap unauthenticated HEAD. Skipped when
+    /// the pool was used in the last 30 seconds.
+    func warmUp(baseURL: String) {
+        lock.lock()
+        let due = lastWarmUp.timeIntervalSinceNow < -30
+        if due { lastWarmUp = Date() }
+        lock.unlock()
+        guard due, let url = URL(string: baseURL + "/v1.0/") else { return }
+        var request = URLRequest(url: url)
+        request.httpMethod = "HEAD"
+        request.timeoutInterval = 15
+        let task = session.dataTask(with: request)
+        task.taskDescription = Self.warmUpTaskDescription
+        task.resume()
+    }
+
+    fileprivate func record(_ metrics: URLSessionTaskMetrics, task: URLSessionTask) {
+        guard let t = metrics.transactionMetrics.last else { return }
+        func seconds(_ start: Date?, _ end: Date?) -> TimeInterval? {
+            guard let start, let end else { return nil }
+            return end.timeIntervalSince(start)
+        }
+        record(Sample(reusedConnection: t.isReusedConnection,
+                      protocolName: t.networkProtocolName,
+                      connectSeconds: seconds(t.connectStartDate, t.connectEndDate),
+                      tlsSeconds: seconds(t.secureConnectionStartDate, t.secureConnectionEndDate)),
+               isWarmUp: task.taskDescription == Self.warmUpTaskDescription)
+    }
+
+    func record(_ sample: Sample, isWarmUp: Bool) {
+        lock.lock()
+        defer { lock.unlock() }
+        lastWarmUp = Date()
+        if isWarmUp {
+            _stats.warmUps += 1
+            return
+        }
+        _stats.requests += 1
+        if sample.reusedConnection {
+            _stats.reusedConnections += 1
+        } else {
+            _stats.connectMilliseconds += (sample.connectSeconds ?? 0) * 1000
+            _stats.tlsMilliseconds += (sample.tlsSeconds ?? 0) * 1000
+        }
+        if sample.protocolName == "h2" {
+            _stats.http2Requests += 1
+        }
+    }
+}
+
+/// The session retains its delegate, so metrics go through this weakly-linked object rather than a cycle.
+private final class MetricsDelegate: NSObject, URLSessionTaskDelegate {
+    weak var transport: GraphTransport?
+
+    func urlSession(_ session: URLSession, task: URLSessionTask, didFinishCollecting metrics: URLSessionTaskMetrics) {
+        transport?.record(metrics, task: task)
+    }
+}
@@ -0,0 +1,212 @@
+import Foundation
+import CoreGraphics
+
+/// How a single PDF page ends up in OneNote.
+enum PageImportStrategy: String, Codable, CaseIterable {
+    /// Extracted text only.
+    case text
+    /// Extracted text + embedded image XObjects.
+    case hybrid
+    /// Page rendered to a bitmap.
+    case image
+}
+
+/// Linear cost model used by the `auto` import mode.
+///
+/// Coefficients are rough defaults measured on an M1 with a typical office connection; the per-strategy
+/// `calibration` factors are then adjusted after every job from the measured wall-clock time, and
+/// persisted in UserDefaults so the model converges to the machine/network it runs on.
+struct ImportCostModel: Codable {
+    var documentLoadSecondsPerMB: Double = 0.02
+    var textPageOverheadSeconds: Double = 0.004
+    var textSecondsPerRun: Double = 0.00004
+    var htmlBytesPerRun: Double = 90
+    var renderSecondsPerMegapixel: Double = 0.045
+    var pngEncodeSecondsPerMegapixel: Double = 0.060
+    var pngBytesPerMegapixel: Double = 350_000
+    var uploadBytesPerSecond: Double = 1_500_000
+
+    /// actual / estimated, per strategy (1.0 when uncalibrated).
+    var calibration: [String: Double] = [:]
+
+    static let defaultsKey = "AutoImportCostModel"
+
+    static func load() -> ImportCostModel {
+        guard let data = UserDefaults.standard.data(forKey: defaultsKey),
+              let model = try? JSONDecoder().decode(ImportCostModel.self, from: data) else {
+            return ImportCostModel()
+        }
+        return model
+    }
+
+    func save() {
+        if let data = try? JSONEncoder().encode(self) {
+            UserDefaults.standard.set(data, forKey: Self.defaultsKey)
+        }
+    }
+
+    func factor(_ strategy: PageImportStrategy) -> Double {
+        calibration[strategy.rawValue] ?? 1.0
+    }
+
+    /// Uncalibrated cost (seconds) of importing `page` with `strategy`, rendering at most at `renderScale`
+    /// (the page's own scale when adaptive render scaling is on).
+    func rawCost(_ strategy: PageImportStrategy, page: PDFPageFeatures, renderScale: CGFloat) -> Double {
+        let runs = Double(page.textRunCount)
+        let textCost = textPageOverheadSeconds + runs * textSecondsPerRun + runs * htmlBytesPerRun / uploadBytesPerSecond
+
+        switch strategy {
+        case .text:
+            return textCost
+        case .hybrid:
+            return textCost + Double(page.imageBytes) / uploadBytesPerSecond
+        case .image:
+            let scale = RenderScaleSelector.scale(for: page, maxScale: renderScale)
+            let mp = page.megapixels * Double(scale * scale)
+            return mp * (renderSecondsPerMegapixel + pngEncodeSecondsPerMegapixel)
+                + mp * pngBytesPerMegapixel / uploadBytesPerSecond
+        }
+    }
+
+    func cost(_ strategy: PageImportStrategy, page: PDFPageFeatures, renderScale: CGFloat) -> Double {
+        rawCost(strategy, page: page, renderScale: renderScale) * factor(strategy)
+    }
+
+    /// Exponentially-weighted update of the calibration factors from one finished job.
+    /// The job-level ratio is attributed to every strategy in proportion to its share of the raw estimate.
+    mutating func calibrate(rawEstimates: [PageImportStrategy: Double], actualSeconds: Double) {
+        let totalRaw = rawEstimates.values.reduce(0, +)
+        guard totalRaw > 0, actualSeconds > 0 else { return }
+        let ratio = actualSeconds / totalRaw
+        let alpha = 0.2
+        for (strategy, raw) in rawEstimates where raw > 0 {
+            let weight = alpha * raw / totalRaw
+            let updated = (1 - weight) * factor(strategy) + weight * ratio
+            calibration[strategy.rawValue] = min(8, max(0.125, updated))
+        }
+    }
+}
+
+struct PlannedPage {
+    let pageIndex: Int
+    var strategy: PageImportStrategy
+    var estimatedSeconds: Double
+    var estimatedQuality: Double
+}
+
+struct ImportPlan {
+    var pages: [PlannedPage]
+    /// Features the plan was made from, parallel to `pages`.
+    let features: [PDFPageFeatures]
+    /// Per-page share of the document load cost, included in every page's estimate.
+    let loadShare: Double
+    let renderScale: CGFloat
+    let startedAt: Date
+
+    var estimatedSeconds: Double {
+        pages.reduce(0) { $0 + $1.estimatedSeconds }
+    }
+
+    /// Re-plans `pages[i]` as a rendered image (e.g. when its extracted text turns out unusable) and re-estimates
+    /// its cost, so the logged estimate and the calibration see the strategy that actually runs.
+    mutating func demoteToImage(_ i: Int, model: ImportCostModel) {
+        pages[i].strategy = .image
+        pages[i].estimatedQuality = ImportPlanner.imageQuality
+        pages[i].estimatedSeconds = model.cost(.image, page: features[i], renderScale: renderScale) + loadShare
+    }
+
+    func pageIndices(_ strategy: PageImportStrategy) -> Set<Int> {
+        Set(pages.filter { $0.strategy == strategy }.map { $0.pageIndex })
+    }
+
+    var summary: String {
+        let counts = PageImportStrategy.allCases.map { s in "\(s.rawValue)=\(pages.filter { $0.strategy == s }.count)" }
+        return counts.joined(separator: " ")
+    }
+}
+
+/// Chooses, per page, the cheapest import strategy whose estimated quality meets the configured threshold.
+enum ImportPlanner {
+    static let qualityThresholdKey = "AutoImportQualityThreshold"
+
+    /// Quality a rendered page gets: visually faithful, but not searchable/selectable.
+    static let imageQuality = 0.9
+
+    static var qualityThreshold: Double {
+        let v = UserDefaults.standard.double(forKey: qualityThresholdKey)
+        return v > 0 ? v : 0.8
+    }
+
+    static func plan(fileURL: URL, maxPages: Int, renderScale: CGFloat) -> ImportPlan? {
+        let startedAt = Date()
+        let features = PDFPageFeatureExtractor.extract(fileURL: fileURL, maxPages: maxPages)
+        if features.isEmpty { return nil }
+
+        let fileBytes = (try? FileManager.default.attributesOfItem(atPath: fileURL.path)[.size] as? NSNumber)?.doubleValue ?? 0
+        return plan(features: features, fileBytes: fileBytes, renderScale: renderScale, startedAt: startedAt)
+    }
+
+    static func plan(features: [PDFPageFeatures], fileBytes: Double, renderScale: CGFloat, startedAt: Date = Date()) -> ImportPlan {
+        let model = ImportCostModel.load()
+        let threshold = qualityThreshold
+
+        // The document is loaded once per job whatever the strategy; spread that cost over the pages.
+        let loadShare = model.documentLoadSecondsPerMB * fileBytes / 1_000_000 / Double(max(1, features.count))
+
+        var pages: [PlannedPage] = []
+        pages.reserveCapacity(features.count)
+        for f in features {
+            var best: PlannedPage?
+            for strategy in PageImportStrategy.allCases {
+                let q = quality(strategy, page: f)
+                guard q >= threshold else { continue }
+                let c = model.cost(strategy, page: f, renderScale: renderScale) + loadShare
+                if best == nil || c < best!.estimatedSeconds {
+                    best = PlannedPage(pageIndex: f.pageIndex, strategy: strategy, estimatedSeconds: c, estimatedQuality: q)
+                }
+            }
+            // Nothing meets the threshold: fall back to the most faithful option.
+            pages.append(best ?? PlannedPage(pageIndex: f.pageIndex,
+                                             strategy: .image,
+                                             estimatedSeconds: model.cost(.image, page: f, renderScale: renderScale) + loadShare,
+                                             estimatedQuality: quality(.image, page: f)))
+        }
+        return ImportPlan(pages: pages, features: features, loadShare: loadShare, renderScale: renderScale, startedAt: startedAt)
+    }
+
+    /// Heuristic 0...1 quality score of importing a page with a given strategy.
+    static func quality(_ strategy: PageImportStrategy, page f: PDFPageFeatures) -> Double {
+        // Vector art (charts, tables drawn with lines, diagrams) is lost by text/hybrid.
+        let vectorPenalty = min(0.6, Double(f.pathOpCount) / 300)
+
+        switch strategy {
+        case .text:
+            return f.textFidelity * (1 - f.imageCoverage) * (1 - vectorPenalty)
+        case .hybrid:
+            if f.textRunCount == 0 {
+                // Pure image page: hybrid keeps the original images.
+                return f.imageCount > 0 ? 0.85 * (1 - vectorPenalty) : 0
+            }
+            return f.textFidelity * (1 - vectorPenalty)
+        case .image:
+            return imageQuality
+        }
+    }
+
+    /// Serializes the load–calibrate–save of the persisted model; jobs finish on several threads.
+    private static let calibrationLock = NSLock()
+
+    /// Feeds the measured duration of a finished job back into the persisted cost model.
+    static func recordActual(plan: ImportPlan, actualSeconds: Double) {
+        calibrationLock.lock()
+        defer { calibrationLock.unlock() }
+        var model = ImportCostModel.load()
+        var raw: [PageImportStrategy: Double] = [:]
+        for p in plan.pages {
+            let f = model.factor(p.strategy)
+            raw[p.strategy, default: 0] += f > 0 ? p.estimatedSeconds / f : p.estimatedSeconds
+        }
+        model.calibrate(rawEstimates: raw, actualSeconds: actualSeconds)
+        model.save()
+    }
+}
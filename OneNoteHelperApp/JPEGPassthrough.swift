@@ -0,0 +1,70 @@
+import Foundation
+import CoreGraphics
+
+/// Scanned PDFs are typically one full-page JPEG per page. For those pages we can attach the original
+/// `DCTDecode` bytes instead of rendering the page and re-encoding it as a (much larger) PNG.
+enum JPEGPassthrough {
+    static let enabledKey = "JPEGPassthrough"
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    /// Minimum share of the MediaBox the image must cover to be considered "the page".
+    private static let minCoverage = 0.97
+
+    /// Returns the embedded JPEG when the page's only visible content is a single, upright,
+    /// full-page DCT-encoded image that browsers can display as-is; nil otherwise.
+    static func fullPageJPEG(page: CGPDFPage, pageIndex: Int) -> Data? {
+        guard page.rotationAngle % 360 == 0 else { return nil }
+
+        let (features, images) = PDFPageFeatureExtractor.scan(page: page, pageIndex: pageIndex)
+        guard features.textRunCount == 0,
+              features.pathOpCount == 0,
+              features.imageCount == 1,
+              images.count == 1,
+              features.imageCoverage >= minCoverage,
+              let placed = images.first else {
+            return nil
+        }
+
+        // Axis-aligned and not mirrored: the JPEG pixels then appear on the page as stored.
+        let t = placed.transform
+        guard abs(t.b) < 1e-6, abs(t.c) < 1e-6, t.a > 0, t.d > 0 else { return nil }
+
+        guard let dict = CGPDFStreamGetDictionary(placed.stream), isPlainDCT(dict) else { return nil }
+
+        var format: CGPDFDataFormat = .raw
+        guard let cfData = CGPDFStreamCopyData(placed.stream, &format), format == .jpegEncoded else { return nil }
+        let data = cfData as Data
+
+        // Sanity check: SOI marker.
+        guard data.count > 4, data[data.startIndex] == 0xFF, data[data.startIndex + 1] == 0xD8 else { return nil }
+        return data
+    }
+
+    /// A single DCTDecode filter, an RGB/Gray colour space, and nothing that changes how the pixels
+    /// are composited (Decode arrays, masks). CMYK JPEGs are excluded: browsers render Adobe CMYK poorly.
+    private static func isPlainDCT(_ dict: CGPDFDictionaryRef) -> Bool {
+        var filterName: UnsafePointer<Int8>?
+        if CGPDFDictionaryGetName(dict, "Filter", &filterName), let filterName {
+            guard String(cString: filterName) == "DCTDecode" else { return false }
+        } else {
+            var arr: CGPDFArrayRef?
+            guard CGPDFDictionaryGetArray(dict, "Filter", &arr), let arr, CGPDFArrayGetCount(arr) == 1 else { return false }
+            var n: UnsafePointer<Int8>?
+            guard CGPDFArrayGetName(arr, 0, &n), let n, String(cString: n) == "DCTDecode" else { return false }
+        }
+
+        var csName: UnsafePointer<Int8>?
+        guard CGPDFDictionaryGetName(dict, "ColorSpace", &csName), let csName else { return false }
+        let cs = String(cString: csName)
+        guard cs == "DeviceRGB" || cs == "DeviceGray" else { return false }
+
+        var obj: CGPDFObjectRef?
+        for key in ["Decode", "SMask", "Mask"] where CGPDFDictionaryGetObject(dict, key, &obj) {
+            return false
+        }
+        return true
+    }
+}
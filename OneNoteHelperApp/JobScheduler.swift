@@ -0,0 +1,183 @@
+import Foundation
+
+/// Runs print jobs concurrently, fairly across users, with separate limits for CPU-heavy and network work.
+///
+/// - Up to `JobWorkers` jobs run at once (default 2). When a worker frees up, the next job is taken from the
+///   next user in round-robin order, so one user's 300-page job (or a burst of jobs) can't hold back another
+///   user's one-page print.
+/// - Inside a job, rendering/extraction runs under a `.cpu` slot (`JobCPUStageLimit`, default half the cores)
+///   and Graph requests under a `.network` slot (`JobNetworkStageLimit`, default 2). A job uploading holds no
+///   CPU slot, so the next job can render while it uploads.
+///
+/// `occupancy` reports how full each stage is; it is logged whenever a job starts or finishes.
+final class JobScheduler {
+    static let workersKey = "JobWorkers"
+    static let cpuLimitKey = "JobCPUStageLimit"
+    static let networkLimitKey = "JobNetworkStageLimit"
+
+    static let shared = JobScheduler()
+
+    enum Stage: String {
+        case cpu
+        case network
+    }
+
+    struct Occupancy {
+        let runningJobs: Int
+        let workers: Int
+        let queuedJobs: Int
+        let queuedUsers: Int
+        let cpuActive: Int
+        let cpuLimit: Int
+        let networkActive: Int
+        let networkLimit: Int
+
+        var summary: String {
+            "jobs \(runningJobs)/\(workers) running, \(queuedJobs) queued (\(queuedUsers) user(s)); cpu \(cpuActive)/\(cpuLimit); network \(networkActive)/\(networkLimit)"
+        }
+    }
+
+    /// Held while a job is in a stage. `leave()` is idempotent.
+    final class StageSlot {
+        private let scheduler: JobScheduler
+        let stage: Stage
+        private var left = false
+        private let lock = NSLock()
+
+        fileprivate init(scheduler: JobScheduler, stage: Stage) {
+            self.scheduler = scheduler
+            self.stage = stage
+        }
+
+        func leave() {
+            lock.lock()
+            let first = !left
+            left = true
+            lock.unlock()
+            if first { scheduler.release(stage) }
+        }
+
+        deinit {
+            leave()
+        }
+    }
+
+    private struct Job {
+        let label: String
+        let work: (@escaping () -> Void) -> Void
+    }
+
+    private let condition = NSCondition()
+    private var queues: [String: [Job]] = [:]
+    /// Users with queued jobs, in round-robin order; the next job comes from the front.
+    private var userOrder: [String] = []
+    private var running = 0
+    private var active: [Stage: Int] = [:]
+
+    /// Called (on an arbitrary thread) when a job starts or finishes, with e.g. "started job-12.pdf for alice".
+    var onChange: ((String, Occupancy) -> Void)?
+
+    static var workers: Int {
+        let v = UserDefaults.standard.integer(forKey: workersKey)
+        return v > 0 ? v : 2
+    }
+
+    static func limit(for stage: Stage) -> Int {
+        switch stage {
+        case .cpu:
+            let v = UserDefaults.standard.integer(forKey: cpuLimitKey)
+            return v > 0 ? v : max(1, ProcessInfo.processInfo.activeProcessorCount / 2)
+        case .network:
+            let v = UserDefaults.standard.integer(forKey: networkLimitKey)
+            return v > 0 ? v : 2
+        }
+    }
+
+    /// Queues a job for `user`. `work` runs on a background queue and must call its argument when the job is
+    /// finished (successfully or not), or earlier once it no longer needs a worker; later calls are ignored.
+    func submit(user: String, label: String, work: @escaping (_ finished: @escaping () -> Void) -> Void) {
+        condition.lock()
+        let key = user.isEmpty ? "(unknown)" : user
+        if queues[key, default: []].isEmpty, !userOrder.contains(key) {
+            userOrder.append(key)
+        }
+        queues[key, default: []].append(Job(label: label, work: work))
+        condition.unlock()
+        startJobs()
+    }
+
+    var occupancy: Occupancy {
+        condition.lock()
+        defer { condition.unlock() }
+        return snapshot()
+    }
+
+    /// Blocks until a slot in `stage` is free. Call `leave()` on the result when the stage is done.
+    func enter(_ stage: Stage) -> StageSlot {
+        condition.lock()
+        while active[stage, default: 0] >= Self.limit(for: stage) {
+            condition.wait()
+        }
+        active[stage, default: 0] += 1
+        condition.unlock()
+        return StageSlot(scheduler: self, stage: stage)
+    }
+
+    fileprivate func release(_ stage: Stage) {
+        condition.lock()
+        active[stage, default: 0] = max(0, active[stage, default: 0] - 1)
+        condition.broadcast()
+        condition.unlock()
+    }
+
+    private func snapshot() -> Occupancy {
+        Occupancy(runningJobs: running, workers: Self.workers,
+                  queuedJobs: queues.values.reduce(0) { $0 + $1.count }, queuedUsers: userOrder.count,
+                  cpuActive: active[.cpu, default: 0], cpuLimit: Self.limit(for: .cpu),
+                  networkActive: active[.network, default: 0], networkLimit: Self.limit(for: .network))
+    }
+
+    /// Starts queued jobs while workers are free, taking one job per user in turn.
+    private func startJobs() {
+        while true {
+            condition.lock()
+            guard running < Self.workers, !userOrder.isEmpty else {
+                condition.unlock()
+                return
+            }
+            let user = userOrder.removeFirst()
+            let job = queues[user]!.removeFirst()
+            if queues[user]!.isEmpty {
+                queues[user] = nil
+            } else {
+                // Back of the line: other users go first.
+                userOrder.append(user)
+            }
+            running += 1
+            let occupancy = snapshot()
+            condition.unlock()
+
+            onChange?("started \(job.label) for \(user)", occupancy)
+            let once = NSLock()
+            var done = false
+            DispatchQueue.global(qos: .userInitiated).async {
+                job.work { [weak self] in
+                    once.lock()
+                    let first = !done
+                    done = true
+                    once.unlock()
+                    if first { self?.finish(label: job.label) }
+                }
+            }
+        }
+    }
+
+    private func finish(label: String) {
+        condition.lock()
+        running = max(0, running - 1)
+        let occupancy = snapshot()
+        condition.unlock()
+        onChange?("finished \(label)", occupancy)
+        startJobs()
+    }
+}
@@ -0,0 +1,85 @@
+import Foundation
+
+/// Splits a job's content into several OneNote requests when one request would be too large.
+///
+/// The job is a list of page sections (HTML plus the binary parts it references). Sections are packed in
+/// order into chunks of at most `SplitMaxRequestMegabytes` (default 20) and `SplitMaxPartsPerRequest`
+/// (default 30) binary parts. The first chunk creates the page (or appends to the target page) together with
+/// one empty placeholder `<div data-id=...>` per later chunk; later chunks are PATCH-appended into their own
+/// placeholder. Because each PATCH has its own target, they can be sent concurrently
+/// (`SplitUploadConcurrency`, default 3) and still land in page order. Placeholder ids carry a per-job split
+/// id, so two split jobs appending to the same page can't fill each other's placeholders.
+enum JobSplitter {
+    static let maxRequestMegabytesKey = "SplitMaxRequestMegabytes"
+    static let maxPartsKey = "SplitMaxPartsPerRequest"
+    static let concurrencyKey = "SplitUploadConcurrency"
+
+    static var maxRequestBytes: Int {
+        let v = UserDefaults.standard.double(forKey: maxRequestMegabytesKey)
+        return Int((v > 0 ? v : 20) * 1_048_576)
+    }
+
+    static var maxParts: Int {
+        let v = UserDefaults.standard.integer(forKey: maxPartsKey)
+        return v > 0 ? v : 30
+    }
+
+    static var concurrency: Int {
+        let v = UserDefaults.standard.integer(forKey: concurrencyKey)
+        return v > 0 ? v : 3
+    }
+
+    /// Bytes a request carries besides the sections: header HTML, multipart framing, patch commands.
+    static let requestOverheadBytes = 8 * 1024
+    /// Multipart framing per binary part.
+    static let partOverheadBytes = 256
+
+    /// Consecutive index ranges of the sections, each within the limits. A section that is over the limits on
+    /// its own gets a chunk to itself.
+    ///
+    /// - Parameters:
+    ///   - htmlBytes: HTML size of each section.
+    ///   - tokens: binary parts each section references (a part referenced by several sections in the same
+    ///     chunk is counted once).
+    ///   - partBytes: size of each part by token.
+    static func partition(htmlBytes: [Int], tokens: [[String]], partBytes: [String: Int],
+                          maxBytes: Int = maxRequestBytes, maxParts: Int = maxParts) -> [Range<Int>] {
+        var ranges: [Range<Int>] = []
+        var start = 0
+        var bytes = requestOverheadBytes
+        var seen: Set<String> = []
+
+        for i in htmlBytes.indices {
+            let newTokens = Set(tokens[i]).subtracting(seen)
+            let added = htmlBytes[i] + newTokens.reduce(0) { $0 + (partBytes[$1] ?? 0) + partOverheadBytes }
+            if i > start, bytes + added > maxBytes || seen.count + newTokens.count > maxParts {
+                ranges.append(start..<i)
+                start = i
+                bytes = requestOverheadBytes
+                seen = []
+                // Recount against the fresh chunk.
+                let fresh = Set(tokens[i])
+                bytes += htmlBytes[i] + fresh.reduce(0) { $0 + (partBytes[$1] ?? 0) + partOverheadBytes }
+                seen = fresh
+                continue
+            }
+            bytes += added
+            seen.formUnion(newTokens)
+        }
+        if start < htmlBytes.count {
+            ranges.append(start..<htmlBytes.count)
+        }
+        return ranges
+    }
+
+    /// `data-id` of the placeholder that chunk `index` (1-based among later chunks) of split `splitId` is
+    /// appended into. A pipelined image job has one placeholder per page instead, numbered by page.
+    static func placeholderID(_ index: Int, splitId: String) -> String {
+        "onh-\(splitId)-part-\(index)"
+    }
+
+    /// A new id for one job's split requests.
+    static func makeSplitID() -> String {
+        UUID().uuidString.lowercased()
+    }
+}
@@ -0,0 +1,268 @@
+import Foundation
+
+/// Values from the linearization parameter dictionary (PDF 32000-1, Annex F.2).
+struct LinearizationInfo {
+    /// /L: length of the complete file in bytes.
+    let fileLength: Int
+    /// /H: offset and length of the primary hint stream.
+    let hintOffset: Int
+    let hintLength: Int
+    /// /O: object number of the first page's page object.
+    let firstPageObject: Int
+    /// /E: offset of the end of the first page section.
+    let endOfFirstPage: Int
+    /// /N: number of pages.
+    let pageCount: Int
+    /// /T: offset of the first entry of the main cross-reference table.
+    let mainXrefOffset: Int
+}
+
+/// Reads a linearized PDF while it is still being written (spooled) by the CUPS backend.
+///
+/// The linearization dictionary and the page offset hint table tell us where each page ends, so we can
+/// tell how many pages have landed. Only the first page section is self-contained though: objects shared
+/// by later pages live in part 8, right before the main xref, i.e. at the very end of the file. So the
+/// reader can produce a standalone one-page PDF as soon as `/E` bytes are on disk, and only reports
+/// progress for the other pages. Not thread-safe: use a reader from one queue only.
+final class LinearizedPDFReader {
+    let url: URL
+    private(set) var info: LinearizationInfo?
+    /// Absolute end offset (exclusive) of every page, in page order. Empty until the hint stream has landed.
+    private(set) var pageEnds: [Int] = []
+
+    init(url: URL) {
+        self.url = url
+    }
+
+    var currentSize: Int {
+        (try? FileManager.default.attributesOfItem(atPath: url.path)[.size] as? NSNumber)?.intValue ?? 0
+    }
+
+    /// Re-reads whatever became available since the last call. Returns false if the file is not linearized.
+    @discardableResult
+    func refresh() -> Bool {
+        let size = currentSize
+        if info == nil {
+            guard size >= 64, let head = read(offset: 0, length: min(size, 1024)) else { return true }
+            guard let parsed = Self.parseLinearizationDictionary(head) else {
+                // Enough header bytes and still no /Linearized: the file isn't linearized.
+                return size < 1024
+            }
+            info = parsed
+        }
+        if pageEnds.isEmpty, let info, size >= info.hintOffset + info.hintLength,
+           let hint = read(offset: info.hintOffset, length: info.hintLength),
+           let table = Self.decodeHintStream(hint) {
+            pageEnds = Self.pageEnds(hintTable: table, info: info)
+        }
+        return true
+    }
+
+    /// Number of leading pages whose bytes are all on disk.
+    var landedPageCount: Int {
+        guard let info else { return 0 }
+        let size = currentSize
+        if pageEnds.isEmpty {
+            return size >= info.endOfFirstPage ? 1 : 0
+        }
+        return pageEnds.prefix { $0 <= size }.count
+    }
+
+    /// A standalone PDF containing only the first page, built from the first `/E` bytes.
+    /// Returns nil until those bytes have landed, or if the layout isn't one we can patch safely.
+    func firstPageDocumentData() -> Data? {
+        guard let info, currentSize >= info.endOfFirstPage,
+              let prefix = read(offset: 0, length: info.endOfFirstPage) else { return nil }
+        return Self.buildFirstPageDocument(prefix: prefix, info: info)
+    }
+
+    private func read(offset: Int, length: Int) -> Data? {
+        guard let fh = try? FileHandle(forReadingFrom: url) else { return nil }
+        defer { try? fh.close() }
+        do {
+            try fh.seek(toOffset: UInt64(offset))
+            let data = try fh.read(upToCount: length) ?? Data()
+            return data.count == length ? data : nil
+        } catch {
+            return nil
+        }
+    }
+
+    // MARK: - Linearization dictionary
+
+    static func parseLinearizationDictionary(_ head: Data) -> LinearizationInfo? {
+        let s = String(decoding: head, as: UTF8.self)
+        guard let lin = s.range(of: "/Linearized"),
+              let open = s.range(of: "<<", options: .backwards, range: s.startIndex..<lin.lowerBound),
+              let close = s.range(of: ">>", range: lin.upperBound..<s.endIndex) else { return nil }
+        let dict = String(s[open.upperBound..<close.lowerBound])
+
+        func int(_ key: String) -> Int? {
+            firstMatch("/\(key)\\s+(\\d+)", in: dict).flatMap { Int($0[0]) }
+        }
+        guard let l = int("L"), let o = int("O"), let e = int("E"), let n = int("N"), let t = int("T"),
+              let h = firstMatch("/H\\s*\\[\\s*(\\d+)\\s+(\\d+)", in: dict),
+              let h0 = Int(h[0]), let h1 = Int(h[1]) else { return nil }
+        return LinearizationInfo(fileLength: l, hintOffset: h0, hintLength: h1,
+                                 firstPageObject: o, endOfFirstPage: e, pageCount: n, mainXrefOffset: t)
+    }
+
+    // MARK: - Hint tables
+
+    /// Decodes the primary hint stream object and returns its (decompressed) data.
+    static func decodeHintStream(_ object: Data) -> Data? {
+        guard let streamKw = object.range(of: Data("stream".utf8)) else { return nil }
+        let dictText = String(decoding: object[object.startIndex..<streamKw.lowerBound], as: UTF8.self)
+
+        var start = streamKw.upperBound
+        if start < object.endIndex, object[start] == 0x0D { start += 1 }
+        if start < object.endIndex, object[start] == 0x0A { start += 1 }
+
+        // A direct /Length only: an indirect one ("12 0 R") can't be resolved here. The lookahead skips digits
+        // too, so backtracking can't match a prefix of the object number ("1" of "12 0 R").
+        let end: Int
+        if let len = firstMatch("/Length\\s+(\\d+)(?![\\d\\s]*R)", in: dictText).flatMap({ Int($0[0]) }),
+           start + len <= object.endIndex {
+            end = start + len
+        } else if let endKw = object.range(of: Data("endstream".utf8), in: start..<object.endIndex) {
+            end = endKw.lowerBound
+        } else {
+            return nil
+        }
+        let raw = object[start..<end]
+
+        if dictText.contains("/FlateDecode") {
+            // zlib stream: skip the 2-byte header; NSData's .zlib expects raw deflate.
+            guard raw.count > 2 else { return nil }
+            return try? (Data(raw.dropFirst(2)) as NSData).decompressed(using: .zlib) as Data
+        }
+        return dictText.contains("/Filter") ? nil : Data(raw)
+    }
+
+    /// Absolute page end offsets from the page offset hint table (Annex F.4.1, items 1-2 of the
+    /// per-page entries). Hint-table offsets ignore the hint stream itself, hence `adjust`.
+    static func pageEnds(hintTable: Data, info: LinearizationInfo) -> [Int] {
+        var r = BitReader(hintTable)
+        guard let _ = r.read(32),                      // least number of objects in a page
+              let firstPageLocation = r.read(32),      // location of the first page's page object
+              let objBits = r.read(16),
+              let leastPageLength = r.read(32),
+              let lengthBits = r.read(16) else { return [] }
+        // Remaining header items (content stream offsets/lengths, shared refs) aren't needed here.
+        r.skipBits(32 + 16 + 32 + 16 + 16 + 16 + 16 + 16)
+
+        let n = info.pageCount
+        guard n > 0, objBits <= 32, lengthBits <= 32 else { return [] }
+
+        // Item 1 for every page, byte aligned, then item 2 for every page.
+        for _ in 0..<n { guard r.read(objBits) != nil else { return [] } }
+        r.alignToByte()
+
+        func adjust(_ offset: Int) -> Int {
+            offset >= info.hintOffset ? offset + info.hintLength : offset
+        }
+
+        var ends: [Int] = []
+        ends.reserveCapacity(n)
+        var pos = firstPageLocation
+        for i in 0..<n {
+            guard let delta = r.read(lengthBits) else { return [] }
+            pos += leastPageLength + delta
+            // The first page section is bounded by /E regardless of how the hint table rounds it.
+            ends.append(i == 0 ? min(info.endOfFirstPage, adjust(pos)) : adjust(pos))
+        }
+        return ends
+    }
+
+    private struct BitReader {
+        private let bytes: [UInt8]
+        private var bit = 0
+
+        init(_ data: Data) { bytes = [UInt8](data) }
+
+        mutating func read(_ count: Int) -> Int? {
+            guard count >= 0, bit + count <= bytes.count * 8 else { return nil }
+            var v = 0
+            for _ in 0..<count {
+                let b = (bytes[bit >> 3] >> (7 - UInt8(bit & 7))) & 1
+                v = (v << 1) | Int(b)
+                bit += 1
+            }
+            return v
+        }
+
+        mutating func skipBits(_ count: Int) { bit += count }
+
+        mutating func alignToByte() { bit = (bit + 7) & ~7 }
+    }
+
+    // MARK: - First page document
+
+    /// Appends an update section to the first-page prefix: a one-kid page tree root and a fresh xref
+    /// built by scanning the object headers actually present in the prefix (no /Prev chain, since the
+    /// first-page trailer points at the main xref which hasn't been written yet).
+    static func buildFirstPageDocument(prefix: Data, info: LinearizationInfo) -> Data? {
+        // ISO Latin 1 maps every byte to one UTF-16 unit, so string offsets are byte offsets.
+        guard let text = String(data: prefix, encoding: .isoLatin1) else { return nil }
+        let ns = text as NSString
+        if text.contains("/Encrypt") { return nil }
+
+        var offsets: [Int: (offset: Int, gen: Int)] = [:]
+        guard let objRe = try? NSRegularExpression(pattern: "(?:^|[\\r\\n])(\\d+)\\s+(\\d+)\\s+obj\\b", options: []) else { return nil }
+        for m in objRe.matches(in: text, range: NSRange(location: 0, length: ns.length)) {
+            guard let num = Int(ns.substring(with: m.range(at: 1))),
+                  let gen = Int(ns.substring(with: m.range(at: 2))) else { continue }
+            offsets[num] = (m.range(at: 1).location, gen)
+        }
+
+        func objectBody(_ num: Int) -> String? {
+            guard let entry = offsets[num] else { return nil }
+            let rest = ns.substring(from: entry.offset)
+            guard let end = rest.range(of: "endobj") else { return nil }
+            return String(rest[rest.startIndex..<end.lowerBound])
+        }
+
+        guard offsets[info.firstPageObject] != nil,
+              let root = firstMatch("/Root\\s+(\\d+)\\s+(\\d+)\\s+R", in: text),
+              let rootNum = Int(root[0]), let rootGen = Int(root[1]),
+              let catalog = objectBody(rootNum),
+              let pagesRef = firstMatch("/Pages\\s+(\\d+)\\s+(\\d+)\\s+R", in: catalog),
+              let pagesNum = Int(pagesRef[0]), let pagesGen = Int(pagesRef[1]) else { return nil }
+
+        // Keep inheritable attributes (Resources, MediaBox, Rotate) of the original root node.
+        var pagesDict = "<< /Type /Pages /Kids [\(info.firstPageObject) 0 R] /Count 1 >>"
+        if let original = objectBody(pagesNum),
+           let open = original.range(of: "<<"), let close = original.range(of: ">>", options: .backwards) {
+            var inner = String(original[open.upperBound..<close.lowerBound])
+            inner = inner.replacingOccurrences(of: "/Kids\\s*\\[[^\\]]*\\]", with: "", options: .regularExpression)
+            inner = inner.replacingOccurrences(of: "/Count\\s+\\d+", with: "", options: .regularExpression)
+            pagesDict = "<<\(inner) /Kids [\(info.firstPageObject) 0 R] /Count 1 >>"
+        }
+
+        var out = prefix
+        if out.last != 0x0A { out.append(0x0A) }
+        offsets[pagesNum] = (out.count, pagesGen)
+        out.append(Data("\(pagesNum) \(pagesGen) obj\n\(pagesDict)\nendobj\n".utf8))
+
+        let size = (offsets.keys.max() ?? 0) + 1
+        let xrefOffset = out.count
+        var xref = "xref\n0 \(size)\n0000000000 65535 f\r\n"
+        for num in 1..<size {
+            if let entry = offsets[num] {
+                xref += String(format: "%010d %05d n\r\n", entry.offset, entry.gen)
+            } else {
+                xref += "0000000000 00000 f\r\n"
+            }
+        }
+        xref += "trailer\n<< /Size \(size) /Root \(rootNum) \(rootGen) R >>\nstartxref\n\(xrefOffset)\n%%EOF\n"
+        out.append(Data(xref.utf8))
+        return out
+    }
+
+    private static func firstMatch(_ pattern: String, in text: String) -> [String]? {
+        guard let re = try? NSRegularExpression(pattern: pattern, options: []) else { return nil }
+        let ns = text as NSString
+        guard let m = re.firstMatch(in: text, range: NSRange(location: 0, length: ns.length)) else { return nil }
+        return (1..<m.numberOfRanges).map { ns.substring(with: m.range(at: $0)) }
+    }
+}
@@ -0,0 +1,110 @@
+import Foundation
+
+/// `multipart/form-data` body, written to disk and uploaded from that file.
+///
+/// Parts are kept as references until the body is written: small header buffers, payloads the caller holds
+/// in memory as-is (`Data` is not copied), and files by URL. `contentLength` is known up front (for preflight
+/// and splitting). `write(to:)` writes the segments one at a time - file parts memory-mapped - into the outbox,
+/// which uploads the request from that file (see UploadOutbox). In-memory payloads (rendered images) stay in
+/// memory until then; the body is never concatenated into a second copy.
+final class MultipartBody {
+    let boundary: String
+
+    private enum Segment {
+        case bytes(Data)
+        case file(URL, length: Int)
+
+        var length: Int {
+            switch self {
+            case .bytes(let d): return d.count
+            case .file(_, let length): return length
+            }
+        }
+    }
+
+    private var segments: [Segment] = []
+    private var finished = false
+
+    private(set) var contentLength: Int = 0
+    private(set) var partCount: Int = 0
+
+    var contentType: String {
+        "multipart/form-data; boundary=\(boundary)"
+    }
+
+    init(boundary: String) {
+        self.boundary = boundary
+    }
+
+    func append(contentType: String, contentDisposition: String, data: Data) {
+        appendHeader(contentType: contentType, contentDisposition: contentDisposition)
+        add(.bytes(data))
+        add(.bytes(Data("\r\n".utf8)))
+    }
+
+    /// Adds a part whose payload is copied from `fileURL` when the body is written. Returns false (and adds
+    /// nothing) if the file can't be read. The file must stay in place until `write(to:)` has run.
+    @discardableResult
+    func append(contentType: String, contentDisposition: String, fileURL: URL) -> Bool {
+        guard let size = (try? FileManager.default.attributesOfItem(atPath: fileURL.path)[.size] as? NSNumber)?.intValue,
+              size > 0, FileManager.default.isReadableFile(atPath: fileURL.path) else { return false }
+        appendHeader(contentType: contentType, contentDisposition: contentDisposition)
+        add(.file(fileURL, length: size))
+        add(.bytes(Data("\r\n".utf8)))
+        return true
+    }
+
+    /// Appends the closing boundary. No parts can be added afterwards.
+    func finish() {
+        guard !finished else { return }
+        add(.bytes(Data("--\(boundary)--\r\n".utf8)))
+        finished = true
+    }
+
+    /// `name` made safe for a quoted `filename="…"` parameter: path separators, quotes, and control and line
+    /// break characters (which would end the header) become "_", and the result is at most `maxLength` characters.
+    static func safeFilename(_ name: String, maxLength: Int = 120) -> String {
+        let unsafe = CharacterSet(charactersIn: "/\\:\"").union(.controlCharacters).union(.newlines)
+        let scalars = name.unicodeScalars.map { unsafe.contains($0) ? "_" : Character($0) }
+        let safe = String(String(scalars).prefix(maxLength)).trimmingCharacters(in: .whitespaces)
+        return safe.isEmpty ? "_" : safe
+    }
+
+    /// Writes the whole body to `url` (e.g. to keep it for a later retry), one segment at a time.
+    func write(to url: URL) throws {
+        guard FileManager.default.createFile(atPath: url.path, contents: nil) else {
+            throw CocoaError(.fileWriteUnknown, userInfo: [NSFilePathErrorKey: url.path])
+        }
+        let handle = try FileHandle(forWritingTo: url)
+        defer { try? handle.close() }
+        for segment in segments {
+            switch segment {
+            case .bytes(let data):
+                try handle.write(contentsOf: data)
+            case .file(let source, let length):
+                let mapped = try Data(contentsOf: source, options: .alwaysMapped)
+                guard mapped.count >= length else {
+                    throw CocoaError(.fileReadCorruptFile, userInfo: [NSFilePathErrorKey: source.path])
+                }
+                try handle.write(contentsOf: mapped.prefix(length))
+            }
+        }
+    }
+
+    private func appendHeader(contentType: String, contentDisposition: String) {
+        precondition(!finished, "MultipartBody: part appended after finish()")
+        let header = "--\(boundary)\r\nContent-Disposition: \(contentDisposition)\r\nContent-Type: \(contentType)\r\n\r\n"
+        add(.bytes(Data(header.utf8)))
+        partCount += 1
+    }
+
+    private func add(_ segment: Segment) {
+        // Coalesce adjacent small buffers (trailing CRLF + next header) into one write.
+        if case .bytes(let next) = segment, next.count < 4096, case .bytes(let prev)? = segments.last, prev.count < 4096 {
+            segments[segments.count - 1] = .bytes(prev + next)
+        } else {
+            segments.append(segment)
+        }
+        contentLength += segment.length
+    }
+}
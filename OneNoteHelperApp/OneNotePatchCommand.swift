@@ -0,0 +1,8 @@
+import Foundation
+
+/// One entry of the `commands` part of a OneNote `PATCH …/pages/{id}/content` request.
+struct OneNotePatchCommand: Encodable {
+    let target: String
+    let action: String
+    let content: String
+}
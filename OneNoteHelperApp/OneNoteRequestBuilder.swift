@@ -0,0 +1,53 @@
+import Foundation
+
+/// Parts of OneNote page requests. A create (`POST …/pages`) carries the page HTML in a `Presentation` part, an
+/// append (`PATCH …/pages/{id}/content`) carries it in a `commands` part; binary parts follow and are referenced
+/// from the HTML as `name:<part name>`.
+enum OneNoteRequestBuilder {
+    /// Part name of the PDF in server mode.
+    static let serverRenderPartName = "pdfdoc"
+
+    /// Adds the part carrying `html`: the page document for a create, or an `append` command for a PATCH.
+    static func appendPage(html: String, appending: Bool, to body: MultipartBody) {
+        if appending {
+            let commands = [OneNotePatchCommand(target: "body", action: "append", content: html)]
+            body.append(contentType: "application/json; charset=utf-8",
+                        contentDisposition: "form-data; name=\"commands\"",
+                        data: (try? JSONEncoder().encode(commands)) ?? Data("[]".utf8))
+        } else {
+            body.append(contentType: "text/html; charset=utf-8",
+                        contentDisposition: "form-data; name=\"Presentation\"",
+                        data: Data(html.utf8))
+        }
+    }
+
+    /// Server mode: OneNote renders the attached PDF into page images itself. The HTML shows the PDF with
+    /// `<img data-render-src>` and, with `attachFile`, also attaches it with `<object data-attachment>`; `page`
+    /// wraps that HTML into the page document or fragment. The PDF part is read from `pdfURL` when the body is
+    /// written. False if the PDF can't be read.
+    @discardableResult
+    static func appendServerRender(pdfURL: URL, title: String, attachFile: Bool, appending: Bool,
+                                   page: (String) -> String, to body: MultipartBody) -> Bool {
+        guard FileManager.default.isReadableFile(atPath: pdfURL.path) else { return false }
+        let partName = serverRenderPartName
+        let filename = "\(MultipartBody.safeFilename(title)).pdf"
+        var html = "<img data-render-src=\"name:\(partName)\" alt=\"\(escapeHTML(title))\" />"
+        if attachFile {
+            html = "<object data-attachment=\"\(escapeHTML(filename))\" data=\"name:\(partName)\" type=\"application/pdf\" />\n" + html
+        }
+        appendPage(html: page(html), appending: appending, to: body)
+        return body.append(contentType: "application/pdf",
+                           contentDisposition: "form-data; name=\"\(partName)\"; filename=\"\(filename)\"",
+                           fileURL: pdfURL)
+    }
+
+    static func escapeHTML(_ value: String) -> String {
+        var escaped = value
+        escaped = escaped.replacingOccurrences(of: "&", with: "&amp;")
+        escaped = escaped.replacingOccurrences(of: "<", with: "&lt;")
+        escaped = escaped.replacingOccurrences(of: ">", with: "&gt;")
+        escaped = escaped.replacingOccurrences(of: "\"", with: "&quot;")
+        escaped = escaped.replacingOccurrences(of: "'", with: "&#39;")
+        return escaped
+    }
+}
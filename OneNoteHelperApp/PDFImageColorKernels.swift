@@ -0,0 +1,391 @@
+import Foundation
+
+// Row converters for image XObjects: unpack samples (1/2/4/8/16 bits per component), apply the /Decode
+// mapping and convert the color space to 8-bit gray or RGB rows (PDFImageXObject.swift reads the dictionary
+// and feeds the rows to PNGStreamEncoder).
+//
+// The per-pixel work is specialized at compile time instead of switching per pixel: the bit depth
+// (`SampleReader`), the Decode mapping (`DecodeMap`) and the color space (`ColorKernel`) are generic
+// parameters of `PDFImageConverter.pipeline`, so each combination gets its own loop. Kernels use Swift SIMD
+// types, which compile to NEON on arm64 and to SSE2 on x86_64, the baseline of the default x86_64 target
+// (nothing here is built for AVX). PDFImageColorKernelsTests has a benchmark per specialization.
+
+/// Color model of an image XObject, with palettes / Lab parameters resolved up front.
+enum PDFImageColorModel {
+    case gray
+    case rgb
+    case cmyk
+    /// CIE L*a*b* with its a*/b* range (amin, amax, bmin, bmax). Colors are taken relative to the space's
+    /// white point, so the WhitePoint itself is not needed.
+    case lab(range: SIMD4<Float>)
+    /// Palette already converted to RGB, (hival + 1) * 3 bytes.
+    case indexed(paletteRGB: [UInt8], hival: Int)
+
+    var components: Int {
+        switch self {
+        case .gray, .indexed: return 1
+        case .rgb, .lab: return 3
+        case .cmyk: return 4
+        }
+    }
+
+    /// Channels of the converted rows: 1 (gray) or 3 (RGB).
+    var outputChannels: Int {
+        if case .gray = self { return 1 }
+        return 3
+    }
+}
+
+/// What the converters need from an image XObject dictionary (see `init?(dict:)`).
+struct PDFImageDescriptor {
+    let width: Int
+    let height: Int
+    let bitsPerComponent: Int
+    let model: PDFImageColorModel
+    /// /Decode, 2 values per component; nil for the default mapping.
+    let decode: [Float]?
+
+    var rowBytes: Int {
+        (width * model.components * bitsPerComponent + 7) / 8
+    }
+}
+
+// MARK: - Sample readers (bits per component)
+
+protocol SampleReader {
+    static var bits: Int { get }
+    /// The `index`-th sample of a packed row (MSB first; 16-bit samples are big-endian).
+    static func sample(_ row: UnsafePointer<UInt8>, _ index: Int) -> UInt16
+}
+
+enum Bits1: SampleReader {
+    static var bits: Int { 1 }
+    @inline(__always) static func sample(_ row: UnsafePointer<UInt8>, _ i: Int) -> UInt16 {
+        UInt16((row[i >> 3] >> (7 - UInt8(i & 7))) & 1)
+    }
+}
+
+enum Bits2: SampleReader {
+    static var bits: Int { 2 }
+    @inline(__always) static func sample(_ row: UnsafePointer<UInt8>, _ i: Int) -> UInt16 {
+        UInt16((row[i >> 2] >> (6 - 2 * UInt8(i & 3))) & 3)
+    }
+}
+
+enum Bits4: SampleReader {
+    static var bits: Int { 4 }
+    @inline(__always) static func sample(_ row: UnsafePointer<UInt8>, _ i: Int) -> UInt16 {
+        UInt16((row[i >> 1] >> (4 - 4 * UInt8(i & 1))) & 15)
+    }
+}
+
+enum Bits8: SampleReader {
+    static var bits: Int { 8 }
+    @inline(__always) static func sample(_ row: UnsafePointer<UInt8>, _ i: Int) -> UInt16 {
+        UInt16(row[i])
+    }
+}
+
+enum Bits16: SampleReader {
+    static var bits: Int { 16 }
+    @inline(__always) static func sample(_ row: UnsafePointer<UInt8>, _ i: Int) -> UInt16 {
+        UInt16(row[2 * i]) << 8 | UInt16(row[2 * i + 1])
+    }
+}
+
+// MARK: - Decode mappings (raw sample -> 8-bit component)
+
+protocol DecodeMap {
+    func map(_ raw: UInt16, component: Int) -> UInt8
+}
+
+/// Default /Decode for continuous color: scale the sample range onto 0...255.
+struct IdentityDecode<R: SampleReader>: DecodeMap {
+    @inline(__always) func map(_ raw: UInt16, component: Int) -> UInt8 {
+        switch R.bits {
+        case 16: return UInt8(raw >> 8)
+        case 8: return UInt8(truncatingIfNeeded: raw)
+        default: return UInt8(truncatingIfNeeded: raw &* UInt16(255 / ((1 << R.bits) - 1)))
+        }
+    }
+}
+
+/// Default /Decode for Indexed images: the sample is the palette index.
+struct IndexDecode: DecodeMap {
+    @inline(__always) func map(_ raw: UInt16, component: Int) -> UInt8 {
+        UInt8(min(raw, 255))
+    }
+}
+
+/// Explicit /Decode arrays: one lookup table per component, indexed by the sample (top 8 bits for 16-bit).
+struct TableDecode: DecodeMap {
+    let tables: [[UInt8]]
+    let shift: UInt16
+
+    /// `toByte` maps a decoded value to the 8-bit component the kernel expects, per component.
+    init(decode: [Float], bitsPerComponent: Int, toByte: (Float, Int) -> UInt8) {
+        let levels = 1 << min(bitsPerComponent, 8)
+        shift = bitsPerComponent == 16 ? 8 : 0
+        tables = (0..<(decode.count / 2)).map { c in
+            let dmin = decode[2 * c]
+            let dmax = decode[2 * c + 1]
+            return (0..<levels).map { raw in
+                toByte(dmin + Float(raw) * (dmax - dmin) / Float(levels - 1), c)
+            }
+        }
+    }
+
+    @inline(__always) func map(_ raw: UInt16, component: Int) -> UInt8 {
+        tables[component][Int(raw >> shift)]
+    }
+}
+
+// MARK: - Color kernels (8-bit components -> 8-bit gray or RGB)
+
+protocol ColorKernel {
+    var components: Int { get }
+    /// 1 (gray) or 3 (RGB).
+    var outputChannels: Int { get }
+    func convert(_ src: UnsafePointer<UInt8>, _ out: UnsafeMutablePointer<UInt8>, count: Int)
+}
+
+struct CopyKernel: ColorKernel {
+    let components: Int
+    var outputChannels: Int { components }
+
+    @inline(__always) func convert(_ src: UnsafePointer<UInt8>, _ out: UnsafeMutablePointer<UInt8>, count: Int) {
+        out.update(from: src, count: count * components)
+    }
+}
+
+/// Naive (non-ICC) CMYK -> RGB: R = (1 - C)(1 - K), ..., 16 pixels at a time.
+struct CMYKKernel: ColorKernel {
+    var components: Int { 4 }
+    var outputChannels: Int { 3 }
+
+    func convert(_ src: UnsafePointer<UInt8>, _ out: UnsafeMutablePointer<UInt8>, count: Int) {
+        var i = 0
+        let raw = UnsafeRawPointer(src)
+        while i + 16 <= count {
+            // De-interleave C M Y K with even/odd halves.
+            let v = raw.loadUnaligned(fromByteOffset: i * 4, as: SIMD64<UInt8>.self)
+            let cy = v.evenHalf, mk = v.oddHalf
+            let c = SIMD16<UInt16>(truncatingIfNeeded: cy.evenHalf)
+            let y = SIMD16<UInt16>(truncatingIfNeeded: cy.oddHalf)
+            let m = SIMD16<UInt16>(truncatingIfNeeded: mk.evenHalf)
+            let k = 255 &- SIMD16<UInt16>(truncatingIfNeeded: mk.oddHalf)
+            let r = Self.div255((255 &- c) &* k)
+            let g = Self.div255((255 &- m) &* k)
+            let b = Self.div255((255 &- y) &* k)
+            let o = out + i * 3
+            for p in 0..<16 {
+                o[3 * p] = UInt8(truncatingIfNeeded: r[p])
+                o[3 * p + 1] = UInt8(truncatingIfNeeded: g[p])
+                o[3 * p + 2] = UInt8(truncatingIfNeeded: b[p])
+            }
+            i += 16
+        }
+        while i < count {
+            let p = src + i * 4
+            let k = 255 - UInt16(p[3])
+            out[i * 3] = UInt8((255 - UInt16(p[0])) * k / 255)
+            out[i * 3 + 1] = UInt8((255 - UInt16(p[1])) * k / 255)
+            out[i * 3 + 2] = UInt8((255 - UInt16(p[2])) * k / 255)
+            i += 1
+        }
+    }
+
+    /// Exact x / 255 for x in 0...65025.
+    @inline(__always) static func div255(_ x: SIMD16<UInt16>) -> SIMD16<UInt16> {
+        let t = x &+ 128
+        return (t &+ (t &>> 8)) &>> 8
+    }
+}
+
+/// Palette lookup (palette already in RGB).
+struct IndexedKernel: ColorKernel {
+    let palette: [UInt8]
+    var components: Int { 1 }
+    var outputChannels: Int { 3 }
+
+    func convert(_ src: UnsafePointer<UInt8>, _ out: UnsafeMutablePointer<UInt8>, count: Int) {
+        let maxIndex = palette.count / 3 - 1
+        palette.withUnsafeBufferPointer { pal in
+            for i in 0..<count {
+                let e = min(Int(src[i]), maxIndex) * 3
+                out[i * 3] = pal[e]
+                out[i * 3 + 1] = pal[e + 1]
+                out[i * 3 + 2] = pal[e + 2]
+            }
+        }
+    }
+}
+
+/// L*a*b* (bytes normalized over L 0...100 and the a*/b* range) -> sRGB, D50-adapted matrix.
+struct LabKernel: ColorKernel {
+    let range: SIMD4<Float>
+    var components: Int { 3 }
+    var outputChannels: Int { 3 }
+
+    /// sRGB transfer function over linear 0...1 in 4096 steps.
+    private static let gammaLUT: [UInt8] = (0..<4096).map { i in
+        let c = Float(i) / 4095
+        let s = c <= 0.0031308 ? 12.92 * c : 1.055 * pow(c, 1 / 2.4) - 0.055
+        return UInt8(max(0, min(255, (s * 255).rounded())))
+    }
+
+    func convert(_ src: UnsafePointer<UInt8>, _ out: UnsafeMutablePointer<UInt8>, count: Int) {
+        // Colors are taken relative to the image's white point and mapped onto D50.
+        let d50 = SIMD3<Float>(0.9642, 1.0, 0.8249)
+        Self.gammaLUT.withUnsafeBufferPointer { lut in
+            for i in 0..<count {
+                let p = src + i * 3
+                let l = Float(p[0]) * (100 / 255)
+                let a = range[0] + Float(p[1]) * (range[1] - range[0]) / 255
+                let b = range[2] + Float(p[2]) * (range[3] - range[2]) / 255
+                let fy = (l + 16) / 116
+                let f = SIMD3<Float>(fy + a / 500, fy, fy - b / 200)
+                let cubed = f * f * f
+                let linear = (f - 16.0 / 116) * (108.0 / 841)
+                let xyz = cubed.replacing(with: linear, where: f .<= 6.0 / 29) * d50
+
+                let rgb = SIMD3<Float>(
+                    3.1338561 * xyz.x - 1.6168667 * xyz.y - 0.4906146 * xyz.z,
+                    -0.9787684 * xyz.x + 1.9161415 * xyz.y + 0.0334540 * xyz.z,
+                    0.0719453 * xyz.x - 0.2289914 * xyz.y + 1.4052427 * xyz.z
+                ).clamped(lowerBound: .zero, upperBound: .one)
+                let idx = SIMD3<Int32>(rgb * 4095, rounding: .toNearestOrEven)
+                out[i * 3] = lut[Int(idx.x)]
+                out[i * 3 + 1] = lut[Int(idx.y)]
+                out[i * 3 + 2] = lut[Int(idx.z)]
+            }
+        }
+    }
+}
+
+// MARK: - Pipeline
+
+enum PDFImageConverter {
+    /// Converts an image XObject's (filter-decoded) samples to `d.model.outputChannels` 8-bit channels per pixel,
+    /// passing each row to `emit` in order (the array is reused between rows). False if the data is short or
+    /// the bit depth unsupported.
+    static func convertRows(_ d: PDFImageDescriptor, data: Data, emit: ([UInt8]) -> Void) -> Bool {
+        guard data.count >= d.rowBytes * d.height else { return false }
+        switch d.bitsPerComponent {
+        case 1: dispatch(Bits1.self, d, data, emit)
+        case 2: dispatch(Bits2.self, d, data, emit)
+        case 4: dispatch(Bits4.self, d, data, emit)
+        case 8: dispatch(Bits8.self, d, data, emit)
+        case 16: dispatch(Bits16.self, d, data, emit)
+        default: return false
+        }
+        return true
+    }
+
+    /// Picks the Decode mapping and kernel for the color model; each branch is its own specialization.
+    private static func dispatch<R: SampleReader>(_ reader: R.Type, _ d: PDFImageDescriptor, _ data: Data,
+                                                  _ emit: ([UInt8]) -> Void) {
+        func unit(_ v: Float, _ c: Int) -> UInt8 { UInt8(max(0, min(255, (v * 255).rounded()))) }
+
+        switch d.model {
+        case .gray, .rgb:
+            let kernel = CopyKernel(components: d.model.components)
+            if let decode = d.decode {
+                return pipeline(reader, TableDecode(decode: decode, bitsPerComponent: R.bits, toByte: unit), kernel, d, data, emit)
+            }
+            return pipeline(reader, IdentityDecode<R>(), kernel, d, data, emit)
+        case .cmyk:
+            if let decode = d.decode {
+                return pipeline(reader, TableDecode(decode: decode, bitsPerComponent: R.bits, toByte: unit), CMYKKernel(), d, data, emit)
+            }
+            return pipeline(reader, IdentityDecode<R>(), CMYKKernel(), d, data, emit)
+        case .lab(let range):
+            let kernel = LabKernel(range: range)
+            if let decode = d.decode {
+                // Re-normalize decoded L*a*b* values onto the bytes LabKernel expects.
+                let map = TableDecode(decode: decode, bitsPerComponent: R.bits) { v, c in
+                    switch c {
+                    case 0: return unit(v / 100, c)
+                    case 1: return unit((v - range[0]) / max(1e-6, range[1] - range[0]), c)
+                    default: return unit((v - range[2]) / max(1e-6, range[3] - range[2]), c)
+                    }
+                }
+                return pipeline(reader, map, kernel, d, data, emit)
+            }
+            return pipeline(reader, IdentityDecode<R>(), kernel, d, data, emit)
+        case .indexed(let palette, let hival):
+            let kernel = IndexedKernel(palette: palette)
+            if let decode = d.decode {
+                let map = TableDecode(decode: decode, bitsPerComponent: R.bits) { v, _ in
+                    UInt8(max(0, min(Float(hival), v.rounded())))
+                }
+                return pipeline(reader, map, kernel, d, data, emit)
+            }
+            return pipeline(reader, IndexDecode(), kernel, d, data, emit)
+        }
+    }
+
+    private static func pipeline<R: SampleReader, D: DecodeMap, K: ColorKernel>(
+        _ reader: R.Type, _ decode: D, _ kernel: K, _ d: PDFImageDescriptor, _ data: Data, _ emit: ([UInt8]) -> Void
+    ) {
+        let samples = d.width * kernel.components
+        let rowBytes = d.rowBytes
+        // 8-bit samples with the default mapping need no unpacking: the kernel reads the stream bytes directly.
+        let direct = R.bits == 8 && D.self == IdentityDecode<R>.self
+        var unpacked = [UInt8](repeating: 0, count: direct ? 0 : samples)
+        var out = [UInt8](repeating: 0, count: d.width * kernel.outputChannels)
+
+        data.withUnsafeBytes { buf in
+            let base = buf.bindMemory(to: UInt8.self).baseAddress!
+            for y in 0..<d.height {
+                let row = base + y * rowBytes
+                out.withUnsafeMutableBufferPointer { o in
+                    if direct {
+                        kernel.convert(row, o.baseAddress!, count: d.width)
+                        return
+                    }
+                    unpacked.withUnsafeMutableBufferPointer { u in
+                        var i = 0
+                        for _ in 0..<d.width {
+                            for c in 0..<kernel.components {
+                                u[i] = decode.map(R.sample(row, i), component: c)
+                                i += 1
+                            }
+                        }
+                        kernel.convert(u.baseAddress!, o.baseAddress!, count: d.width)
+                    }
+                }
+                emit(out)
+            }
+        }
+    }
+
+    /// Converts an Indexed lookup table from its base space to RGB with the same kernels.
+    static func paletteToRGB(base: PDFImageColorModel, lookup: [UInt8], entries: Int) -> [UInt8] {
+        var out = [UInt8](repeating: 0, count: entries * 3)
+        lookup.withUnsafeBufferPointer { src in
+            out.withUnsafeMutableBufferPointer { dst in
+                let s = src.baseAddress!
+                let o = dst.baseAddress!
+                switch base {
+                case .gray:
+                    for i in 0..<entries {
+                        o[3 * i] = s[i]
+                        o[3 * i + 1] = s[i]
+                        o[3 * i + 2] = s[i]
+                    }
+                case .rgb:
+                    o.update(from: s, count: entries * 3)
+                case .cmyk:
+                    CMYKKernel().convert(s, o, count: entries)
+                case .lab(let range):
+                    // Lookup entries hold Lab bytes over the same default ranges as samples.
+                    LabKernel(range: range).convert(s, o, count: entries)
+                case .indexed:
+                    break
+                }
+            }
+        }
+        return out
+    }
+}
@@ -0,0 +1,127 @@
+import Foundation
+import CoreGraphics
+
+// Image XObjects to PNG: the descriptor is read from the image dictionary, and the rows converted by
+// PDFImageColorKernels.swift are written straight into PNGStreamEncoder.
+
+extension PDFImageDescriptor {
+    /// nil for image masks, unsupported color spaces (Separation, DeviceN, Pattern) and malformed dictionaries.
+    init?(dict: CGPDFDictionaryRef) {
+        var w: CGPDFInteger = 0
+        var h: CGPDFInteger = 0
+        guard CGPDFDictionaryGetInteger(dict, "Width", &w), CGPDFDictionaryGetInteger(dict, "Height", &h),
+              w > 0, h > 0 else { return nil }
+        var isMask: CGPDFBoolean = 0
+        if CGPDFDictionaryGetBoolean(dict, "ImageMask", &isMask), isMask != 0 { return nil }
+
+        var bpc: CGPDFInteger = 8
+        _ = CGPDFDictionaryGetInteger(dict, "BitsPerComponent", &bpc)
+        guard [1, 2, 4, 8, 16].contains(bpc) else { return nil }
+
+        var csObj: CGPDFObjectRef?
+        let model: PDFImageColorModel?
+        if CGPDFDictionaryGetObject(dict, "ColorSpace", &csObj), let csObj {
+            model = Self.colorModel(csObj)
+        } else {
+            model = .rgb
+        }
+        guard let model else { return nil }
+
+        var decode: [Float]?
+        var arr: CGPDFArrayRef?
+        if CGPDFDictionaryGetArray(dict, "Decode", &arr), let arr, CGPDFArrayGetCount(arr) == 2 * model.components {
+            decode = (0..<CGPDFArrayGetCount(arr)).map { i in
+                var v: CGPDFReal = 0
+                return CGPDFArrayGetNumber(arr, i, &v) ? Float(v) : 0
+            }
+        }
+
+        self.width = Int(w)
+        self.height = Int(h)
+        self.bitsPerComponent = Int(bpc)
+        self.model = model
+        self.decode = decode
+    }
+
+    private static func colorModel(_ obj: CGPDFObjectRef) -> PDFImageColorModel? {
+        var namePtr: UnsafePointer<Int8>?
+        if CGPDFObjectGetValue(obj, .name, &namePtr), let namePtr {
+            switch String(cString: namePtr) {
+            case "DeviceGray", "CalGray", "G": return .gray
+            case "DeviceRGB", "CalRGB", "RGB": return .rgb
+            case "DeviceCMYK", "CMYK": return .cmyk
+            default: return nil
+            }
+        }
+
+        var arr: CGPDFArrayRef?
+        guard CGPDFObjectGetValue(obj, .array, &arr), let arr, CGPDFArrayGetCount(arr) >= 1 else { return nil }
+        var familyPtr: UnsafePointer<Int8>?
+        guard CGPDFArrayGetName(arr, 0, &familyPtr), let familyPtr else { return nil }
+
+        switch String(cString: familyPtr) {
+        case "CalGray":
+            return .gray
+        case "CalRGB":
+            return .rgb
+        case "ICCBased":
+            // The profile is ignored; /N says which device space it behaves like.
+            var stream: CGPDFStreamRef?
+            guard CGPDFArrayGetStream(arr, 1, &stream), let stream, let d = CGPDFStreamGetDictionary(stream) else { return nil }
+            var n: CGPDFInteger = 0
+            guard CGPDFDictionaryGetInteger(d, "N", &n) else { return nil }
+            switch n {
+            case 1: return .gray
+            case 3: return .rgb
+            case 4: return .cmyk
+            default: return nil
+            }
+        case "Lab":
+            var d: CGPDFDictionaryRef?
+            guard CGPDFArrayGetDictionary(arr, 1, &d), let d else { return nil }
+            func numbers(_ key: String, _ count: Int) -> [Float]? {
+                var a: CGPDFArrayRef?
+                guard CGPDFDictionaryGetArray(d, key, &a), let a, CGPDFArrayGetCount(a) == count else { return nil }
+                return (0..<count).map { i in
+                    var v: CGPDFReal = 0
+                    return CGPDFArrayGetNumber(a, i, &v) ? Float(v) : 0
+                }
+            }
+            let range = numbers("Range", 4) ?? [-100, 100, -100, 100]
+            return .lab(range: SIMD4(range[0], range[1], range[2], range[3]))
+        case "Indexed", "I":
+            guard CGPDFArrayGetCount(arr) >= 4 else { return nil }
+            var baseObj: CGPDFObjectRef?
+            var hival: CGPDFInteger = 0
+            guard CGPDFArrayGetObject(arr, 1, &baseObj), let baseObj, let base = colorModel(baseObj),
+                  CGPDFArrayGetInteger(arr, 2, &hival), (0...255).contains(hival) else { return nil }
+            if case .indexed = base { return nil }
+
+            var lookup = Data()
+            var str: CGPDFStringRef?
+            var stream: CGPDFStreamRef?
+            if CGPDFArrayGetString(arr, 3, &str), let str, let p = CGPDFStringGetBytePtr(str) {
+                lookup = Data(bytes: p, count: CGPDFStringGetLength(str))
+            } else if CGPDFArrayGetStream(arr, 3, &stream), let stream {
+                var format: CGPDFDataFormat = .raw
+                lookup = (CGPDFStreamCopyData(stream, &format) as Data?) ?? Data()
+            }
+            let entries = Int(hival) + 1
+            guard lookup.count >= entries * base.components else { return nil }
+            return .indexed(paletteRGB: PDFImageConverter.paletteToRGB(base: base, lookup: [UInt8](lookup), entries: entries),
+                            hival: Int(hival))
+        default:
+            return nil
+        }
+    }
+}
+
+extension PDFImageConverter {
+    /// Decodes an image XObject's (filter-decoded) samples into a PNG. nil if the data is short or unsupported.
+    static func encodePNG(_ d: PDFImageDescriptor, data: Data) -> Data? {
+        guard let enc = PNGStreamEncoder(width: d.width, height: d.height,
+                                         colorType: d.model.outputChannels == 1 ? .gray : .rgb),
+              convertRows(d, data: data, emit: { enc.append(row: $0) }) else { return nil }
+        return enc.finish()
+    }
+}
@@ -0,0 +1,274 @@
+import Foundation
+import CoreGraphics
+import ImageIO
+import PDFKit
+import UniformTypeIdentifiers
+
+/// PDFKit rendering backend for ParallelPageRenderer. The file is read once; every worker context
+/// opens its own PDFDocument on the shared bytes and draws into its own bitmap context.
+final class PDFKitRasterBackend: PageRasterBackend {
+    private let data: Data
+    let scale: CGFloat
+    /// Per-page overrides of `scale` (see RenderScaleSelector).
+    let pageScales: [Int: CGFloat]
+    /// Pages whose content bounds can be trusted, so only that region (plus padding) is rendered.
+    let regionHints: [Int: RegionHint]
+    let paddingPoints: CGFloat
+
+    /// What is known about a page's content extent before rendering.
+    struct RegionHint {
+        /// Paths (stroked ones with their line width) and images, from a complete content stream scan
+        /// (PDFPageFeatures.graphicsBounds).
+        let graphics: CGRect
+        /// The page shows visible text; its extent is taken from PDFKit's text layout.
+        let hasText: Bool
+    }
+
+    init?(fileURL: URL, scale: CGFloat, pageScales: [Int: CGFloat] = [:],
+          regionHints: [Int: RegionHint] = [:], paddingPoints: CGFloat = 0) {
+        guard let data = try? Data(contentsOf: fileURL), PDFDocument(data: data) != nil else { return nil }
+        self.data = data
+        self.scale = scale
+        self.pageScales = pageScales
+        self.regionHints = regionHints
+        self.paddingPoints = paddingPoints
+    }
+
+    func makeContext() -> PageRasterContext? {
+        guard let doc = PDFDocument(data: data) else { return nil }
+        return Context(document: doc, backend: self)
+    }
+
+    private final class Context: PageRasterContext {
+        private let document: PDFDocument
+        private let backend: PDFKitRasterBackend
+        private let colorSpace = CGColorSpaceCreateDeviceRGB()
+
+        init(document: PDFDocument, backend: PDFKitRasterBackend) {
+            self.document = document
+            self.backend = backend
+        }
+
+        /// The part of the MediaBox worth rendering, or nil to render the whole page.
+        private func contentRect(_ page: PDFPage, mediaBox: CGRect, hint: RegionHint) -> CGRect? {
+            var rect = hint.graphics
+            if hint.hasText {
+                guard let text = page.selection(for: mediaBox)?.bounds(for: page), !text.isEmpty else { return nil }
+                rect = rect.union(text)
+            }
+            guard !rect.isNull, !rect.isEmpty else { return nil }
+            let padded = rect.insetBy(dx: -backend.paddingPoints, dy: -backend.paddingPoints).intersection(mediaBox)
+            guard !padded.isNull, padded.width * padded.height < 0.9 * mediaBox.width * mediaBox.height else { return nil }
+            return padded
+        }
+
+        func rasterize(pageIndex: Int) -> RasterImage? {
+            guard let page = document.page(at: pageIndex) else { return nil }
+            let scale = backend.pageScales[pageIndex] ?? backend.scale
+            let mediaBox = page.bounds(for: .mediaBox)
+            var bounds = mediaBox
+            if let hint = backend.regionHints[pageIndex], let rect = contentRect(page, mediaBox: mediaBox, hint: hint) {
+                bounds = rect
+            }
+            let width = max(1, Int((bounds.width * scale).rounded()))
+            let height = max(1, Int((bounds.height * scale).rounded()))
+            let bytesPerRow = width * 4
+
+            var pixels = [UInt8](repeating: 0, count: bytesPerRow * height)
+            let ok = pixels.withUnsafeMutableBytes { buf -> Bool in
+                guard let ctx = CGContext(data: buf.baseAddress,
+                                          width: width,
+                                          height: height,
+                                          bitsPerComponent: 8,
+                                          bytesPerRow: bytesPerRow,
+                                          space: colorSpace,
+                                          bitmapInfo: CGImageAlphaInfo.premultipliedLast.rawValue) else { return false }
+                ctx.setFillColor(CGColor(red: 1, green: 1, blue: 1, alpha: 1))
+                ctx.fill(CGRect(x: 0, y: 0, width: width, height: height))
+                ctx.scaleBy(x: scale, y: scale)
+                // draw(with:to:) puts the MediaBox origin at (0, 0); shift so the rendered region starts there.
+                ctx.translateBy(x: mediaBox.minX - bounds.minX, y: mediaBox.minY - bounds.minY)
+                page.draw(with: .mediaBox, to: ctx)
+                return true
+            }
+            guard ok else { return nil }
+            return RasterImage(width: width, height: height, bytesPerRow: bytesPerRow, pixels: pixels)
+        }
+    }
+
+    // MARK: - Banded rendering (oversized pages)
+
+    /// Pages above this many pixels at their render scale are rendered in bands (posters, CAD plots).
+    static let bandedThresholdKey = "BandedRenderThresholdMegapixels"
+    /// Size of the band buffer; peak memory of a banded page stays at about this, whatever the page size.
+    static let bandBufferKey = "BandedRenderBufferMegabytes"
+
+    static var bandedThresholdPixels: Double {
+        let v = UserDefaults.standard.double(forKey: bandedThresholdKey)
+        return (v > 0 ? v : 24) * 1_000_000
+    }
+
+    static var bandBufferBytes: Int {
+        let v = UserDefaults.standard.integer(forKey: bandBufferKey)
+        return (v > 0 ? v : 16) << 20
+    }
+
+    /// Renders `page` N rows at a time into one fixed buffer and streams the rows into PNGStreamEncoder, so the
+    /// full-page bitmap never exists. The color type comes from a small probe render (gray pages are written as
+    /// 8-bit gray, everything else as RGB); the probe also serves blank detection when `detectBlank` is set.
+    /// Every band re-draws the page clipped to the band, so this trades CPU for memory: only use it for pages
+    /// too big to rasterize at once.
+    static func encodeBanded(pageIndex: Int, page: PDFPage, scale: CGFloat, detectBlank: Bool) -> EncodedPage? {
+        let bounds = page.bounds(for: .mediaBox)
+        let width = max(1, Int((bounds.width * scale).rounded()))
+        let height = max(1, Int((bounds.height * scale).rounded()))
+        let bytesPerRow = width * 4
+        let colorSpace = CGColorSpaceCreateDeviceRGB()
+
+        func draw(into buf: UnsafeMutableRawBufferPointer, width: Int, rows: Int, bytesPerRow: Int,
+                  offsetY: CGFloat, scale: CGFloat) -> Bool {
+            guard let ctx = CGContext(data: buf.baseAddress,
+                                      width: width,
+                                      height: rows,
+                                      bitsPerComponent: 8,
+                                      bytesPerRow: bytesPerRow,
+                                      space: colorSpace,
+                                      bitmapInfo: CGImageAlphaInfo.premultipliedLast.rawValue) else { return false }
+            ctx.setFillColor(CGColor(red: 1, green: 1, blue: 1, alpha: 1))
+            ctx.fill(CGRect(x: 0, y: 0, width: width, height: rows))
+            ctx.translateBy(x: 0, y: -offsetY)
+            ctx.scaleBy(x: scale, y: scale)
+            page.draw(with: .mediaBox, to: ctx)
+            return true
+        }
+
+        // Probe: the whole page at no more than ~2 MP.
+        let probeScale = min(scale, scale * CGFloat((2_000_000 / Double(width * height)).squareRoot()))
+        let probeWidth = max(1, Int((bounds.width * probeScale).rounded()))
+        let probeHeight = max(1, Int((bounds.height * probeScale).rounded()))
+        var probePixels = [UInt8](repeating: 0, count: probeWidth * 4 * probeHeight)
+        guard probePixels.withUnsafeMutableBytes({ draw(into: $0, width: probeWidth, rows: probeHeight,
+                                                        bytesPerRow: probeWidth * 4, offsetY: 0, scale: probeScale) }) else { return nil }
+        let probe = RasterImage(width: probeWidth, height: probeHeight, bytesPerRow: probeWidth * 4, pixels: probePixels)
+        if detectBlank, BlankPageDetector.isBlank(probe) {
+            return EncodedPage(pageIndex: pageIndex, mimeType: "", fileExtension: "", data: Data(), isBlank: true)
+        }
+        let gray: Bool
+        switch PNGColorReduction.analyze(probe, region: PixelRegion(x: 0, y: 0, width: probeWidth, height: probeHeight)) {
+        case .bilevel, .gray: gray = PNGColorReduction.isEnabled
+        case .palette(let colors): gray = PNGColorReduction.isEnabled && colors.allSatisfy { $0 == ($0 & 0xFF) &* 0x01_0101 }
+        default: gray = false
+        }
+
+        guard let enc = PNGStreamEncoder(width: width, height: height, colorType: gray ? .gray : .rgb) else { return nil }
+        let bandRows = max(1, min(height, bandBufferBytes / bytesPerRow))
+        var band = [UInt8](repeating: 0, count: bytesPerRow * bandRows)
+        var row = [UInt8](repeating: 0, count: enc.rowBytes)
+
+        var top = 0
+        while top < height {
+            let rows = min(bandRows, height - top)
+            // CG's origin is bottom-left: image rows [top, top + rows) are device y [height - top - rows, height - top).
+            let ok = band.withUnsafeMutableBytes {
+                draw(into: $0, width: width, rows: rows, bytesPerRow: bytesPerRow,
+                     offsetY: CGFloat(height - top - rows), scale: scale)
+            }
+            guard ok else { return nil }
+
+            band.withUnsafeBufferPointer { px in
+                for y in 0..<rows {
+                    let src = px.baseAddress! + y * bytesPerRow
+                    row.withUnsafeMutableBufferPointer { dst in
+                        if gray {
+                            for x in 0..<width {
+                                let p = src + x * 4
+                                // Rec. 601 luma, 8-bit fixed point.
+                                dst[x] = UInt8((77 * Int(p[0]) + 150 * Int(p[1]) + 29 * Int(p[2])) >> 8)
+                            }
+                        } else {
+                            for x in 0..<width {
+                                dst[x * 3] = src[x * 4]
+                                dst[x * 3 + 1] = src[x * 4 + 1]
+                                dst[x * 3 + 2] = src[x * 4 + 2]
+                            }
+                        }
+                    }
+                    enc.append(row: row)
+                }
+            }
+            top += rows
+        }
+
+        guard let data = enc.finish() else { return nil }
+        return EncodedPage(pageIndex: pageIndex, mimeType: "image/png", fileExtension: "png", data: data,
+                           pixelWidth: width, format: "png/\(gray ? "gray8" : "rgb8") (banded \(bandRows) rows)")
+    }
+
+    /// Wraps a raster in a CGImage (the pixels are copied once into the provider). `opaque` ignores the
+    /// alpha byte, which is always 255 for rendered pages.
+    static func cgImage(_ raster: RasterImage, opaque: Bool = false) -> CGImage? {
+        guard let provider = CGDataProvider(data: Data(raster.pixels) as CFData) else { return nil }
+        let alpha: CGImageAlphaInfo = opaque ? .noneSkipLast : .premultipliedLast
+        return CGImage(width: raster.width,
+                       height: raster.height,
+                       bitsPerComponent: 8,
+                       bitsPerPixel: 32,
+                       bytesPerRow: raster.bytesPerRow,
+                       space: CGColorSpaceCreateDeviceRGB(),
+                       bitmapInfo: CGBitmapInfo(rawValue: alpha.rawValue),
+                       provider: provider,
+                       decode: nil,
+                       shouldInterpolate: false,
+                       intent: .defaultIntent)
+    }
+
+    /// Encodes a rendered page as JPEG when PageFormatClassifier finds it photographic, PNG otherwise.
+    /// `format` of the result says which, and why.
+    static func encodePage(pageIndex: Int, raster: RasterImage, region: PixelRegion?, imageCoverage: Double) -> EncodedPage? {
+        guard PageFormatClassifier.isEnabled else {
+            return encodePNG(pageIndex: pageIndex, raster: raster, region: region)
+        }
+        let r = region ?? PixelRegion(x: 0, y: 0, width: raster.width, height: raster.height)
+        let analysis = PNGColorReduction.analyze(raster, region: r)
+        let decision = PageFormatClassifier.classify(raster, region: r, format: analysis, imageCoverage: imageCoverage)
+        if decision.photographic {
+            let quality = PageFormatClassifier.jpegQuality
+            if let jpeg = encodeJPEG(raster, region: r, quality: quality) {
+                return EncodedPage(pageIndex: pageIndex, mimeType: "image/jpeg", fileExtension: "jpg", data: jpeg,
+                                   pixelWidth: r.width,
+                                   format: "jpeg/q\(Int((quality * 100).rounded())) (photo: \(decision.summary))")
+            }
+        }
+        let usedFormat: PNGColorReduction.Format? = PNGColorReduction.isEnabled ? analysis : .rgb
+        guard let png = PNGColorReduction.encode(raster, region: r, format: usedFormat) else { return nil }
+        return EncodedPage(pageIndex: pageIndex, mimeType: "image/png", fileExtension: "png", data: png.data,
+                           pixelWidth: r.width, format: "png/\(png.format)")
+    }
+
+    /// JPEG of the region through ImageIO.
+    static func encodeJPEG(_ raster: RasterImage, region r: PixelRegion, quality: Double) -> Data? {
+        guard let full = cgImage(raster, opaque: true),
+              let image = full.cropping(to: CGRect(x: r.x, y: r.y, width: r.width, height: r.height)) else { return nil }
+        let out = NSMutableData()
+        guard let dest = CGImageDestinationCreateWithData(out, UTType.jpeg.identifier as CFString, 1, nil) else { return nil }
+        let props: [CFString: Any] = [kCGImageDestinationLossyCompressionQuality: quality]
+        CGImageDestinationAddImage(dest, image, props as CFDictionary)
+        guard CGImageDestinationFinalize(dest) else { return nil }
+        return out as Data
+    }
+
+    /// PNG straight from the raster (PNGStreamEncoder); pages are opaque, so alpha is dropped, and the color
+    /// type is reduced to the smallest faithful one (PNGColorReduction) unless that is turned off.
+    /// `region` crops the raster (e.g. white margins, see RasterCrop) without copying it.
+    static func encodePNG(pageIndex: Int, raster: RasterImage, region: PixelRegion? = nil) -> EncodedPage? {
+        let encoded: (data: Data, format: String)?
+        if PNGColorReduction.isEnabled {
+            encoded = PNGColorReduction.encode(raster, region: region)
+        } else {
+            encoded = PNGStreamEncoder.encodeOpaqueRGB(raster, region: region).map { ($0, "rgb8") }
+        }
+        guard let encoded else { return nil }
+        return EncodedPage(pageIndex: pageIndex, mimeType: "image/png", fileExtension: "png", data: encoded.data,
+                           pixelWidth: region?.width ?? raster.width, format: "png/\(encoded.format)")
+    }
+}
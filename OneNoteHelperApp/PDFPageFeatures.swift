@@ -0,0 +1,536 @@
+import Foundation
+import CoreGraphics
+
+/// Cheap per-page features gathered by walking the page content stream with `CGPDFScanner`.
+/// Nothing is rendered or decoded here; we only look at operators and dictionary entries.
+struct PDFPageFeatures {
+    let pageIndex: Int
+    let mediaBox: CGRect
+
+    /// Number of text-showing operators (Tj, TJ, ', ").
+    var textRunCount: Int = 0
+    /// Same, excluding invisible text (render mode 3/7, e.g. OCR layers).
+    var visibleTextRunCount: Int = 0
+    /// Number of path painting operators (S, f, B, ...) and shadings.
+    var pathOpCount: Int = 0
+    /// Number of image XObjects / inline images drawn on the page.
+    var imageCount: Int = 0
+    /// Fraction of the MediaBox covered by images (0...1, overlaps are not subtracted).
+    var imageCoverage: Double = 0
+    /// Sum of the encoded image stream lengths (bytes).
+    var imageBytes: Int = 0
+
+    /// Fonts declared in the page resources, and how many of them map back to Unicode.
+    var fontCount: Int = 0
+    var fontsWithUnicode: Int = 0
+
+    /// Size of the page content stream(s) in bytes.
+    var contentBytes: Int = 0
+    /// Number of entries in /Annots (PDFKit draws annotation appearances too).
+    var annotationCount: Int = 0
+
+    /// Smallest visible text size on the page, in default user space units (points), after the text
+    /// matrix and CTM are applied. nil when the page shows no visible text.
+    var minFontSize: Double?
+    /// Union of painted paths and placed images in default user space (stroked paths padded for line width,
+    /// joins and caps; clipping ignored); .null when nothing but text is painted. Text extents are not tracked here.
+    var graphicsBounds: CGRect = .null
+    /// A shading (`sh`) paints the whole clip region, which isn't tracked: graphicsBounds can't be trusted.
+    var hasUnboundedPaint: Bool = false
+    /// Text is shown in a Type3 font, whose glyphs are arbitrary drawings that can extend past the text layout.
+    var usesType3Font: Bool = false
+    /// Highest native resolution (pixels per inch as placed) among images covering at least 10% of the page.
+    var maxImageDPI: Double = 0
+    /// Part of the page wasn't scanned: a content stream failed to parse, or a form XObject couldn't be followed
+    /// (no /Resources, nested too deep). The counts and bounds above are then lower bounds only.
+    var scanIncomplete: Bool = false
+
+    /// The scan found nothing that would paint: no visible text, paths, images or annotations. Only a hint
+    /// (see BlankPageDetector): the page may still paint through what the scan doesn't model.
+    var paintsNothing: Bool {
+        !scanIncomplete && visibleTextRunCount == 0 && pathOpCount == 0 && imageCount == 0 && annotationCount == 0
+    }
+
+    var megapixels: Double {
+        Double(mediaBox.width * mediaBox.height) / 1_000_000
+    }
+
+    /// Share of fonts whose text we expect PDFKit to extract correctly.
+    var textFidelity: Double {
+        if textRunCount == 0 { return 0 }
+        if fontCount == 0 { return 1 }
+        return Double(fontsWithUnicode) / Double(fontCount)
+    }
+}
+
+enum PDFPageFeatureExtractor {
+    static func extract(fileURL: URL, maxPages: Int) -> [PDFPageFeatures] {
+        guard let doc = CGPDFDocument(fileURL as CFURL) else { return [] }
+        return extract(document: doc, maxPages: maxPages)
+    }
+
+    static func extract(document doc: CGPDFDocument, maxPages: Int) -> [PDFPageFeatures] {
+        let pageCount = min(doc.numberOfPages, maxPages)
+        if pageCount <= 0 { return [] }
+
+        var out: [PDFPageFeatures] = []
+        out.reserveCapacity(pageCount)
+        for p in 1...pageCount {
+            guard let page = doc.page(at: p) else { continue }
+            out.append(extract(page: page, pageIndex: p - 1))
+        }
+        return out
+    }
+
+    static func extract(page: CGPDFPage, pageIndex: Int) -> PDFPageFeatures {
+        scan(page: page, pageIndex: pageIndex).features
+    }
+
+    /// An image XObject drawn on the page, with its placement in default user space.
+    /// The stream is owned by the document and only valid while it is alive.
+    struct PlacedImage {
+        let stream: CGPDFStreamRef
+        let rect: CGRect
+        let transform: CGAffineTransform
+    }
+
+    /// Same as `extract(page:pageIndex:)`, but also returns the image XObjects with their placement.
+    static func scan(page: CGPDFPage, pageIndex: Int) -> (features: PDFPageFeatures, images: [PlacedImage]) {
+        var features = PDFPageFeatures(pageIndex: pageIndex, mediaBox: page.getBoxRect(.mediaBox))
+
+        if let pageDict = page.dictionary {
+            features.contentBytes = contentStreamLength(pageDict)
+            var annots: CGPDFArrayRef?
+            if CGPDFDictionaryGetArray(pageDict, "Annots", &annots), let annots {
+                features.annotationCount = CGPDFArrayGetCount(annots)
+            }
+            if let resources = dictionary(pageDict, "Resources") {
+                inspectFonts(resources, into: &features)
+            }
+        }
+
+        let state = ScanState(features: features)
+        guard let table = makeOperatorTable() else {
+            features.scanIncomplete = true
+            return (features, [])
+        }
+        defer { CGPDFOperatorTableRelease(table) }
+        state.table = table
+
+        let cs = CGPDFContentStreamCreateWithPage(page)
+        defer { CGPDFContentStreamRelease(cs) }
+        let info = Unmanaged.passUnretained(state).toOpaque()
+        let scanner = CGPDFScannerCreate(cs, table, info)
+        if !CGPDFScannerScan(scanner) {
+            state.features.scanIncomplete = true
+        }
+        CGPDFScannerRelease(scanner)
+
+        state.features.imageCoverage = min(1, state.features.imageCoverage)
+        return (state.features, state.placedImages)
+    }
+
+    // MARK: - Scanner plumbing
+
+    /// The parts of the text state that affect the rendered size of glyphs.
+    fileprivate struct TextState {
+        var fontSize: CGFloat = 0
+        /// Tr 3 (and 7) paints nothing: OCR layers on scanned pages.
+        var renderMode: Int = 0
+    }
+
+    /// The parts of the graphics state that affect how far a stroke reaches past its path.
+    fileprivate struct StrokeState {
+        var lineWidth: CGFloat = 1
+        var miterLimit: CGFloat = 10
+        /// 0 = miter joins, which can reach `miterLimit` half-widths out.
+        var lineJoin: Int = 0
+
+        /// Distance from the path to the outside of the stroke, in default user space.
+        func reach(ctm: CGAffineTransform) -> CGFloat {
+            let scale = max(hypot(ctm.a, ctm.b), hypot(ctm.c, ctm.d))
+            // Width 0 is the thinnest line the device can draw; cover it with a point.
+            let halfWidth = max(lineWidth * scale, 1) / 2
+            // Square caps reach sqrt(2) half-widths out at a corner.
+            return halfWidth * (lineJoin == 0 ? max(miterLimit, 1.5) : 1.5)
+        }
+    }
+
+    fileprivate final class ScanState {
+        var features: PDFPageFeatures
+        var ctm: CGAffineTransform = .identity
+        var ctmStack: [CGAffineTransform] = []
+        var text = TextState()
+        var textStack: [TextState] = []
+        var stroke = StrokeState()
+        var strokeStack: [StrokeState] = []
+        var textMatrix: CGAffineTransform = .identity
+        /// Bounds of the path under construction (m/l/c/v/y/re), in default user space.
+        var pathBounds: CGRect = .null
+        var formDepth = 0
+        var table: CGPDFOperatorTableRef?
+        var placedImages: [PlacedImage] = []
+
+        init(features: PDFPageFeatures) {
+            self.features = features
+        }
+
+        /// Records an image painted through the unit square of the current CTM.
+        func recordImage(bytes: Int, pixelSize: CGSize? = nil) {
+            features.imageCount += 1
+            features.imageBytes += bytes
+            let box = features.mediaBox
+            let area = box.width * box.height
+            guard area > 0 else { return }
+            let placed = CGRect(x: 0, y: 0, width: 1, height: 1).applying(ctm).intersection(box)
+            guard !placed.isNull else { return }
+            features.graphicsBounds = features.graphicsBounds.union(placed)
+            let coverage = Double(placed.width * placed.height / area)
+            features.imageCoverage += coverage
+
+            // Native DPI along each image axis (the unit square's edges after the CTM).
+            if let pixelSize, coverage >= 0.1 {
+                let xLength = hypot(ctm.a, ctm.b)
+                let yLength = hypot(ctm.c, ctm.d)
+                if xLength > 0, yLength > 0 {
+                    let dpi = max(pixelSize.width * 72 / xLength, pixelSize.height * 72 / yLength)
+                    features.maxImageDPI = max(features.maxImageDPI, Double(dpi))
+                }
+            }
+        }
+
+        func addPathPoints(_ points: [CGPoint]) {
+            for p in points {
+                let t = p.applying(ctm)
+                pathBounds = pathBounds.union(CGRect(x: t.x, y: t.y, width: 0, height: 0))
+            }
+        }
+
+        /// Records one text-showing operator at the current font size and matrices.
+        func recordText() {
+            features.textRunCount += 1
+            guard text.renderMode != 3, text.renderMode != 7 else { return }
+            features.visibleTextRunCount += 1
+            guard text.fontSize > 0 else { return }
+            let m = textMatrix.concatenating(ctm)
+            let size = Double(text.fontSize * hypot(m.c, m.d))
+            // Sub-point text is either invisible trickery or unreadable at any scale; don't let it drive resolution.
+            guard size >= 1 else { return }
+            features.minFontSize = min(features.minFontSize ?? size, size)
+        }
+    }
+
+    private static func state(_ info: UnsafeMutableRawPointer?) -> ScanState? {
+        guard let info else { return nil }
+        return Unmanaged<ScanState>.fromOpaque(info).takeUnretainedValue()
+    }
+
+    private static func makeOperatorTable() -> CGPDFOperatorTableRef? {
+        guard let table = CGPDFOperatorTableCreate() else { return nil }
+
+        CGPDFOperatorTableSetCallback(table, "q") { _, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            s.ctmStack.append(s.ctm)
+            s.textStack.append(s.text)
+            s.strokeStack.append(s.stroke)
+        }
+        CGPDFOperatorTableSetCallback(table, "Q") { _, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            if let last = s.ctmStack.popLast() { s.ctm = last }
+            if let last = s.textStack.popLast() { s.text = last }
+            if let last = s.strokeStack.popLast() { s.stroke = last }
+        }
+        CGPDFOperatorTableSetCallback(table, "cm") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info),
+                  let m = PDFPageFeatureExtractor.popMatrix(scanner) else { return }
+            s.ctm = m.concatenating(s.ctm)
+        }
+
+        // Text matrix / text state: only what is needed to know the rendered glyph size.
+        CGPDFOperatorTableSetCallback(table, "BT") { _, info in
+            PDFPageFeatureExtractor.state(info)?.textMatrix = .identity
+        }
+        CGPDFOperatorTableSetCallback(table, "Tm") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info),
+                  let m = PDFPageFeatureExtractor.popMatrix(scanner) else { return }
+            s.textMatrix = m
+        }
+        CGPDFOperatorTableSetCallback(table, "Tf") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var size: CGPDFReal = 0
+            if CGPDFScannerPopNumber(scanner, &size) { s.text.fontSize = abs(size) }
+            var fontName: UnsafePointer<Int8>?
+            if CGPDFScannerPopName(scanner, &fontName), let fontName,
+               let obj = CGPDFContentStreamGetResource(CGPDFScannerGetContentStream(scanner), "Font", fontName) {
+                var font: CGPDFDictionaryRef?
+                var subtype: UnsafePointer<Int8>?
+                if CGPDFObjectGetValue(obj, .dictionary, &font), let font,
+                   CGPDFDictionaryGetName(font, "Subtype", &subtype), let subtype, String(cString: subtype) == "Type3" {
+                    s.features.usesType3Font = true
+                }
+            }
+        }
+        CGPDFOperatorTableSetCallback(table, "Tr") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var mode: CGPDFInteger = 0
+            if CGPDFScannerPopInteger(scanner, &mode) { s.text.renderMode = Int(mode) }
+        }
+
+        let textOps = ["Tj", "TJ", "'", "\""]
+        for op in textOps {
+            CGPDFOperatorTableSetCallback(table, op) { _, info in
+                PDFPageFeatureExtractor.state(info)?.recordText()
+            }
+        }
+
+        // Path construction: only the extent of the points matters (curves stay inside their control points).
+        // Callbacks are C function pointers and can't capture the operand count, hence one loop per arity.
+        for op in ["m", "l"] {
+            CGPDFOperatorTableSetCallback(table, op) { scanner, info in
+                PDFPageFeatureExtractor.addPathOperands(scanner, info, count: 2)
+            }
+        }
+        for op in ["v", "y"] {
+            CGPDFOperatorTableSetCallback(table, op) { scanner, info in
+                PDFPageFeatureExtractor.addPathOperands(scanner, info, count: 4)
+            }
+        }
+        CGPDFOperatorTableSetCallback(table, "c") { scanner, info in
+            PDFPageFeatureExtractor.addPathOperands(scanner, info, count: 6)
+        }
+        CGPDFOperatorTableSetCallback(table, "re") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info),
+                  let v = PDFPageFeatureExtractor.popNumbers(scanner, 4) else { return }
+            // All four corners: under a rotating or skewing CTM two opposite ones don't bound the rectangle.
+            s.addPathPoints([CGPoint(x: v[0], y: v[1]), CGPoint(x: v[0] + v[2], y: v[1]),
+                             CGPoint(x: v[0], y: v[1] + v[3]), CGPoint(x: v[0] + v[2], y: v[1] + v[3])])
+        }
+        CGPDFOperatorTableSetCallback(table, "n") { _, info in
+            PDFPageFeatureExtractor.state(info)?.pathBounds = .null
+        }
+
+        // Line width, miter limit and join, directly or through an ExtGState.
+        CGPDFOperatorTableSetCallback(table, "w") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var v: CGPDFReal = 0
+            if CGPDFScannerPopNumber(scanner, &v) { s.stroke.lineWidth = abs(v) }
+        }
+        CGPDFOperatorTableSetCallback(table, "M") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var v: CGPDFReal = 0
+            if CGPDFScannerPopNumber(scanner, &v) { s.stroke.miterLimit = v }
+        }
+        CGPDFOperatorTableSetCallback(table, "j") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var v: CGPDFInteger = 0
+            if CGPDFScannerPopInteger(scanner, &v) { s.stroke.lineJoin = Int(v) }
+        }
+        CGPDFOperatorTableSetCallback(table, "gs") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var nameRef: UnsafePointer<Int8>?
+            var dict: CGPDFDictionaryRef?
+            guard CGPDFScannerPopName(scanner, &nameRef), let name = nameRef,
+                  let obj = CGPDFContentStreamGetResource(CGPDFScannerGetContentStream(scanner), "ExtGState", name),
+                  CGPDFObjectGetValue(obj, .dictionary, &dict), let gs = dict else { return }
+            var v: CGPDFReal = 0
+            if CGPDFDictionaryGetNumber(gs, "LW", &v) { s.stroke.lineWidth = abs(v) }
+            if CGPDFDictionaryGetNumber(gs, "ML", &v) { s.stroke.miterLimit = v }
+            var join: CGPDFInteger = 0
+            if CGPDFDictionaryGetInteger(gs, "LJ", &join) { s.stroke.lineJoin = Int(join) }
+        }
+
+        for op in ["f", "F", "f*"] {
+            CGPDFOperatorTableSetCallback(table, op) { _, info in
+                guard let s = PDFPageFeatureExtractor.state(info) else { return }
+                s.features.pathOpCount += 1
+                s.features.graphicsBounds = s.features.graphicsBounds.union(s.pathBounds)
+                s.pathBounds = .null
+            }
+        }
+        for op in ["S", "s", "B", "B*", "b", "b*"] {
+            CGPDFOperatorTableSetCallback(table, op) { _, info in
+                guard let s = PDFPageFeatureExtractor.state(info) else { return }
+                s.features.pathOpCount += 1
+                if !s.pathBounds.isNull {
+                    let reach = s.stroke.reach(ctm: s.ctm)
+                    s.features.graphicsBounds = s.features.graphicsBounds.union(s.pathBounds.insetBy(dx: -reach, dy: -reach))
+                }
+                s.pathBounds = .null
+            }
+        }
+        CGPDFOperatorTableSetCallback(table, "sh") { _, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            s.features.pathOpCount += 1
+            s.features.hasUnboundedPaint = true
+        }
+
+        // Inline images (BI ... ID ... EI) are reported through "EI".
+        CGPDFOperatorTableSetCallback(table, "EI") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var stream: CGPDFStreamRef?
+            var bytes = 0
+            var pixelSize: CGSize?
+            if CGPDFScannerPopStream(scanner, &stream), let stream, let dict = CGPDFStreamGetDictionary(stream) {
+                var len: CGPDFInteger = 0
+                if CGPDFDictionaryGetInteger(dict, "Length", &len) { bytes = Int(len) }
+                pixelSize = PDFPageFeatureExtractor.imagePixelSize(dict, abbreviated: true)
+            }
+            s.recordImage(bytes: bytes, pixelSize: pixelSize)
+        }
+
+        CGPDFOperatorTableSetCallback(table, "Do") { scanner, info in
+            guard let s = PDFPageFeatureExtractor.state(info) else { return }
+            var namePtr: UnsafePointer<Int8>?
+            guard CGPDFScannerPopName(scanner, &namePtr), let namePtr else { return }
+            let cs = CGPDFScannerGetContentStream(scanner)
+            // An XObject we can't inspect may still paint.
+            var streamRef: CGPDFStreamRef?
+            var subtypeRef: UnsafePointer<Int8>?
+            guard let obj = CGPDFContentStreamGetResource(cs, "XObject", namePtr),
+                  CGPDFObjectGetValue(obj, .stream, &streamRef), let stream = streamRef,
+                  let dict = CGPDFStreamGetDictionary(stream),
+                  CGPDFDictionaryGetName(dict, "Subtype", &subtypeRef), let subtypeName = subtypeRef else {
+                s.features.scanIncomplete = true
+                return
+            }
+            let subtype = String(cString: subtypeName)
+
+            if subtype == "Image" {
+                var len: CGPDFInteger = 0
+                let bytes = CGPDFDictionaryGetInteger(dict, "Length", &len) ? Int(len) : 0
+                s.recordImage(bytes: bytes, pixelSize: PDFPageFeatureExtractor.imagePixelSize(dict, abbreviated: false))
+                s.placedImages.append(PlacedImage(stream: stream,
+                                                  rect: CGRect(x: 0, y: 0, width: 1, height: 1).applying(s.ctm),
+                                                  transform: s.ctm))
+            } else if subtype == "Form" {
+                // Recurse into the form with its own matrix and resources (bounded depth). A form that can't be
+                // followed is still drawn by the renderer, so the page's features are incomplete.
+                guard s.formDepth < 8, let table = s.table,
+                      let formResources = PDFPageFeatureExtractor.dictionary(dict, "Resources") else {
+                    s.features.scanIncomplete = true
+                    return
+                }
+                s.formDepth += 1
+                s.ctmStack.append(s.ctm)
+                if let matrix = PDFPageFeatureExtractor.matrix(dict, "Matrix") {
+                    s.ctm = matrix.concatenating(s.ctm)
+                }
+                let formCS = CGPDFContentStreamCreateWithStream(stream, formResources, cs)
+                let formScanner = CGPDFScannerCreate(formCS, table, info)
+                if !CGPDFScannerScan(formScanner) {
+                    s.features.scanIncomplete = true
+                }
+                CGPDFScannerRelease(formScanner)
+                CGPDFContentStreamRelease(formCS)
+                if let last = s.ctmStack.popLast() { s.ctm = last }
+                s.formDepth -= 1
+            }
+        }
+
+        return table
+    }
+
+    fileprivate static func popMatrix(_ scanner: CGPDFScannerRef) -> CGAffineTransform? {
+        guard let v = popNumbers(scanner, 6) else { return nil }
+        return CGAffineTransform(a: v[0], b: v[1], c: v[2], d: v[3], tx: v[4], ty: v[5])
+    }
+
+    /// Pops `count` coordinates (x y pairs) and adds them to the current path.
+    fileprivate static func addPathOperands(_ scanner: CGPDFScannerRef, _ info: UnsafeMutableRawPointer?, count: Int) {
+        guard let s = state(info), let v = popNumbers(scanner, count) else { return }
+        s.addPathPoints(stride(from: 0, to: count, by: 2).map { CGPoint(x: v[$0], y: v[$0 + 1]) })
+    }
+
+    /// Pops `count` numeric operands, returned in source order (they come off the stack last first).
+    fileprivate static func popNumbers(_ scanner: CGPDFScannerRef, _ count: Int) -> [CGFloat]? {
+        var v = [CGPDFReal](repeating: 0, count: count)
+        for i in stride(from: count - 1, through: 0, by: -1) {
+            guard CGPDFScannerPopNumber(scanner, &v[i]) else { return nil }
+        }
+        return v
+    }
+
+    // MARK: - Dictionary helpers
+
+    fileprivate static func dictionary(_ dict: CGPDFDictionaryRef, _ key: String) -> CGPDFDictionaryRef? {
+        var out: CGPDFDictionaryRef?
+        if CGPDFDictionaryGetDictionary(dict, key, &out) { return out }
+        return nil
+    }
+
+    fileprivate static func matrix(_ dict: CGPDFDictionaryRef, _ key: String) -> CGAffineTransform? {
+        var arr: CGPDFArrayRef?
+        guard CGPDFDictionaryGetArray(dict, key, &arr), let arr, CGPDFArrayGetCount(arr) == 6 else { return nil }
+        var v = [CGPDFReal](repeating: 0, count: 6)
+        for i in 0..<6 {
+            guard CGPDFArrayGetNumber(arr, i, &v[i]) else { return nil }
+        }
+        return CGAffineTransform(a: v[0], b: v[1], c: v[2], d: v[3], tx: v[4], ty: v[5])
+    }
+
+    /// Width/Height of an image dictionary (inline images may use the abbreviated W/H keys).
+    fileprivate static func imagePixelSize(_ dict: CGPDFDictionaryRef, abbreviated: Bool) -> CGSize? {
+        var w: CGPDFInteger = 0
+        var h: CGPDFInteger = 0
+        let hasW = CGPDFDictionaryGetInteger(dict, "Width", &w) || (abbreviated && CGPDFDictionaryGetInteger(dict, "W", &w))
+        let hasH = CGPDFDictionaryGetInteger(dict, "Height", &h) || (abbreviated && CGPDFDictionaryGetInteger(dict, "H", &h))
+        guard hasW, hasH, w > 0, h > 0 else { return nil }
+        return CGSize(width: Int(w), height: Int(h))
+    }
+
+    private static func contentStreamLength(_ pageDict: CGPDFDictionaryRef) -> Int {
+        func length(_ stream: CGPDFStreamRef) -> Int {
+            guard let d = CGPDFStreamGetDictionary(stream) else { return 0 }
+            var len: CGPDFInteger = 0
+            return CGPDFDictionaryGetInteger(d, "Length", &len) ? Int(len) : 0
+        }
+
+        var stream: CGPDFStreamRef?
+        if CGPDFDictionaryGetStream(pageDict, "Contents", &stream), let stream {
+            return length(stream)
+        }
+        var arr: CGPDFArrayRef?
+        if CGPDFDictionaryGetArray(pageDict, "Contents", &arr), let arr {
+            var total = 0
+            for i in 0..<CGPDFArrayGetCount(arr) {
+                var s: CGPDFStreamRef?
+                if CGPDFArrayGetStream(arr, i, &s), let s { total += length(s) }
+            }
+            return total
+        }
+        return 0
+    }
+
+    private static func inspectFonts(_ resources: CGPDFDictionaryRef, into features: inout PDFPageFeatures) {
+        guard let fonts = dictionary(resources, "Font") else { return }
+        var total = 0
+        var unicode = 0
+        CGPDFDictionaryApplyBlock(fonts, { _, obj, _ in
+            var font: CGPDFDictionaryRef?
+            guard CGPDFObjectGetValue(obj, .dictionary, &font), let font else { return true }
+            total += 1
+
+            var toUnicode: CGPDFStreamRef?
+            if CGPDFDictionaryGetStream(font, "ToUnicode", &toUnicode) {
+                unicode += 1
+                return true
+            }
+
+            // Simple fonts with a standard encoding extract fine without ToUnicode.
+            // Composite (Type0) fonts and custom/symbolic encodings usually do not.
+            var subtypeName: UnsafePointer<Int8>?
+            let subtype = CGPDFDictionaryGetName(font, "Subtype", &subtypeName) ? subtypeName.map { String(cString: $0) } : nil
+            var encName: UnsafePointer<Int8>?
+            if subtype != "Type0", subtype != "Type3",
+               CGPDFDictionaryGetName(font, "Encoding", &encName), let encName {
+                let enc = String(cString: encName)
+                if enc == "WinAnsiEncoding" || enc == "MacRomanEncoding" || enc == "StandardEncoding" {
+                    unicode += 1
+                }
+            }
+            return true
+        }, nil)
+        features.fontCount = total
+        features.fontsWithUnicode = unicode
+    }
+}
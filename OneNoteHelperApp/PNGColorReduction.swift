@@ -0,0 +1,232 @@
+import Foundation
+
+/// Picks the smallest PNG color type that reproduces a rendered page exactly (1-bit, 8-bit gray, or a palette
+/// of up to 256 colors), and only falls back to RGB when the page really has more colors. Printed office
+/// pages are mostly black-and-white text, so this is usually a several-fold size and encode-time win.
+///
+/// Pages with more than 256 colors can optionally be dithered to a fixed palette (`PNGPaletteDithering`,
+/// off by default because it is lossy).
+enum PNGColorReduction {
+    static let enabledKey = "PNGColorReduction"
+    static let ditherKey = "PNGPaletteDithering"
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var ditherEnabled: Bool {
+        UserDefaults.standard.bool(forKey: ditherKey)
+    }
+
+    enum Format: Equatable {
+        /// Pure black and white only: 1-bit gray.
+        case bilevel
+        /// r == g == b everywhere: 8-bit gray.
+        case gray
+        /// At most 256 distinct colors (0xBBGGRR, in first-seen order).
+        case palette([UInt32])
+        /// More than 256 colors, dithered to the fixed 6x7x6 palette (lossy, opt-in).
+        case ditheredPalette
+        case rgb
+
+        var name: String {
+            switch self {
+            case .bilevel: return "gray1"
+            case .gray: return "gray8"
+            case .palette(let colors): return "palette\(PNGColorReduction.bitDepth(forColors: colors.count))(\(colors.count))"
+            case .ditheredPalette: return "palette8-dithered"
+            case .rgb: return "rgb8"
+            }
+        }
+    }
+
+    static func bitDepth(forColors count: Int) -> Int {
+        switch count {
+        case ...2: return 1
+        case ...4: return 2
+        case ...16: return 4
+        default: return 8
+        }
+    }
+
+    /// One pass over the region: gray check and distinct color count (stops counting past 256).
+    /// Consecutive identical pixels - most of a page - skip the lookup entirely.
+    static func analyze(_ raster: RasterImage, region r: PixelRegion) -> Format {
+        var gray = true
+        var onlyBlackWhite = true
+        var index: [UInt32: Int] = [:]
+        var colors: [UInt32] = []
+        var overflow = false
+        var last: UInt32 = .max
+
+        raster.pixels.withUnsafeBytes { buf in
+            guard let base = buf.baseAddress else { return }
+            for y in r.y..<(r.y + r.height) {
+                let row = base + y * raster.bytesPerRow + r.x * 4
+                for x in 0..<r.width {
+                    let p = row.loadUnaligned(fromByteOffset: x * 4, as: UInt32.self).littleEndian & 0x00FF_FFFF
+                    if p == last { continue }
+                    last = p
+                    if gray, p != (p & 0xFF) &* 0x01_0101 { gray = false }
+                    if onlyBlackWhite, p != 0, p != 0xFF_FFFF { onlyBlackWhite = false }
+                    if !overflow, index[p] == nil {
+                        if colors.count == 256 {
+                            overflow = true
+                        } else {
+                            index[p] = colors.count
+                            colors.append(p)
+                        }
+                    }
+                    // Nothing left to learn: too many colors and not gray.
+                    if overflow, !gray { return }
+                }
+            }
+        }
+
+        if gray, onlyBlackWhite { return .bilevel }
+        if !overflow, colors.count <= 16 { return .palette(colors) }
+        if gray { return .gray }
+        if !overflow { return .palette(colors) }
+        return ditherEnabled ? .ditheredPalette : .rgb
+    }
+
+    /// Encodes the region in the smallest faithful format. Returns the PNG and the format name (for logs).
+    /// Pass `format` when the region has already been analyzed.
+    static func encode(_ raster: RasterImage, region: PixelRegion? = nil, format known: Format? = nil,
+                       level: PNGStreamEncoder.Level = .configured) -> (data: Data, format: String)? {
+        let r = region ?? PixelRegion(x: 0, y: 0, width: raster.width, height: raster.height)
+        guard r.width > 0, r.height > 0, r.x >= 0, r.y >= 0,
+              r.x + r.width <= raster.width, r.y + r.height <= raster.height else { return nil }
+
+        let format = known ?? analyze(raster, region: r)
+        let data: Data?
+        switch format {
+        case .bilevel:
+            data = encodeIndexed(raster, region: r, colorType: .gray, bitDepth: 1, palette: nil, level: level) { p in
+                p == 0 ? 0 : 1
+            }
+        case .gray:
+            data = encodeIndexed(raster, region: r, colorType: .gray, bitDepth: 8, palette: nil, level: level) { p in
+                UInt8(p & 0xFF)
+            }
+        case .palette(let colors):
+            var index: [UInt32: UInt8] = [:]
+            var plte: [UInt8] = []
+            for (i, c) in colors.enumerated() {
+                index[c] = UInt8(i)
+                plte += [UInt8(c & 0xFF), UInt8((c >> 8) & 0xFF), UInt8((c >> 16) & 0xFF)]
+            }
+            var last: UInt32 = .max
+            var lastIndex: UInt8 = 0
+            data = encodeIndexed(raster, region: r, colorType: .palette, bitDepth: bitDepth(forColors: colors.count),
+                                 palette: plte, level: level) { p in
+                if p != last {
+                    last = p
+                    lastIndex = index[p] ?? 0
+                }
+                return lastIndex
+            }
+        case .ditheredPalette:
+            data = encodeDithered(raster, region: r, level: level)
+        case .rgb:
+            data = PNGStreamEncoder.encodeOpaqueRGB(raster, region: r, level: level)
+        }
+        guard let data else { return nil }
+        return (data, format.name)
+    }
+
+    /// Maps every pixel (0xBBGGRR) to a sample with `sample`, packs rows MSB-first at `bitDepth` and encodes.
+    private static func encodeIndexed(_ raster: RasterImage, region r: PixelRegion,
+                                      colorType: PNGStreamEncoder.ColorType, bitDepth: Int, palette: [UInt8]?,
+                                      level: PNGStreamEncoder.Level, sample: (UInt32) -> UInt8) -> Data? {
+        guard let enc = PNGStreamEncoder(width: r.width, height: r.height, colorType: colorType,
+                                         bitDepth: bitDepth, palette: palette, level: level) else { return nil }
+        var packed = [UInt8](repeating: 0, count: enc.rowBytes)
+        let perByte = 8 / bitDepth
+
+        raster.pixels.withUnsafeBytes { buf in
+            let base = buf.baseAddress!
+            for y in r.y..<(r.y + r.height) {
+                let row = base + y * raster.bytesPerRow + r.x * 4
+                packed.withUnsafeMutableBufferPointer { out in
+                    if bitDepth == 8 {
+                        for x in 0..<r.width {
+                            out[x] = sample(row.loadUnaligned(fromByteOffset: x * 4, as: UInt32.self).littleEndian & 0x00FF_FFFF)
+                        }
+                        return
+                    }
+                    var x = 0
+                    for i in 0..<out.count {
+                        var byte: UInt8 = 0
+                        for _ in 0..<perByte {
+                            byte <<= UInt8(bitDepth)
+                            if x < r.width {
+                                byte |= sample(row.loadUnaligned(fromByteOffset: x * 4, as: UInt32.self).littleEndian & 0x00FF_FFFF)
+                                x += 1
+                            }
+                        }
+                        out[i] = byte
+                    }
+                }
+                enc.append(row: packed)
+            }
+        }
+        return enc.finish()
+    }
+
+    // MARK: - Dithering
+
+    private static let levels = (r: 6, g: 7, b: 6)
+
+    /// Floyd-Steinberg to the uniform 6x7x6 (252 color) palette.
+    private static func encodeDithered(_ raster: RasterImage, region r: PixelRegion, level: PNGStreamEncoder.Level) -> Data? {
+        var plte: [UInt8] = []
+        for ri in 0..<levels.r {
+            for gi in 0..<levels.g {
+                for bi in 0..<levels.b {
+                    plte += [quantLevel(ri, levels.r), quantLevel(gi, levels.g), quantLevel(bi, levels.b)]
+                }
+            }
+        }
+        guard let enc = PNGStreamEncoder(width: r.width, height: r.height, colorType: .palette,
+                                         bitDepth: 8, palette: plte, level: level) else { return nil }
+
+        // Error carried to the current and next row, per channel, with one pixel of slack on each side.
+        let stride = (r.width + 2) * 3
+        var errCur = [Int32](repeating: 0, count: stride)
+        var errNext = [Int32](repeating: 0, count: stride)
+        var out = [UInt8](repeating: 0, count: r.width)
+
+        raster.pixels.withUnsafeBufferPointer { px in
+            for y in r.y..<(r.y + r.height) {
+                let row = px.baseAddress! + y * raster.bytesPerRow + r.x * 4
+                for i in errNext.indices { errNext[i] = 0 }
+                /// Quantizes one channel and spreads its error (7/16 right, 3/16, 5/16, 1/16 below).
+                func quantize(_ x: Int, _ c: Int, _ n: Int) -> Int {
+                    let e = (x + 1) * 3 + c
+                    let v = min(255, max(0, Int32(row[x * 4 + c]) + errCur[e] / 16))
+                    let qi = Int((v * Int32(n - 1) + 127) / 255)
+                    let err = v - Int32(quantLevel(qi, n))
+                    errCur[e + 3] += err * 7
+                    errNext[e - 3] += err * 3
+                    errNext[e] += err * 5
+                    errNext[e + 3] += err
+                    return qi
+                }
+                for x in 0..<r.width {
+                    let qr = quantize(x, 0, levels.r)
+                    let qg = quantize(x, 1, levels.g)
+                    let qb = quantize(x, 2, levels.b)
+                    out[x] = UInt8((qr * levels.g + qg) * levels.b + qb)
+                }
+                enc.append(row: out)
+                swap(&errCur, &errNext)
+            }
+        }
+        return enc.finish()
+    }
+
+    private static func quantLevel(_ i: Int, _ n: Int) -> UInt8 {
+        UInt8(i * 255 / (n - 1))
+    }
+}
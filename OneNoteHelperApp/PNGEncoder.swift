@@ -0,0 +1,371 @@
+import Foundation
+import Compression
+
+/// Streaming PNG writer: rows go in already packed for the target color type, PNG bytes come out.
+///
+/// Filtering is done here with SIMD (per-row adaptive filter selection, see `Level`); deflate is the
+/// Compression framework's zlib encoder, which is considerably faster than ImageIO's PNG path and never
+/// needs the whole image in memory.
+final class PNGStreamEncoder {
+    enum ColorType: UInt8 {
+        case gray = 0
+        case rgb = 2
+        case palette = 3
+        case rgba = 6
+    }
+
+    /// Speed/size trade-off, configurable with the `PNGEncodeLevel` default.
+    enum Level: String {
+        /// "Up" filter on every row: cheapest, and good on rendered documents.
+        case fastest
+        /// Per-row choice between None/Sub/Up/Paeth (minimum sum of absolute differences).
+        case balanced
+        /// Per-row choice between all five filters.
+        case smallest
+
+        static let defaultsKey = "PNGEncodeLevel"
+
+        static var configured: Level {
+            Level(rawValue: UserDefaults.standard.string(forKey: defaultsKey) ?? "") ?? .balanced
+        }
+    }
+
+    let width: Int
+    let height: Int
+    let colorType: ColorType
+    let bitDepth: Int
+    let level: Level
+
+    /// Bytes per packed row (without the filter byte).
+    let rowBytes: Int
+    /// Bytes per complete pixel, at least 1 (filter "bpp").
+    private let bpp: Int
+
+    private var out = Data()
+    private var filter: OutputFilter?
+    private var adler = Adler32()
+    private var rowsWritten = 0
+    private var prevRow: [UInt8]
+    private var scratch: [[UInt8]]
+    private var pending = Data()
+    private var failed = false
+
+    private static let idatChunkSize = 1 << 16
+
+    init?(width: Int, height: Int, colorType: ColorType, bitDepth: Int = 8, palette: [UInt8]? = nil, level: Level = .configured) {
+        guard width > 0, height > 0, [1, 2, 4, 8].contains(bitDepth) else { return nil }
+        self.width = width
+        self.height = height
+        self.colorType = colorType
+        self.bitDepth = bitDepth
+        self.level = level
+
+        let channels: Int
+        switch colorType {
+        case .gray, .palette: channels = 1
+        case .rgb: channels = 3
+        case .rgba: channels = 4
+        }
+        rowBytes = (width * channels * bitDepth + 7) / 8
+        bpp = max(1, channels * bitDepth / 8)
+        prevRow = [UInt8](repeating: 0, count: rowBytes)
+        scratch = Array(repeating: [UInt8](repeating: 0, count: rowBytes + 1), count: 5)
+
+        out.append(contentsOf: [0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A])
+        var ihdr = Data()
+        ihdr.appendBE32(UInt32(width))
+        ihdr.appendBE32(UInt32(height))
+        ihdr.append(contentsOf: [UInt8(bitDepth), colorType.rawValue, 0, 0, 0])
+        writeChunk("IHDR", ihdr)
+
+        if colorType == .palette {
+            guard let palette, palette.count % 3 == 0, (3...768).contains(palette.count) else { return nil }
+            writeChunk("PLTE", Data(palette))
+        }
+
+        // zlib header (deflate, 32K window, default compression) - the Compression framework emits raw deflate.
+        pending.append(contentsOf: [0x78, 0x9C])
+        filter = try? OutputFilter(.compress, using: .zlib, bufferCapacity: Self.idatChunkSize) { [weak self] data in
+            guard let self, let data else { return }
+            self.pending.append(data)
+            self.flushIDAT(final: false)
+        }
+        if filter == nil { return nil }
+    }
+
+    /// Appends one packed row (`rowBytes` bytes).
+    func append(row: UnsafeBufferPointer<UInt8>) {
+        guard !failed, rowsWritten < height, row.count >= rowBytes, let base = row.baseAddress else { return }
+
+        let chosen = chooseFilter(base)
+        let filtered = scratch[chosen]
+        adler.update(filtered)
+        do {
+            try filter?.write(filtered)
+        } catch {
+            failed = true
+        }
+        prevRow.withUnsafeMutableBufferPointer { dst in
+            dst.baseAddress!.update(from: base, count: rowBytes)
+        }
+        rowsWritten += 1
+    }
+
+    func append(row: [UInt8]) {
+        row.withUnsafeBufferPointer { append(row: $0) }
+    }
+
+    /// Finishes the stream. Returns nil if fewer than `height` rows were appended or deflate failed.
+    func finish() -> Data? {
+        guard !failed, rowsWritten == height, let filter else { return nil }
+        do {
+            try filter.finalize()
+        } catch {
+            return nil
+        }
+        self.filter = nil
+        pending.appendBE32(adler.value)
+        flushIDAT(final: true)
+        writeChunk("IEND", Data())
+        return out
+    }
+
+    // MARK: - Filtering
+
+    /// Filters the row with the candidate filters of the current level into `scratch[type]`
+    /// (filter byte first) and returns the chosen filter type.
+    private func chooseFilter(_ cur: UnsafePointer<UInt8>) -> Int {
+        let candidates: [Int]
+        switch level {
+        case .fastest: candidates = [2]
+        case .balanced: candidates = [0, 1, 2, 4]
+        case .smallest: candidates = [0, 1, 2, 3, 4]
+        }
+
+        var best = candidates[0]
+        var bestScore = UInt64.max
+        prevRow.withUnsafeBufferPointer { prev in
+            for type in candidates {
+                let score = scratch[type].withUnsafeMutableBufferPointer { dst -> UInt64 in
+                    dst[0] = UInt8(type)
+                    return PNGFilters.apply(type: type, cur: cur, prev: prev.baseAddress!, bpp: bpp,
+                                            count: rowBytes, out: dst.baseAddress! + 1,
+                                            score: candidates.count > 1)
+                }
+                if score < bestScore {
+                    bestScore = score
+                    best = type
+                }
+            }
+        }
+        return best
+    }
+
+    // MARK: - Chunks
+
+    private func flushIDAT(final: Bool) {
+        while pending.count >= Self.idatChunkSize || (final && !pending.isEmpty) {
+            let n = min(Self.idatChunkSize, pending.count)
+            writeChunk("IDAT", pending.prefix(n))
+            pending.removeFirst(n)
+        }
+    }
+
+    private func writeChunk(_ type: String, _ data: Data) {
+        let typeBytes = Data(type.utf8)
+        out.appendBE32(UInt32(data.count))
+        out.append(typeBytes)
+        out.append(data)
+        var crc = CRC32()
+        crc.update(typeBytes)
+        crc.update(data)
+        out.appendBE32(crc.value)
+    }
+
+    // MARK: - Convenience
+
+    /// Encodes an opaque RGBA raster (or the `region` of it) as RGB; the renderer composites onto white,
+    /// so alpha is always 255.
+    static func encodeOpaqueRGB(_ raster: RasterImage, region: PixelRegion? = nil, level: Level = .configured) -> Data? {
+        let r = region ?? PixelRegion(x: 0, y: 0, width: raster.width, height: raster.height)
+        guard r.x >= 0, r.y >= 0, r.x + r.width <= raster.width, r.y + r.height <= raster.height,
+              let enc = PNGStreamEncoder(width: r.width, height: r.height, colorType: .rgb, level: level) else { return nil }
+        var row = [UInt8](repeating: 0, count: r.width * 3)
+        raster.pixels.withUnsafeBufferPointer { px in
+            for y in r.y..<(r.y + r.height) {
+                let src = px.baseAddress! + y * raster.bytesPerRow + r.x * 4
+                row.withUnsafeMutableBufferPointer { dst in
+                    var s = 0
+                    var d = 0
+                    for _ in 0..<r.width {
+                        dst[d] = src[s]
+                        dst[d + 1] = src[s + 1]
+                        dst[d + 2] = src[s + 2]
+                        s += 4
+                        d += 3
+                    }
+                }
+                enc.append(row: row)
+            }
+        }
+        return enc.finish()
+    }
+}
+
+/// PNG filter kernels (RFC 2083 §6). 16 bytes at a time with SIMD, scalar head (first `bpp` bytes,
+/// where the left neighbour is 0) and tail.
+enum PNGFilters {
+    typealias V = SIMD16<UInt8>
+    typealias W = SIMD16<Int16>
+
+    /// Writes the filtered row to `out` and, when `score` is set, returns the sum of absolute values of the
+    /// filtered bytes taken as signed (the usual filter selection heuristic).
+    @inline(__always)
+    static func apply(type: Int, cur: UnsafePointer<UInt8>, prev: UnsafePointer<UInt8>, bpp: Int,
+                      count: Int, out: UnsafeMutablePointer<UInt8>, score: Bool) -> UInt64 {
+        // Head: a = c = 0.
+        let head = min(bpp, count)
+        for i in 0..<head {
+            out[i] = scalar(type, x: cur[i], a: 0, b: prev[i], c: 0)
+        }
+
+        var i = head
+        let raw = UnsafeRawPointer(cur)
+        let rawPrev = UnsafeRawPointer(prev)
+        while i + 16 <= count {
+            let x = raw.loadUnaligned(fromByteOffset: i, as: V.self)
+            let b = rawPrev.loadUnaligned(fromByteOffset: i, as: V.self)
+            let r: V
+            switch type {
+            case 0:
+                r = x
+            case 1:
+                r = x &- raw.loadUnaligned(fromByteOffset: i - bpp, as: V.self)
+            case 2:
+                r = x &- b
+            case 3:
+                let a = raw.loadUnaligned(fromByteOffset: i - bpp, as: V.self)
+                r = x &- ((a &>> 1) &+ (b &>> 1) &+ (a & b & 1))
+            default:
+                let a = raw.loadUnaligned(fromByteOffset: i - bpp, as: V.self)
+                let c = rawPrev.loadUnaligned(fromByteOffset: i - bpp, as: V.self)
+                r = x &- paeth(a, b, c)
+            }
+            UnsafeMutableRawPointer(out).storeBytes(of: r, toByteOffset: i, as: V.self)
+            i += 16
+        }
+        while i < count {
+            out[i] = scalar(type, x: cur[i], a: cur[i - bpp], b: prev[i], c: prev[i - bpp])
+            i += 1
+        }
+
+        guard score else { return 0 }
+        var sum: UInt64 = 0
+        var j = 0
+        let rawOut = UnsafeRawPointer(out)
+        while j + 16 <= count {
+            let v = rawOut.loadUnaligned(fromByteOffset: j, as: V.self)
+            let m = pointwiseMin(v, 0 &- v)
+            sum += UInt64(SIMD16<UInt16>(truncatingIfNeeded: m).wrappedSum())
+            j += 16
+        }
+        while j < count {
+            let v = out[j]
+            sum += UInt64(min(v, 0 &- v))
+            j += 1
+        }
+        return sum
+    }
+
+    @inline(__always)
+    static func paeth(_ a: V, _ b: V, _ c: V) -> V {
+        let a16 = W(truncatingIfNeeded: a)
+        let b16 = W(truncatingIfNeeded: b)
+        let c16 = W(truncatingIfNeeded: c)
+        let pa = abs(b16 &- c16)
+        let pb = abs(a16 &- c16)
+        let pc = abs(a16 &+ b16 &- c16 &- c16)
+        let useA = (pa .<= pb) .& (pa .<= pc)
+        let useB = .!useA .& (pb .<= pc)
+        var pred = c16
+        pred.replace(with: b16, where: useB)
+        pred.replace(with: a16, where: useA)
+        return V(truncatingIfNeeded: pred)
+    }
+
+    @inline(__always)
+    private static func abs(_ v: W) -> W {
+        v.replacing(with: 0 &- v, where: v .< 0)
+    }
+
+    @inline(__always)
+    static func scalar(_ type: Int, x: UInt8, a: UInt8, b: UInt8, c: UInt8) -> UInt8 {
+        switch type {
+        case 0: return x
+        case 1: return x &- a
+        case 2: return x &- b
+        case 3: return x &- UInt8((UInt16(a) + UInt16(b)) >> 1)
+        default:
+            let p = Int(a) + Int(b) - Int(c)
+            let pa = Swift.abs(p - Int(a)), pb = Swift.abs(p - Int(b)), pc = Swift.abs(p - Int(c))
+            let pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c)
+            return x &- pred
+        }
+    }
+}
+
+struct CRC32 {
+    private static let table: [UInt32] = (0..<256).map { n -> UInt32 in
+        var c = UInt32(n)
+        for _ in 0..<8 {
+            c = (c & 1) != 0 ? 0xEDB8_8320 ^ (c >> 1) : c >> 1
+        }
+        return c
+    }
+
+    private var crc: UInt32 = 0xFFFF_FFFF
+
+    var value: UInt32 { crc ^ 0xFFFF_FFFF }
+
+    mutating func update<D: DataProtocol>(_ data: D) {
+        var c = crc
+        Self.table.withUnsafeBufferPointer { t in
+            for region in data.regions {
+                for byte in region {
+                    c = t[Int((c ^ UInt32(byte)) & 0xFF)] ^ (c >> 8)
+                }
+            }
+        }
+        crc = c
+    }
+}
+
+struct Adler32 {
+    private var a: UInt32 = 1
+    private var b: UInt32 = 0
+
+    var value: UInt32 { (b << 16) | a }
+
+    mutating func update(_ bytes: [UInt8]) {
+        // 5552 is the largest n for which the sums can't overflow 32 bits before the modulo.
+        var i = 0
+        bytes.withUnsafeBufferPointer { p in
+            while i < p.count {
+                let end = min(p.count, i + 5552)
+                while i < end {
+                    a &+= UInt32(p[i])
+                    b &+= a
+                    i += 1
+                }
+                a %= 65521
+                b %= 65521
+            }
+        }
+    }
+}
+
+extension Data {
+    mutating func appendBE32(_ v: UInt32) {
+        append(contentsOf: [UInt8(v >> 24), UInt8((v >> 16) & 0xFF), UInt8((v >> 8) & 0xFF), UInt8(v & 0xFF)])
+    }
+}
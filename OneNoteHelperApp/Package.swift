@@ -30,6 +30,30 @@ let package = Package(
                 .copy("Resources/ghostscript")
             ]
         ),
+        // Foundation-only parts of the app, built separately so they can be unit-tested (also on Linux).
+        .target(
+            name: "OneNoteHelperCore",
+            path: ".",
+            sources: [
+                "GraphRateController.swift",
+                "GraphTokenCache.swift",
+                "GraphTransport.swift",
+                "JobSplitter.swift",
+                "MultipartBody.swift",
+                "OneNotePatchCommand.swift",
+                "OneNoteRequestBuilder.swift",
+                "PDFImageColorKernels.swift",
+                "ParallelPageRenderer.swift",
+                "UploadOutbox.swift"
+            ],
+            swiftSettings: [.swiftLanguageMode(.v5)]
+        ),
+        .testTarget(
+            name: "OneNoteHelperCoreTests",
+            dependencies: ["OneNoteHelperCore"],
+            path: "Tests/OneNoteHelperCoreTests",
+            swiftSettings: [.swiftLanguageMode(.v5)]
+        ),
         .executableTarget(
             name: "OneNoteCUPSBackend",
             path: "Sources/OneNoteCUPSBackend",
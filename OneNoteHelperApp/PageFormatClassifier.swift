@@ -0,0 +1,89 @@
+import Foundation
+
+/// Decides whether a rendered page is photographic (encode as JPEG) or text/line art (keep lossless PNG).
+///
+/// Signals, cheapest first: the PDF structure (share of the page covered by images), the color count from
+/// PNGColorReduction's analysis pass (a page with 256 colors or fewer is always better as a palette PNG),
+/// and the entropy of horizontal luma gradients on a sample of rows (flat areas and hard edges give low
+/// entropy, photographs high entropy).
+enum PageFormatClassifier {
+    static let enabledKey = "PhotoPagesAsJPEG"
+    static let jpegQualityKey = "PhotoJPEGQuality"
+    static let entropyThresholdKey = "PhotoGradientEntropyThreshold"
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var jpegQuality: Double {
+        let v = UserDefaults.standard.double(forKey: jpegQualityKey)
+        return (v > 0 && v <= 1) ? v : 0.8
+    }
+
+    static var entropyThreshold: Double {
+        let v = UserDefaults.standard.double(forKey: entropyThresholdKey)
+        return v > 0 ? v : 4.0
+    }
+
+    /// Image coverage at which a many-color page counts as photographic regardless of the gradients.
+    static let photoCoverage = 0.5
+
+    struct Decision {
+        let photographic: Bool
+        let entropy: Double
+        let imageCoverage: Double
+
+        var summary: String {
+            "entropy \(String(format: "%.1f", entropy)) bits, images \(Int((imageCoverage * 100).rounded()))%"
+        }
+    }
+
+    /// `format` is PNGColorReduction's analysis of the same region; `imageCoverage` comes from PDFPageFeatures.
+    static func classify(_ raster: RasterImage, region: PixelRegion, format: PNGColorReduction.Format,
+                         imageCoverage: Double) -> Decision {
+        switch format {
+        case .rgb, .ditheredPalette:
+            let entropy = gradientEntropy(raster, region: region)
+            let photographic = imageCoverage >= photoCoverage || entropy >= entropyThreshold
+            return Decision(photographic: photographic, entropy: entropy, imageCoverage: imageCoverage)
+        default:
+            return Decision(photographic: false, entropy: 0, imageCoverage: imageCoverage)
+        }
+    }
+
+    /// Shannon entropy (bits) of |luma(x) - luma(x-1)| over every 4th row.
+    static func gradientEntropy(_ raster: RasterImage, region r: PixelRegion, rowStep: Int = 4) -> Double {
+        guard r.width > 1, r.height > 0 else { return 0 }
+        var histogram = [Int](repeating: 0, count: 256)
+        var samples = 0
+
+        raster.pixels.withUnsafeBufferPointer { px in
+            histogram.withUnsafeMutableBufferPointer { hist in
+                for y in stride(from: r.y, to: r.y + r.height, by: rowStep) {
+                    let row = px.baseAddress! + y * raster.bytesPerRow + r.x * 4
+                    var previous = luma(row)
+                    for x in 1..<r.width {
+                        let l = luma(row + x * 4)
+                        hist[abs(l - previous)] += 1
+                        previous = l
+                    }
+                    samples += r.width - 1
+                }
+            }
+        }
+
+        guard samples > 0 else { return 0 }
+        let n = Double(samples)
+        return histogram.reduce(0.0) { h, count in
+            guard count > 0 else { return h }
+            let p = Double(count) / n
+            return h - p * log2(p)
+        }
+    }
+
+    @inline(__always)
+    private static func luma(_ p: UnsafePointer<UInt8>) -> Int {
+        // Rec. 601 weights in eighths: (2R + 5G + B) / 8.
+        (2 * Int(p[0]) + 5 * Int(p[1]) + Int(p[2])) >> 3
+    }
+}
@@ -0,0 +1,127 @@
+import Foundation
+import Dispatch
+
+// Platform-neutral on purpose (Foundation + Dispatch only): the scheduling logic can be exercised on
+// Linux with a fake backend; the macOS backend lives in PDFKitRasterBackend.swift.
+
+/// A rendered page: 8-bit RGBA, premultiplied alpha last, rows top to bottom.
+struct RasterImage {
+    let width: Int
+    let height: Int
+    let bytesPerRow: Int
+    var pixels: [UInt8]
+}
+
+/// An encoded page ready to be attached (PNG, JPEG, ...).
+struct EncodedPage {
+    let pageIndex: Int
+    let mimeType: String
+    let fileExtension: String
+    let data: Data
+    /// Width in pixels of the encoded image (after any cropping), 0 if unknown.
+    var pixelWidth: Int = 0
+    /// Short description of the encoding for logs, e.g. "png/gray8".
+    var format: String = ""
+    /// Set by encoders that detected a blank page; `data` is empty then.
+    var isBlank: Bool = false
+}
+
+/// Per-worker rasterizer. Never shared between threads: PDF documents/pages are not thread-safe,
+/// so every worker gets its own context (and document instance).
+protocol PageRasterContext: AnyObject {
+    func rasterize(pageIndex: Int) -> RasterImage?
+}
+
+/// Pluggable rendering backend (PDFKit on macOS; anything else that can produce RGBA pages).
+protocol PageRasterBackend {
+    func makeContext() -> PageRasterContext?
+}
+
+/// Rasterizes pages concurrently (one render context per worker), encodes them concurrently, and
+/// delivers the results strictly in the order of `pageIndices`.
+final class ParallelPageRenderer {
+    typealias Encoder = (_ pageIndex: Int, _ raster: RasterImage) -> EncodedPage?
+
+    static let workerCountKey = "RenderWorkerCount"
+
+    static var defaultWorkerCount: Int {
+        let configured = UserDefaults.standard.integer(forKey: workerCountKey)
+        if configured > 0 { return configured }
+        return max(1, min(8, ProcessInfo.processInfo.activeProcessorCount))
+    }
+
+    private let backend: PageRasterBackend
+    private let workerCount: Int
+    private let encode: Encoder
+
+    init(backend: PageRasterBackend, workerCount: Int = ParallelPageRenderer.defaultWorkerCount, encode: @escaping Encoder) {
+        self.backend = backend
+        self.workerCount = max(1, workerCount)
+        self.encode = encode
+    }
+
+    /// Blocks until every page has been delivered. `onPage` is called serially, in page order, with nil
+    /// for pages that failed to render or encode. Returning false from `onPage` stops scheduling new pages.
+    func run(pageIndices: [Int], onPage: @escaping (_ pageIndex: Int, _ page: EncodedPage?) -> Bool) {
+        if pageIndices.isEmpty { return }
+
+        let workers = min(workerCount, pageIndices.count)
+        // Bounds the number of raw bitmaps alive at once (rendered but not yet encoded).
+        let inFlight = DispatchSemaphore(value: workers + 2)
+        let encodeQueue = DispatchQueue(label: "fr.dubertrand.OneNoteHelperApp.encode", attributes: .concurrent)
+        let encodeGroup = DispatchGroup()
+
+        let lock = NSLock()
+        var next = 0
+        var cancelled = false
+        var slots = [EncodedPage??](repeating: nil, count: pageIndices.count)
+        var delivered = 0
+
+        func complete(_ position: Int, _ page: EncodedPage?) {
+            lock.lock()
+            defer { lock.unlock() }
+            slots[position] = .some(page)
+            while delivered < slots.count, let ready = slots[delivered] {
+                slots[delivered] = nil
+                if !cancelled, !onPage(pageIndices[delivered], ready) {
+                    cancelled = true
+                }
+                delivered += 1
+            }
+        }
+
+        func claim() -> Int? {
+            lock.lock()
+            defer { lock.unlock() }
+            guard !cancelled, next < pageIndices.count else { return nil }
+            next += 1
+            return next - 1
+        }
+
+        DispatchQueue.concurrentPerform(iterations: workers) { _ in
+            let context = backend.makeContext()
+            while let position = claim() {
+                inFlight.wait()
+                guard let context, let raster = context.rasterize(pageIndex: pageIndices[position]) else {
+                    inFlight.signal()
+                    complete(position, nil)
+                    continue
+                }
+                encodeQueue.async(group: encodeGroup) {
+                    let encoded = self.encode(pageIndices[position], raster)
+                    inFlight.signal()
+                    complete(position, encoded)
+                }
+            }
+        }
+        encodeGroup.wait()
+
+        // Pages never claimed because of cancellation still need their slot filled.
+        lock.lock()
+        let claimed = next
+        lock.unlock()
+        for position in claimed..<pageIndices.count {
+            complete(position, nil)
+        }
+    }
+}
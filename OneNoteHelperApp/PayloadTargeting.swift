@@ -0,0 +1,191 @@
+import Foundation
+import CoreGraphics
+import ImageIO
+import UniformTypeIdentifiers
+
+/// Preflight of a job's payload against Graph's limits, before anything is sent.
+///
+/// The final size and part count are estimated from the per-page encodings (the same packing JobSplitter
+/// uses). Image parts over `PayloadMaxPartMegabytes` (default 25, Graph's per-image limit) are re-encoded
+/// down the `ladder` (lower JPEG quality, then lower resolution, then grayscale) until they fit; when
+/// `PayloadBudgetMegabytes` is set (default 0: no budget), the largest images are stepped down the same way
+/// until the whole job fits the budget. If the target can't be met even at the last step, the job fails
+/// before uploading, with the reason.
+enum PayloadTargeting {
+    static let maxPartMegabytesKey = "PayloadMaxPartMegabytes"
+    static let budgetMegabytesKey = "PayloadBudgetMegabytes"
+
+    static var maxPartBytes: Int {
+        let v = UserDefaults.standard.double(forKey: maxPartMegabytesKey)
+        return Int((v > 0 ? v : 25) * 1_048_576)
+    }
+
+    /// Upper bound on the whole job's upload, or nil when there is none.
+    static var budgetBytes: Int? {
+        let v = UserDefaults.standard.double(forKey: budgetMegabytesKey)
+        return v > 0 ? Int(v * 1_048_576) : nil
+    }
+
+    /// Largest part that fits both the per-part limit and, on its own, one request.
+    static var partLimit: Int {
+        min(maxPartBytes, JobSplitter.maxRequestBytes - JobSplitter.requestOverheadBytes - JobSplitter.partOverheadBytes)
+    }
+
+    struct Step {
+        let quality: Double
+        let scale: Double
+        let grayscale: Bool
+
+        var summary: String {
+            "jpeg/q\(Int((quality * 100).rounded())) at \(Int((scale * 100).rounded()))%" + (grayscale ? " gray" : "")
+        }
+    }
+
+    /// Tried in order; each step loses more than the one before.
+    static let ladder: [Step] = [
+        Step(quality: 0.8, scale: 1, grayscale: false),
+        Step(quality: 0.6, scale: 1, grayscale: false),
+        Step(quality: 0.6, scale: 0.75, grayscale: false),
+        Step(quality: 0.5, scale: 0.5, grayscale: false),
+        Step(quality: 0.5, scale: 0.5, grayscale: true),
+        Step(quality: 0.4, scale: 0.35, grayscale: true)
+    ]
+
+    struct Part {
+        var mimeType: String
+        var data: Data
+        /// Set once the part was re-encoded: the step used and the width of the original, in pixels.
+        var step: Step?
+        var originalPixelWidth: Int?
+    }
+
+    struct Estimate {
+        let bytes: Int
+        let parts: Int
+        let requests: Int
+
+        var summary: String {
+            "\(String(format: "%.1f", Double(bytes) / 1_048_576)) MB, \(parts) part(s), \(requests) request(s)"
+        }
+    }
+
+    enum Failure: Error, CustomStringConvertible {
+        case partTooLarge(token: String, bytes: Int, limit: Int)
+        case overBudget(bytes: Int, budget: Int)
+        case requestTooLarge(bytes: Int, limit: Int)
+
+        var description: String {
+            func mb(_ b: Int) -> String { String(format: "%.1f MB", Double(b) / 1_048_576) }
+            switch self {
+            case .partTooLarge(let token, let bytes, let limit):
+                return "part \(token) is \(mb(bytes)) and can't be brought under the \(mb(limit)) per-part limit"
+            case .overBudget(let bytes, let budget):
+                return "estimated upload of \(mb(bytes)) can't be brought under the \(mb(budget)) budget (\(budgetMegabytesKey))"
+            case .requestTooLarge(let bytes, let limit):
+                return "request of \(mb(bytes)) is over the \(mb(limit)) per-request limit and can't be split"
+            }
+        }
+    }
+
+    /// Size of the job as it would be uploaded: sections packed into requests, parts counted once per request.
+    static func estimate(htmlBytes: [Int], tokens: [[String]], partBytes: [String: Int]) -> Estimate {
+        let ranges = JobSplitter.partition(htmlBytes: htmlBytes, tokens: tokens, partBytes: partBytes)
+        var bytes = 0
+        var parts = 0
+        for range in ranges {
+            let chunkTokens = Set(range.flatMap { tokens[$0] })
+            bytes += JobSplitter.requestOverheadBytes + range.reduce(0) { $0 + htmlBytes[$1] }
+            bytes += chunkTokens.reduce(0) { $0 + (partBytes[$1] ?? 0) + JobSplitter.partOverheadBytes }
+            // Plus the presentation (or commands) part.
+            parts += chunkTokens.count + 1
+        }
+        return Estimate(bytes: bytes, parts: parts, requests: ranges.count)
+    }
+
+    /// Brings `parts` within the per-part limit and the budget, re-encoding images as needed.
+    static func fit(_ parts: inout [String: Part], htmlBytes: [Int], tokens: [[String]]) -> Result<Estimate, Failure> {
+        let originals = parts
+        let limit = partLimit
+
+        for (token, part) in originals where part.data.count > limit {
+            guard isReducible(part.mimeType),
+                  let reduced = ladder.lazy.compactMap({ reencode(part, step: $0) }).first(where: { $0.data.count <= limit }) else {
+                return .failure(.partTooLarge(token: token, bytes: part.data.count, limit: limit))
+            }
+            parts[token] = reduced
+        }
+
+        var current = estimate(htmlBytes: htmlBytes, tokens: tokens, partBytes: parts.mapValues { $0.data.count })
+        guard let budget = budgetBytes, current.bytes > budget else { return .success(current) }
+
+        // Largest images first: they save the most per re-encode.
+        let candidates = originals.keys.filter { isReducible(originals[$0]!.mimeType) }
+            .sorted { originals[$0]!.data.count > originals[$1]!.data.count }
+        for step in ladder {
+            var bytes = current.bytes
+            for token in candidates where bytes > budget {
+                guard let reduced = reencode(originals[token]!, step: step), reduced.data.count < parts[token]!.data.count else {
+                    continue
+                }
+                bytes -= parts[token]!.data.count - reduced.data.count
+                parts[token] = reduced
+            }
+            current = estimate(htmlBytes: htmlBytes, tokens: tokens, partBytes: parts.mapValues { $0.data.count })
+            if current.bytes <= budget { return .success(current) }
+        }
+        return .failure(.overBudget(bytes: current.bytes, budget: budget))
+    }
+
+    /// Checks a body that can be neither split nor re-encoded (e.g. an attached PDF).
+    static func check(requestBytes: Int) -> Failure? {
+        if requestBytes > JobSplitter.maxRequestBytes {
+            return .requestTooLarge(bytes: requestBytes, limit: JobSplitter.maxRequestBytes)
+        }
+        if let budget = budgetBytes, requestBytes > budget {
+            return .overBudget(bytes: requestBytes, budget: budget)
+        }
+        return nil
+    }
+
+    static func isReducible(_ mimeType: String) -> Bool {
+        mimeType == "image/png" || mimeType == "image/jpeg"
+    }
+
+    /// The part as a JPEG at `step`, or nil when it can't be decoded. Transparent areas become white.
+    static func reencode(_ part: Part, step: Step) -> Part? {
+        guard let source = CGImageSourceCreateWithData(part.data as CFData, nil),
+              let properties = CGImageSourceCopyPropertiesAtIndex(source, 0, nil) as? [CFString: Any],
+              let width = properties[kCGImagePropertyPixelWidth] as? Int,
+              let height = properties[kCGImagePropertyPixelHeight] as? Int, width > 0, height > 0 else { return nil }
+
+        let image: CGImage?
+        if step.scale < 1 {
+            let options: [CFString: Any] = [
+                kCGImageSourceCreateThumbnailFromImageAlways: true,
+                kCGImageSourceCreateThumbnailWithTransform: true,
+                kCGImageSourceThumbnailMaxPixelSize: max(1, Int((Double(max(width, height)) * step.scale).rounded()))
+            ]
+            image = CGImageSourceCreateThumbnailAtIndex(source, 0, options as CFDictionary)
+        } else {
+            image = CGImageSourceCreateImageAtIndex(source, 0, nil)
+        }
+        guard let image else { return nil }
+
+        let space = step.grayscale ? CGColorSpaceCreateDeviceGray() : CGColorSpaceCreateDeviceRGB()
+        let info = step.grayscale ? CGImageAlphaInfo.none.rawValue : CGImageAlphaInfo.noneSkipLast.rawValue
+        guard let ctx = CGContext(data: nil, width: image.width, height: image.height, bitsPerComponent: 8,
+                                  bytesPerRow: 0, space: space, bitmapInfo: info) else { return nil }
+        let rect = CGRect(x: 0, y: 0, width: image.width, height: image.height)
+        ctx.setFillColor(CGColor(gray: 1, alpha: 1))
+        ctx.fill(rect)
+        ctx.draw(image, in: rect)
+        guard let flattened = ctx.makeImage() else { return nil }
+
+        let out = NSMutableData()
+        guard let dest = CGImageDestinationCreateWithData(out, UTType.jpeg.identifier as CFString, 1, nil) else { return nil }
+        let props: [CFString: Any] = [kCGImageDestinationLossyCompressionQuality: step.quality]
+        CGImageDestinationAddImage(dest, flattened, props as CFDictionary)
+        guard CGImageDestinationFinalize(dest) else { return nil }
+        return Part(mimeType: "image/jpeg", data: out as Data, step: step, originalPixelWidth: width)
+    }
+}
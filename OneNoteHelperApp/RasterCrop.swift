@@ -0,0 +1,103 @@
+import Foundation
+
+/// A rectangle of pixels in a RasterImage (top-left origin, like the raster rows).
+struct PixelRegion: Equatable {
+    let x: Int
+    let y: Int
+    let width: Int
+    let height: Int
+}
+
+/// Finds the white margins of a rendered page so they can be cropped before encoding.
+enum RasterCrop {
+    static let enabledKey = "AutoCropMargins"
+    /// White border kept around the content, in PDF points.
+    static let paddingKey = "AutoCropPaddingPoints"
+
+    /// Samples at or above this count as paper.
+    static let whiteThreshold: UInt8 = 248
+    /// Below this saving the crop isn't worth a differently-sized image.
+    static let minSavedFraction = 0.02
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var paddingPoints: Double {
+        let d = UserDefaults.standard
+        return d.object(forKey: paddingKey) == nil ? 12 : max(0, d.double(forKey: paddingKey))
+    }
+
+    /// Bounding box of the non-white content plus `padding` pixels, or nil when there is nothing worth
+    /// cropping (no content at all, or margins too thin to matter).
+    ///
+    /// Rows are tested 16 bytes at a time from the top and bottom; within the content rows, each row is only
+    /// scanned up to the current left/right bounds, so the cost stays close to one pass over the margins.
+    static func contentRegion(_ raster: RasterImage, padding: Int) -> PixelRegion? {
+        let width = raster.width
+        let height = raster.height
+        let rowLength = width * 4
+        guard width > 0, height > 0 else { return nil }
+
+        return raster.pixels.withUnsafeBytes { buf -> PixelRegion? in
+            guard let base = buf.baseAddress else { return nil }
+            let threshold = SIMD16<UInt8>(repeating: whiteThreshold)
+
+            func row(_ y: Int) -> UnsafeRawPointer { base + y * raster.bytesPerRow }
+
+            /// First byte offset in [from, to) that is darker than paper, if any.
+            func firstInk(_ p: UnsafeRawPointer, from: Int, to: Int) -> Int? {
+                var i = from
+                while i + 16 <= to {
+                    if any(p.loadUnaligned(fromByteOffset: i, as: SIMD16<UInt8>.self) .< threshold) { break }
+                    i += 16
+                }
+                while i < to {
+                    if p.load(fromByteOffset: i, as: UInt8.self) < whiteThreshold { return i }
+                    i += 1
+                }
+                return nil
+            }
+
+            /// Last byte offset in [from, to) that is darker than paper, if any.
+            func lastInk(_ p: UnsafeRawPointer, from: Int, to: Int) -> Int? {
+                var i = to
+                while i - 16 >= from {
+                    if any(p.loadUnaligned(fromByteOffset: i - 16, as: SIMD16<UInt8>.self) .< threshold) { break }
+                    i -= 16
+                }
+                while i > from {
+                    i -= 1
+                    if p.load(fromByteOffset: i, as: UInt8.self) < whiteThreshold { return i }
+                }
+                return nil
+            }
+
+            guard let top = (0..<height).first(where: { firstInk(row($0), from: 0, to: rowLength) != nil }) else { return nil }
+            let bottom = (top..<height).reversed().first(where: { firstInk(row($0), from: 0, to: rowLength) != nil }) ?? top
+
+            var left = width
+            var right = -1
+            for y in top...bottom {
+                let p = row(y)
+                if left > 0, let i = firstInk(p, from: 0, to: left * 4) {
+                    left = i / 4
+                }
+                if right < width - 1, let i = lastInk(p, from: (right + 1) * 4, to: rowLength) {
+                    right = i / 4
+                }
+                if left == 0, right == width - 1 { break }
+            }
+            guard right >= left else { return nil }
+
+            let x0 = max(0, left - padding)
+            let y0 = max(0, top - padding)
+            let x1 = min(width, right + 1 + padding)
+            let y1 = min(height, bottom + 1 + padding)
+            let region = PixelRegion(x: x0, y: y0, width: x1 - x0, height: y1 - y0)
+
+            let kept = Double(region.width * region.height) / Double(width * height)
+            return kept <= 1 - minSavedFraction ? region : nil
+        }
+    }
+}
@@ -0,0 +1,86 @@
+import Foundation
+import CoreGraphics
+
+/// Chooses the rasterization scale of each rendered page from its content features instead of rendering
+/// everything at the maximum scale: the lowest scale that keeps the smallest text legible, raised for dense
+/// vector art and for full-page images, up to their native resolution. A per-job pixel budget then scales
+/// the whole job down if needed.
+enum RenderScaleSelector {
+    static let enabledKey = "AdaptiveRenderScale"
+    /// Minimum em size (in pixels) of the smallest text on a page.
+    static let minTextPixelsKey = "MinLegibleTextPixels"
+    /// Upper bound for the total number of rendered pixels of a job, in megapixels.
+    static let pixelBudgetKey = "RenderPixelBudgetMegapixels"
+
+    /// Scale jobs render at; per-page scales are chosen at or below it. The early page 1 of a spooling job
+    /// (see EarlyPageStore) is rendered at the same scale so the job can reuse it.
+    static let jobScale: CGFloat = 2.0
+    static let minScale: CGFloat = 1.0
+    /// Floor when the pixel budget forces a job below `minScale`.
+    static let budgetFloorScale: CGFloat = 0.75
+    /// Scales are rounded to this step so similar pages render identically.
+    static let step: CGFloat = 0.25
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var minTextPixels: Double {
+        let v = UserDefaults.standard.double(forKey: minTextPixelsKey)
+        return v > 0 ? v : 16
+    }
+
+    static var pixelBudgetMegapixels: Double {
+        let v = UserDefaults.standard.double(forKey: pixelBudgetKey)
+        return v > 0 ? v : 150
+    }
+
+    /// Scale for a single page, ignoring the job budget. Returns `maxScale` when adaptive scaling is off.
+    static func scale(for f: PDFPageFeatures, maxScale: CGFloat) -> CGFloat {
+        guard isEnabled else { return maxScale }
+
+        var needed = minScale
+        if let minFont = f.minFontSize {
+            needed = max(needed, CGFloat(minTextPixels / minFont))
+        }
+        // Hairlines in charts and tables disappear or alias badly at low scales.
+        if f.pathOpCount >= 200 {
+            needed = max(needed, 1.5)
+        }
+        // Mostly-image pages (scans): at least the images' own resolution, so they don't lose detail. This is a
+        // floor like the others; maxScale still bounds it.
+        if f.imageCoverage >= 0.5, f.maxImageDPI > 0 {
+            needed = max(needed, CGFloat(f.maxImageDPI / 72))
+        }
+
+        let rounded = (needed / step).rounded(.up) * step
+        return min(maxScale, max(minScale, rounded))
+    }
+
+    /// Per-page scales for a job, scaled down uniformly when the total exceeds the pixel budget.
+    static func scales(for features: [PDFPageFeatures], maxScale: CGFloat) -> [Int: CGFloat] {
+        var out: [Int: CGFloat] = [:]
+        for f in features {
+            out[f.pageIndex] = scale(for: f, maxScale: maxScale)
+        }
+        guard isEnabled else { return out }
+
+        let total = megapixels(features, scales: out)
+        let budget = pixelBudgetMegapixels
+        guard total > budget else { return out }
+
+        let factor = CGFloat((budget / total).squareRoot())
+        for (pageIndex, s) in out {
+            let reduced = ((s * factor) / step).rounded(.down) * step
+            out[pageIndex] = max(budgetFloorScale, reduced)
+        }
+        return out
+    }
+
+    static func megapixels(_ features: [PDFPageFeatures], scales: [Int: CGFloat]) -> Double {
+        features.reduce(0) { sum, f in
+            let s = Double(scales[f.pageIndex] ?? 1)
+            return sum + f.megapixels * s * s
+        }
+    }
+}
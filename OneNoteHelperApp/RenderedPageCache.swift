@@ -0,0 +1,283 @@
+import Foundation
+import CoreGraphics
+import CryptoKit
+
+/// On-disk cache of encoded pages (PNG/JPEG), shared across jobs: recurring reports and templates re-print
+/// identical pages all the time.
+///
+/// The key is a SHA-256 over what determines the rendered pixels: the page's decoded content stream(s), its
+/// resources (fonts, images, forms, ... walked recursively), boxes, rotation and annotations, plus the render
+/// parameters and the version of the render pipeline. Entries are `<key>.json` (metadata) + `<key>.data` in the
+/// user's Caches folder, evicted least-recently-used past `RenderCacheMaxMegabytes`.
+final class RenderedPageCache {
+    static let enabledKey = "RenderCache"
+    static let maxMegabytesKey = "RenderCacheMaxMegabytes"
+
+    static let shared = RenderedPageCache()
+
+    /// Bump when rendering, cropping or encoding changes the output for the same parameters. The app's build
+    /// number is part of the key as well, so an upgrade never serves pages encoded by an older build.
+    static let pipelineVersion = 3
+
+    private static let pipelineTag: String = {
+        let build = Bundle.main.object(forInfoDictionaryKey: "CFBundleVersion") as? String ?? "dev"
+        return "pipeline:\(pipelineVersion)/\(build)"
+    }()
+
+    static var isEnabled: Bool {
+        UserDefaults.standard.object(forKey: enabledKey) as? Bool ?? true
+    }
+
+    static var maxBytes: Int {
+        let v = UserDefaults.standard.integer(forKey: maxMegabytesKey)
+        return (v > 0 ? v : 512) << 20
+    }
+
+    struct Entry: Codable {
+        let mimeType: String
+        let fileExtension: String
+        let pixelWidth: Int
+        let format: String
+        let isBlank: Bool
+    }
+
+    let directory: URL
+    private let fm = FileManager.default
+
+    init(directory: URL? = nil) {
+        let base = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first
+            ?? URL(fileURLWithPath: NSTemporaryDirectory(), isDirectory: true)
+        self.directory = directory ?? base.appendingPathComponent("RenderedPages", isDirectory: true)
+        try? fm.createDirectory(at: self.directory, withIntermediateDirectories: true)
+    }
+
+    private func metaURL(_ key: String) -> URL { directory.appendingPathComponent("\(key).json") }
+    private func dataURL(_ key: String) -> URL { directory.appendingPathComponent("\(key).data") }
+
+    func lookup(_ key: String, pageIndex: Int) -> EncodedPage? {
+        guard let meta = try? Data(contentsOf: metaURL(key)),
+              let entry = try? JSONDecoder().decode(Entry.self, from: meta) else { return nil }
+        let data: Data
+        if entry.isBlank {
+            data = Data()
+        } else {
+            guard let d = try? Data(contentsOf: dataURL(key)) else { return nil }
+            data = d
+        }
+        // Touch for LRU eviction.
+        try? fm.setAttributes([.modificationDate: Date()], ofItemAtPath: metaURL(key).path)
+        return EncodedPage(pageIndex: pageIndex, mimeType: entry.mimeType, fileExtension: entry.fileExtension, data: data,
+                           pixelWidth: entry.pixelWidth, format: entry.format, isBlank: entry.isBlank)
+    }
+
+    func store(_ page: EncodedPage, for key: String) {
+        let entry = Entry(mimeType: page.mimeType, fileExtension: page.fileExtension, pixelWidth: page.pixelWidth,
+                          format: page.format, isBlank: page.isBlank)
+        guard let meta = try? JSONEncoder().encode(entry) else { return }
+        // Data first: a metadata file only ever points at complete data.
+        if !page.isBlank {
+            guard (try? page.data.write(to: dataURL(key), options: .atomic)) != nil else { return }
+        }
+        try? meta.write(to: metaURL(key), options: .atomic)
+    }
+
+    /// Evicts least-recently-used entries until the cache fits in `maxBytes`.
+    func prune(maxBytes: Int = RenderedPageCache.maxBytes) {
+        let keys: [URLResourceKey] = [.contentModificationDateKey, .fileSizeKey]
+        guard let files = try? fm.contentsOfDirectory(at: directory, includingPropertiesForKeys: keys) else { return }
+
+        struct Item { let key: String; let used: Date; let bytes: Int }
+        var byKey: [String: Item] = [:]
+        for url in files {
+            let key = url.deletingPathExtension().lastPathComponent
+            let values = try? url.resourceValues(forKeys: Set(keys))
+            let bytes = values?.fileSize ?? 0
+            let used = url.pathExtension == "json" ? values?.contentModificationDate : nil
+            let prev = byKey[key]
+            byKey[key] = Item(key: key, used: used ?? prev?.used ?? .distantPast, bytes: (prev?.bytes ?? 0) + bytes)
+        }
+
+        var total = byKey.values.reduce(0) { $0 + $1.bytes }
+        guard total > maxBytes else { return }
+        for item in byKey.values.sorted(by: { $0.used < $1.used }) {
+            try? fm.removeItem(at: metaURL(item.key))
+            try? fm.removeItem(at: dataURL(item.key))
+            total -= item.bytes
+            if total <= maxBytes { break }
+        }
+    }
+
+    // MARK: - Keys
+
+    /// Cache key of `page` rendered with `parameters` (anything that changes the output bytes). Pass the same
+    /// `memo` for every page of one document, so resources the pages share are hashed only once.
+    static func key(page: CGPDFPage, parameters: String, memo: PDFDigestMemo = PDFDigestMemo()) -> String? {
+        guard let dict = page.dictionary else { return nil }
+        var hasher = PDFObjectHasher(memo: memo)
+        hasher.update(pipelineTag)
+        hasher.update("params:\(parameters)")
+        hasher.update("media:\(page.getBoxRect(.mediaBox))crop:\(page.getBoxRect(.cropBox))rot:\(page.rotationAngle)")
+        for key in ["Contents", "Resources", "Annots", "Group"] {
+            hasher.update("/\(key)")
+            if let obj = inheritableObject(dict, key, inherited: key == "Resources") {
+                hasher.hash(obj, depth: 0)
+            }
+        }
+        return hasher.finalize()
+    }
+
+    /// `key` from the page dictionary, or - for inheritable entries like /Resources - from the nearest ancestor.
+    private static func inheritableObject(_ page: CGPDFDictionaryRef, _ key: String, inherited: Bool) -> CGPDFObjectRef? {
+        var node: CGPDFDictionaryRef? = page
+        var hops = 0
+        while let n = node, hops < 32 {
+            var obj: CGPDFObjectRef?
+            if CGPDFDictionaryGetObject(n, key, &obj), let obj { return obj }
+            guard inherited else { return nil }
+            var parent: CGPDFDictionaryRef?
+            node = CGPDFDictionaryGetDictionary(n, "Parent", &parent) ? parent : nil
+            hops += 1
+        }
+        return nil
+    }
+}
+
+/// Digests of the dictionaries and streams of one document hashed so far, shared by the keys of its pages: a
+/// font, image or form inherited by every page is decoded and hashed once per job instead of once per page.
+/// Objects are identified by address, so a memo must not outlive its CGPDFDocument.
+final class PDFDigestMemo {
+    fileprivate var digests: [UnsafeRawPointer: String] = [:]
+    /// Objects whose digest is being computed, by nesting level; a cycle hashes as a reference to one of them.
+    fileprivate var inProgress: [UnsafeRawPointer: Int] = [:]
+}
+
+/// Streams a canonical serialization of a PDF object graph into SHA-256: dictionary keys sorted, streams by
+/// their decoded bytes, back-references (/Parent, /P) skipped, depth bounded. Every dictionary and stream is
+/// hashed on its own and enters its parent's hash as its digest, which `PDFDigestMemo` keeps for later pages.
+/// A cycle hashes as how many levels out the object it returns to is; digests that depend on where the object
+/// was reached from (a cycle leaving it, or the depth limit) are not memoized.
+private struct PDFObjectHasher {
+    private var sha = SHA256()
+    private let memo: PDFDigestMemo
+    /// Lowest level a cycle inside referred back to (Int.max: none).
+    private var cycleLevel = Int.max
+    /// The depth limit cut something off.
+    private var truncated = false
+    private static let maxDepth = 24
+    private static let skippedKeys: Set<String> = ["Parent", "P"]
+
+    init(memo: PDFDigestMemo) {
+        self.memo = memo
+    }
+
+    mutating func update(_ s: String) {
+        sha.update(data: Data(s.utf8))
+    }
+
+    mutating func finalize() -> String {
+        sha.finalize().map { String(format: "%02x", $0) }.joined()
+    }
+
+    mutating func hash(_ obj: CGPDFObjectRef, depth: Int) {
+        guard depth < Self.maxDepth else {
+            update("~")
+            truncated = true
+            return
+        }
+        switch CGPDFObjectGetType(obj) {
+        case .null:
+            update("n")
+        case .boolean:
+            var b: CGPDFBoolean = 0
+            CGPDFObjectGetValue(obj, .boolean, &b)
+            update("b\(b)")
+        case .integer:
+            var i: CGPDFInteger = 0
+            CGPDFObjectGetValue(obj, .integer, &i)
+            update("i\(i)")
+        case .real:
+            var r: CGPDFReal = 0
+            CGPDFObjectGetValue(obj, .real, &r)
+            update("r\(r)")
+        case .name:
+            var n: UnsafePointer<Int8>?
+            if CGPDFObjectGetValue(obj, .name, &n), let n { update("/\(String(cString: n))") }
+        case .string:
+            var s: CGPDFStringRef?
+            if CGPDFObjectGetValue(obj, .string, &s), let s, let p = CGPDFStringGetBytePtr(s) {
+                update("s\(CGPDFStringGetLength(s)):")
+                sha.update(bufferPointer: UnsafeRawBufferPointer(start: p, count: CGPDFStringGetLength(s)))
+            }
+        case .array:
+            var a: CGPDFArrayRef?
+            guard CGPDFObjectGetValue(obj, .array, &a), let a else { return }
+            let count = CGPDFArrayGetCount(a)
+            update("[\(count)")
+            for i in 0..<count {
+                var item: CGPDFObjectRef?
+                if CGPDFArrayGetObject(a, i, &item), let item { hash(item, depth: depth + 1) }
+            }
+            update("]")
+        case .dictionary:
+            var d: CGPDFDictionaryRef?
+            guard CGPDFObjectGetValue(obj, .dictionary, &d), let d else { return }
+            hashShared(UnsafeRawPointer(d), depth: depth) { $0.hash(dictionary: d, depth: $1) }
+        case .stream:
+            var st: CGPDFStreamRef?
+            guard CGPDFObjectGetValue(obj, .stream, &st), let st else { return }
+            hashShared(UnsafeRawPointer(st), depth: depth) { sub, depth in
+                if let d = CGPDFStreamGetDictionary(st) { sub.hash(dictionary: d, depth: depth) }
+                var format: CGPDFDataFormat = .raw
+                if let data = CGPDFStreamCopyData(st, &format) as Data? {
+                    sub.update("stream\(format.rawValue):\(data.count):")
+                    sub.sha.update(data: data)
+                }
+            }
+        @unknown default:
+            update("?")
+        }
+    }
+
+    /// Hashes the dictionary or stream `id` as its digest: from the memo, or computed by `body` in a hasher of
+    /// its own (one level down).
+    private mutating func hashShared(_ id: UnsafeRawPointer, depth: Int, _ body: (inout PDFObjectHasher, Int) -> Void) {
+        if let digest = memo.digests[id] {
+            update("#\(digest)")
+            return
+        }
+        if let enclosing = memo.inProgress[id] {
+            update("@\(depth - enclosing)")
+            cycleLevel = min(cycleLevel, enclosing)
+            return
+        }
+        memo.inProgress[id] = depth
+        var sub = PDFObjectHasher(memo: memo)
+        body(&sub, depth)
+        memo.inProgress[id] = nil
+
+        let digest = sub.finalize()
+        if sub.cycleLevel >= depth, !sub.truncated {
+            memo.digests[id] = digest
+        } else {
+            cycleLevel = min(cycleLevel, sub.cycleLevel)
+            truncated = truncated || sub.truncated
+        }
+        update("#\(digest)")
+    }
+
+    private mutating func hash(dictionary d: CGPDFDictionaryRef, depth: Int) {
+        var entries: [(String, CGPDFObjectRef)] = []
+        CGPDFDictionaryApplyBlock(d, { key, value, _ in
+            entries.append((String(cString: key), value))
+            return true
+        }, nil)
+        entries.sort { $0.0 < $1.0 }
+
+        update("<<\(entries.count)")
+        for (key, value) in entries where !Self.skippedKeys.contains(key) {
+            update("/\(key)")
+            hash(value, depth: depth + 1)
+        }
+        update(">>")
+    }
+}
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Run the attachment PDF optimizer offline over a corpus and report size/time.
+
+Use-case: tune the Ghostscript settings used by the XPC service (optimizePDF) on Linux or macOS
+without going through the app. The arguments below must stay in sync with
+OneNoteGhostscriptXPC/main.swift.
+
+What it does:
+- Runs `gs -sDEVICE=pdfwrite` with object/xref streams, duplicate image detection and font subsetting
+  (plus optional image downsampling) on every *.pdf under the corpus directory
+- Prints before/after bytes, saving and wall-clock time per file, then totals
+- Optionally keeps the optimized files and/or writes a CSV
+
+Usage:
+  optimize_pdf_corpus.py /path/to/corpus [--gs gs] [--downsample-dpi 150] [--out /tmp/opt] [--csv report.csv]
+"""
+
+import argparse
+import csv
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def optimize_args(downsample_dpi: int):
+    args = [
+        "-dSAFER",
+        "-dBATCH",
+        "-dNOPAUSE",
+        "-sDEVICE=pdfwrite",
+        "-dCompatibilityLevel=1.5",
+        "-dWriteObjStms=true",
+        "-dWriteXRefStm=true",
+        "-dDetectDuplicateImages=true",
+        "-dCompressFonts=true",
+        "-dSubsetFonts=true",
+        "-dAutoRotatePages=/None",
+    ]
+    if downsample_dpi > 0:
+        args += [
+            "-dDownsampleColorImages=true",
+            "-dDownsampleGrayImages=true",
+            "-dDownsampleMonoImages=true",
+            f"-dColorImageResolution={downsample_dpi}",
+            f"-dGrayImageResolution={downsample_dpi}",
+            f"-dMonoImageResolution={downsample_dpi * 2}",
+            "-dColorImageDownsampleThreshold=1.5",
+            "-dGrayImageDownsampleThreshold=1.5",
+        ]
+    else:
+        args += [
+            "-dDownsampleColorImages=false",
+            "-dDownsampleGrayImages=false",
+            "-dDownsampleMonoImages=false",
+            "-dPassThroughJPEGImages=true",
+        ]
+    return args
+
+
+def find_pdfs(root: str):
+    for dirpath, _, files in os.walk(root):
+        for name in sorted(files):
+            if name.lower().endswith(".pdf"):
+                yield os.path.join(dirpath, name)
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("corpus", help="Directory containing sample PDFs (searched recursively)")
+    ap.add_argument("--gs", default=shutil.which("gs") or "gs", help="Ghostscript executable")
+    ap.add_argument("--downsample-dpi", type=int, default=0, help="Downsample images above this DPI (0 = off)")
+    ap.add_argument("--out", help="Keep optimized files in this directory")
+    ap.add_argument("--csv", help="Write per-file results to this CSV file")
+    args = ap.parse_args()
+
+    if not shutil.which(args.gs) and not os.path.exists(args.gs):
+        print(f"ERROR: Ghostscript not found: {args.gs}", file=sys.stderr)
+        return 2
+
+    out_dir = args.out or tempfile.mkdtemp(prefix="pdfopt-")
+    os.makedirs(out_dir, exist_ok=True)
+
+    rows = []
+    total_before = total_after = 0
+    total_time = 0.0
+
+    for src in find_pdfs(args.corpus):
+        rel = os.path.relpath(src, args.corpus)
+        dst = os.path.join(out_dir, rel.replace(os.sep, "__"))
+        cmd = [args.gs] + optimize_args(args.downsample_dpi) + [f"-sOutputFile={dst}", src]
+
+        before = os.path.getsize(src)
+        t0 = time.monotonic()
+        proc = subprocess.run(cmd, text=True, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        elapsed = time.monotonic() - t0
+
+        if proc.returncode != 0 or not os.path.exists(dst):
+            print(f"FAIL  {rel}: gs exit={proc.returncode}")
+            rows.append((rel, before, "", f"{elapsed:.3f}", "failed"))
+            continue
+
+        after = os.path.getsize(dst)
+        # The app keeps the original when optimizing doesn't help; report the same outcome.
+        kept = after >= before
+        effective = before if kept else after
+        saving = 100.0 * (before - effective) / before if before else 0.0
+        print(f"{'KEEP' if kept else 'OK  '}  {rel}: {before} -> {after} bytes ({saving:.1f}% saved) in {elapsed * 1000:.0f} ms")
+        rows.append((rel, before, after, f"{elapsed:.3f}", "kept-original" if kept else "optimized"))
+
+        total_before += before
+        total_after += effective
+        total_time += elapsed
+
+    if total_before:
+        saving = 100.0 * (total_before - total_after) / total_before
+        print(f"\nTOTAL {len(rows)} file(s): {total_before} -> {total_after} bytes ({saving:.1f}% saved) in {total_time:.2f} s")
+    else:
+        print("No PDFs processed.")
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["file", "bytes_before", "bytes_after", "seconds", "result"])
+            w.writerows(rows)
+
+    if not args.out:
+        shutil.rmtree(out_dir, ignore_errors=True)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -23,6 +23,8 @@ final class LogStore: ObservableObject {
 
     @Published var text: String = ""
     @Published var activityState: ActivityState = .waiting
+    /// JobScheduler occupancy, e.g. "jobs 1/2 running, 0 queued (0 user(s)); cpu 1/4; network 0/2".
+    @Published var schedulerSummary: String = ""
 
     private let df: DateFormatter = {
         let d = DateFormatter()
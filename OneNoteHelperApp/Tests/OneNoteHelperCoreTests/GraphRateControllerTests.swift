@@ -0,0 +1,180 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+/// Answers every request with the next scripted response (200 once the script is used up), like a Graph
+/// endpoint that throttles for a while.
+private final class ScriptedGraphProtocol: URLProtocol {
+    struct Reply {
+        let status: Int
+        var headers: [String: String] = [:]
+    }
+
+    private static let lock = NSLock()
+    private static var script: [Reply] = []
+    private static var requestDates: [Date] = []
+
+    static func reset(_ replies: [Reply]) {
+        lock.lock()
+        script = replies
+        requestDates = []
+        lock.unlock()
+    }
+
+    static var requests: [Date] {
+        lock.lock()
+        defer { lock.unlock() }
+        return requestDates
+    }
+
+    override class func canInit(with request: URLRequest) -> Bool { true }
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest { request }
+
+    override func startLoading() {
+        Self.lock.lock()
+        Self.requestDates.append(Date())
+        let reply = Self.script.isEmpty ? Reply(status: 200) : Self.script.removeFirst()
+        Self.lock.unlock()
+
+        let response = HTTPURLResponse(url: request.url!, statusCode: reply.status, httpVersion: "HTTP/1.1",
+                                       headerFields: reply.headers)!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        client?.urlProtocol(self, didLoad: Data("{}".utf8))
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {}
+}
+
+final class GraphRateControllerTests: XCTestCase {
+    private var session: URLSession!
+
+    override func setUp() {
+        let config = URLSessionConfiguration.ephemeral
+        config.protocolClasses = [ScriptedGraphProtocol.self]
+        session = URLSession(configuration: config)
+    }
+
+    override func tearDown() {
+        session.invalidateAndCancel()
+    }
+
+    /// Sends through `controller.send` (the app's sendGraphRequest loop). Returns the final status and the
+    /// pauses it waited before retries.
+    private func send(_ controller: GraphRateController, key: String, maxRetries: Int = 3) -> (status: Int, delays: [TimeInterval]) {
+        var delays: [TimeInterval] = []
+        var slots = 0
+        let result = controller.send(key: key, session: session, maxRetries: maxRetries,
+                                     slot: {
+                                         slots += 1
+                                         return { slots -= 1 }
+                                     },
+                                     onThrottled: { _, retry, delay in
+                                         XCTAssertEqual(retry, delays.count + 1)
+                                         delays.append(delay)
+                                     }) {
+            URLRequest(url: URL(string: "https://graph.example/v1.0/me/onenote/pages")!)
+        }
+        XCTAssertEqual(slots, 0, "every attempt's slot is released")
+        return (result.response?.statusCode ?? 0, delays)
+    }
+
+    func test429WithRetryAfterIsRetriedAfterThePause() {
+        ScriptedGraphProtocol.reset([.init(status: 429, headers: ["Retry-After": "1"])])
+        let controller = GraphRateController()
+
+        let result = send(controller, key: "tenant/user")
+
+        XCTAssertEqual(result.status, 200)
+        XCTAssertEqual(result.delays, [1])
+        let requests = ScriptedGraphProtocol.requests
+        XCTAssertEqual(requests.count, 2)
+        XCTAssertGreaterThanOrEqual(requests[1].timeIntervalSince(requests[0]), 0.95)
+    }
+
+    func test503WithHTTPDateRetryAfter() {
+        let formatter = DateFormatter()
+        formatter.locale = Locale(identifier: "en_US_POSIX")
+        formatter.timeZone = TimeZone(identifier: "GMT")
+        formatter.dateFormat = "EEE, dd MMM yyyy HH:mm:ss zzz"
+        let date = formatter.string(from: Date().addingTimeInterval(2))
+        ScriptedGraphProtocol.reset([.init(status: 503, headers: ["Retry-After": date])])
+
+        let result = send(GraphRateController(), key: "tenant/user")
+
+        XCTAssertEqual(result.status, 200)
+        XCTAssertEqual(result.delays.count, 1)
+        // The header has whole seconds only.
+        XCTAssertGreaterThan(result.delays[0], 0.5)
+        XCTAssertLessThanOrEqual(result.delays[0], 2.5)
+    }
+
+    func testGivesUpAfterMaxRetries() {
+        let throttled = ScriptedGraphProtocol.Reply(status: 429, headers: ["Retry-After": "0"])
+        ScriptedGraphProtocol.reset(Array(repeating: throttled, count: 5))
+
+        let result = send(GraphRateController(), key: "tenant/user", maxRetries: 2)
+
+        XCTAssertEqual(result.status, 429)
+        XCTAssertEqual(result.delays, [0, 0])
+        XCTAssertEqual(ScriptedGraphProtocol.requests.count, 3)
+    }
+
+    func testThrottlingPausesOnlyThatAccount() {
+        let controller = GraphRateController()
+        let permit = controller.acquire(key: "a")
+        XCTAssertEqual(controller.finish(permit, .throttled(retryAfter: 30)), 30)
+        XCTAssertTrue(controller.summary(key: "a").contains("paused 30s"))
+
+        // Another account isn't held back by it.
+        let started = Date()
+        controller.finish(controller.acquire(key: "b"), .success)
+        XCTAssertLessThan(Date().timeIntervalSince(started), 1)
+    }
+
+    func testWindowHalvesOnThrottlingAndGrowsOnSuccess() {
+        let controller = GraphRateController()
+        XCTAssertTrue(controller.summary(key: "k").hasPrefix("idle"))
+
+        controller.finish(controller.acquire(key: "k"), .throttled(retryAfter: 0))
+        XCTAssertTrue(controller.summary(key: "k").hasPrefix("window 1.0"), controller.summary(key: "k"))
+
+        controller.finish(controller.acquire(key: "k"), .success)
+        XCTAssertTrue(controller.summary(key: "k").hasPrefix("window 2.0"), controller.summary(key: "k"))
+    }
+
+    func testConcurrencyWindowHoldsBackExtraRequests() {
+        // The initial window is 2 requests in flight.
+        let controller = GraphRateController()
+        let first = controller.acquire(key: "k")
+        _ = controller.acquire(key: "k")
+
+        let third = expectation(description: "third permit")
+        DispatchQueue.global().async {
+            controller.finish(controller.acquire(key: "k"), .success)
+            third.fulfill()
+        }
+        usleep(300_000)
+        controller.finish(first, .success)
+        wait(for: [third], timeout: 5)
+    }
+
+    func testRetryAfterParsing() {
+        func response(_ value: String?) -> HTTPURLResponse {
+            HTTPURLResponse(url: URL(string: "https://graph.example")!, statusCode: 429, httpVersion: "HTTP/1.1",
+                            headerFields: value.map { ["Retry-After": $0] } ?? [:])!
+        }
+        XCTAssertEqual(GraphRateController.retryAfter(response("7")), 7)
+        XCTAssertEqual(GraphRateController.retryAfter(response(" 2.5 ")), 2.5)
+        XCTAssertEqual(GraphRateController.retryAfter(response("-3")), 0)
+        XCTAssertEqual(GraphRateController.retryAfter(response("Wed, 21 Oct 2015 07:28:00 GMT")), 0)
+        XCTAssertNil(GraphRateController.retryAfter(response("soon")))
+        XCTAssertNil(GraphRateController.retryAfter(response(nil)))
+    }
+
+    func testAccountKeyFromAccessToken() {
+        let claims = Data(#"{"tid":"t1","oid":"o1"}"#.utf8).base64EncodedString()
+            .replacingOccurrences(of: "=", with: "")
+        XCTAssertEqual(GraphRateController.key(forAccessToken: "header.\(claims).signature"), "t1/o1")
+        XCTAssertEqual(GraphRateController.key(forAccessToken: "opaque-token"), "default")
+    }
+}
@@ -0,0 +1,97 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+/// Stands in for MSAL: records each acquisition and holds its completion until the test answers it.
+private final class ScriptedRefresher {
+    var calls: [Bool] = []
+    var pending: [(String?, Date?) -> Void] = []
+    var called: XCTestExpectation?
+
+    func refresh(interactive: Bool, forceRefresh: Bool, completion: @escaping (String?, Date?) -> Void) {
+        calls.append(interactive)
+        pending.append(completion)
+        called?.fulfill()
+    }
+
+    func answer(_ token: String?) {
+        pending.removeFirst()(token, token == nil ? nil : Date().addingTimeInterval(3600))
+    }
+}
+
+final class GraphTokenCacheTests: XCTestCase {
+    private var cache: GraphTokenCache!
+    private var refresher: ScriptedRefresher!
+
+    override func setUp() {
+        cache = GraphTokenCache()
+        refresher = ScriptedRefresher()
+        cache.refresher = refresher.refresh
+    }
+
+    private func expectAcquisition(_ description: String) -> XCTestExpectation {
+        let called = expectation(description: description)
+        refresher.called = called
+        return called
+    }
+
+    func testNonInteractiveGetNeverSignsIn() {
+        let called = expectAcquisition("silent acquisition")
+        let done = expectation(description: "token")
+        cache.get(interactive: false) { token in
+            XCTAssertNil(token)
+            done.fulfill()
+        }
+        wait(for: [called], timeout: 5)
+        refresher.answer(nil)
+        wait(for: [done], timeout: 5)
+        XCTAssertEqual(refresher.calls, [false])
+    }
+
+    func testInteractiveGetMaySignIn() {
+        let called = expectAcquisition("acquisition")
+        let done = expectation(description: "token")
+        cache.get(interactive: true) { token in
+            XCTAssertEqual(token, "t1")
+            done.fulfill()
+        }
+        wait(for: [called], timeout: 5)
+        refresher.answer("t1")
+        wait(for: [done], timeout: 5)
+        XCTAssertEqual(refresher.calls, [true])
+
+        // Cached from now on, for either kind of caller.
+        let cached = expectation(description: "cached token")
+        cache.get(interactive: false) { token in
+            XCTAssertEqual(token, "t1")
+            cached.fulfill()
+        }
+        wait(for: [cached], timeout: 5)
+        XCTAssertEqual(refresher.calls, [true])
+    }
+
+    func testFailedSilentAcquisitionOnlySignsInForInteractiveCallers() {
+        let silent = expectAcquisition("prefetch")
+        cache.prefetch()
+        wait(for: [silent], timeout: 5)
+
+        let retryDone = expectation(description: "non-interactive caller")
+        cache.get(interactive: false) { token in
+            XCTAssertNil(token)
+            retryDone.fulfill()
+        }
+        let jobDone = expectation(description: "interactive caller")
+        cache.get(interactive: true) { token in
+            XCTAssertEqual(token, "t1")
+            jobDone.fulfill()
+        }
+
+        // The non-interactive caller is answered without waiting for the sign-in.
+        let signIn = expectAcquisition("sign-in")
+        refresher.answer(nil)
+        wait(for: [retryDone, signIn], timeout: 5)
+        XCTAssertEqual(refresher.calls, [false, true])
+
+        refresher.answer("t1")
+        wait(for: [jobDone], timeout: 5)
+    }
+}
@@ -0,0 +1,183 @@
+import XCTest
+@testable import OneNoteHelperCore
+#if canImport(Darwin)
+import Darwin
+#endif
+
+final class GraphTransportTests: XCTestCase {
+    private var transport: GraphTransport!
+
+    override func setUp() {
+        transport = GraphTransport(configuration: .ephemeral)
+    }
+
+    override func tearDown() {
+        transport.session.invalidateAndCancel()
+    }
+
+    private func sample(reused: Bool, h2: Bool = true, connect: TimeInterval? = nil, tls: TimeInterval? = nil)
+        -> GraphTransport.Sample {
+        GraphTransport.Sample(reusedConnection: reused, protocolName: h2 ? "h2" : "http/1.1",
+                              connectSeconds: connect, tlsSeconds: tls)
+    }
+
+    func testWarmUpsAreKeptOutOfRequestStats() {
+        transport.record(sample(reused: false, connect: 0.05, tls: 0.1), isWarmUp: true)
+        transport.record(sample(reused: true), isWarmUp: false)
+
+        let stats = transport.stats
+        XCTAssertEqual(stats.warmUps, 1)
+        XCTAssertEqual(stats.requests, 1)
+        XCTAssertEqual(stats.reusedConnections, 1)
+        XCTAssertEqual(stats.http2Requests, 1)
+        XCTAssertEqual(stats.connectMilliseconds, 0)
+        XCTAssertEqual(stats.tlsMilliseconds, 0)
+    }
+
+    func testHandshakeTimesAverageOverNewConnections() {
+        transport.record(sample(reused: false, connect: 0.25, tls: 0.5), isWarmUp: false)
+        transport.record(sample(reused: false, h2: false, connect: 0.125, tls: 0.25), isWarmUp: false)
+        transport.record(sample(reused: true), isWarmUp: false)
+        transport.record(sample(reused: true), isWarmUp: false)
+
+        let stats = transport.stats
+        XCTAssertEqual(stats.requests, 4)
+        XCTAssertEqual(stats.reusedConnections, 2)
+        XCTAssertEqual(stats.http2Requests, 3)
+        XCTAssertEqual(stats.summary,
+                       "4 request(s) (+0 warm-up), 2 on reused connections, 3 over h2; "
+                       + "new connections avg connect 187 ms, TLS 375 ms")
+    }
+
+    #if canImport(Darwin)
+    /// Polls `condition` until it holds or `timeout` passes.
+    private func eventually(timeout: TimeInterval = 5, _ condition: () -> Bool) -> Bool {
+        let deadline = Date().addingTimeInterval(timeout)
+        while !condition() {
+            if Date() > deadline { return false }
+            usleep(10_000)
+        }
+        return true
+    }
+
+    private func get(_ url: URL) -> Int? {
+        var status: Int?
+        let done = DispatchSemaphore(value: 0)
+        transport.session.dataTask(with: url) { _, response, _ in
+            status = (response as? HTTPURLResponse)?.statusCode
+            done.signal()
+        }.resume()
+        done.wait()
+        return status
+    }
+
+    func testRequestsReuseTheWarmedUpConnection() throws {
+        // Plain HTTP: a local TLS server would need a trusted certificate. Reuse works the same way; the
+        // handshake timings are covered by the sample tests above.
+        let server = try KeepAliveHTTPServer()
+        defer { server.stop() }
+        let base = "http://127.0.0.1:\(server.port)"
+
+        transport.warmUp(baseURL: base)
+        XCTAssertTrue(eventually { self.transport.stats.warmUps == 1 })
+        // Used in the last 30 seconds: no second warm-up.
+        transport.warmUp(baseURL: base)
+
+        for _ in 0..<3 {
+            XCTAssertEqual(get(URL(string: base + "/v1.0/me/onenote/notebooks")!), 200)
+        }
+        XCTAssertTrue(eventually { self.transport.stats.requests == 3 })
+
+        let stats = transport.stats
+        XCTAssertEqual(stats.warmUps, 1)
+        XCTAssertEqual(stats.reusedConnections, 3)
+        XCTAssertEqual(server.connections, 1)
+        XCTAssertEqual(server.requests, 4)
+    }
+    #endif
+}
+
+#if canImport(Darwin)
+/// HTTP/1.1 server on 127.0.0.1 that keeps connections open and answers every request with "200 ok".
+private final class KeepAliveHTTPServer {
+    struct SocketError: Error {}
+
+    let port: UInt16
+    private let listener: Int32
+    private let lock = NSLock()
+    private var _connections = 0
+    private var _requests = 0
+
+    var connections: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return _connections
+    }
+
+    var requests: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return _requests
+    }
+
+    init() throws {
+        let fd = socket(AF_INET, SOCK_STREAM, 0)
+        guard fd >= 0 else { throw SocketError() }
+        var addr = sockaddr_in()
+        addr.sin_len = UInt8(MemoryLayout<sockaddr_in>.size)
+        addr.sin_family = sa_family_t(AF_INET)
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1")
+        var length = socklen_t(MemoryLayout<sockaddr_in>.size)
+        let bound = withUnsafeMutablePointer(to: &addr) { p in
+            p.withMemoryRebound(to: sockaddr.self, capacity: 1) { sa in
+                bind(fd, sa, length) == 0 && getsockname(fd, sa, &length) == 0
+            }
+        }
+        guard bound, listen(fd, 8) == 0 else {
+            close(fd)
+            throw SocketError()
+        }
+        listener = fd
+        port = UInt16(bigEndian: addr.sin_port)
+        Thread { [self] in acceptLoop() }.start()
+    }
+
+    func stop() {
+        close(listener)
+    }
+
+    private func acceptLoop() {
+        while true {
+            let client = accept(listener, nil, nil)
+            if client < 0 { return }
+            lock.lock()
+            _connections += 1
+            lock.unlock()
+            Thread { [self] in serve(client) }.start()
+        }
+    }
+
+    private func serve(_ client: Int32) {
+        defer { close(client) }
+        let headerEnd = Data("\r\n\r\n".utf8)
+        var pending = Data()
+        var buffer = [UInt8](repeating: 0, count: 4096)
+        while true {
+            let n = read(client, &buffer, buffer.count)
+            if n <= 0 { return }
+            pending.append(contentsOf: buffer[0..<n])
+            // Only GET and HEAD arrive here, so a request ends with its headers.
+            while let end = pending.range(of: headerEnd) {
+                let isHead = pending[pending.startIndex..<end.lowerBound].starts(with: Data("HEAD ".utf8))
+                pending = Data(pending[end.upperBound...])
+                lock.lock()
+                _requests += 1
+                lock.unlock()
+                let reply = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n" + (isHead ? "" : "ok")
+                let bytes = Array(reply.utf8)
+                guard write(client, bytes, bytes.count) == bytes.count else { return }
+            }
+        }
+    }
+}
+#endif
@@ -0,0 +1,84 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+final class JobSplitterTests: XCTestCase {
+    private let overhead = JobSplitter.requestOverheadBytes
+    private let partOverhead = JobSplitter.partOverheadBytes
+
+    func testEverythingFitsInOneChunk() {
+        let ranges = JobSplitter.partition(htmlBytes: [100, 200, 300], tokens: [["a"], [], ["b"]],
+                                           partBytes: ["a": 1000, "b": 1000], maxBytes: 1 << 20, maxParts: 30)
+        XCTAssertEqual(ranges, [0..<3])
+        XCTAssertEqual(JobSplitter.partition(htmlBytes: [], tokens: [], partBytes: [:], maxBytes: 1 << 20, maxParts: 30), [])
+    }
+
+    func testOversizedSectionGetsItsOwnChunk() {
+        let ranges = JobSplitter.partition(htmlBytes: [100, 200_000, 100], tokens: [[], [], []], partBytes: [:],
+                                           maxBytes: 100_000, maxParts: 30)
+        XCTAssertEqual(ranges, [0..<1, 1..<2, 2..<3])
+
+        // Also when it comes first.
+        XCTAssertEqual(JobSplitter.partition(htmlBytes: [200_000, 100], tokens: [[], []], partBytes: [:],
+                                             maxBytes: 100_000, maxParts: 30),
+                       [0..<1, 1..<2])
+    }
+
+    func testSharedTokenCountsOncePerChunk() {
+        let part = 40_000
+        // Room for two parts and 1000 bytes of HTML.
+        let maxBytes = overhead + 2 * (part + partOverhead) + 1000
+        let ranges = JobSplitter.partition(htmlBytes: [100, 100, 100, 100, 100, 1000],
+                                           tokens: [["a"], ["a"], ["b"], ["c"], ["a"], []],
+                                           partBytes: ["a": part, "b": part, "c": part],
+                                           maxBytes: maxBytes, maxParts: 30)
+        // Sections 0-2 fit only if "a" is counted once. In the second chunk "a" is counted again, which leaves
+        // no room for section 5.
+        XCTAssertEqual(ranges, [0..<3, 3..<5, 5..<6])
+    }
+
+    func testPartLimit() {
+        let ranges = JobSplitter.partition(htmlBytes: [10, 10, 10, 10, 10], tokens: [["a"], ["b"], ["c"], ["d"], ["e"]],
+                                           partBytes: ["a": 10, "b": 10, "c": 10, "d": 10, "e": 10],
+                                           maxBytes: 1 << 20, maxParts: 3)
+        XCTAssertEqual(ranges, [0..<3, 3..<5])
+
+        // A part referenced again doesn't count against the limit.
+        XCTAssertEqual(JobSplitter.partition(htmlBytes: [10, 10, 10, 10], tokens: [["a"], ["a", "b"], ["c"], ["d"]],
+                                             partBytes: ["a": 10, "b": 10, "c": 10, "d": 10],
+                                             maxBytes: 1 << 20, maxParts: 3),
+                       [0..<3, 3..<4])
+    }
+
+    func testChunksKeepSectionOrderAndStayWithinLimits() {
+        let count = 50
+        let htmlBytes = (0..<count).map { ($0 * 7919) % 30_000 }
+        // Every third section reuses the previous section's part.
+        let tokens = (0..<count).map { i in ["p\(i % 3 == 2 ? i - 1 : i)"] }
+        var partBytes: [String: Int] = [:]
+        for i in 0..<count {
+            partBytes["p\(i)"] = (i * 104_729) % 50_000
+        }
+        let maxBytes = 120_000
+        let maxParts = 4
+
+        let ranges = JobSplitter.partition(htmlBytes: htmlBytes, tokens: tokens, partBytes: partBytes,
+                                           maxBytes: maxBytes, maxParts: maxParts)
+
+        XCTAssertEqual(ranges.flatMap { Array($0) }, Array(0..<count))
+        for range in ranges {
+            XCTAssertFalse(range.isEmpty)
+            let parts = Set(range.flatMap { tokens[$0] })
+            let bytes = overhead + range.reduce(0) { $0 + htmlBytes[$1] }
+                + parts.reduce(0) { $0 + partBytes[$1]! + partOverhead }
+            if range.count > 1 {
+                XCTAssertLessThanOrEqual(bytes, maxBytes, "\(range)")
+                XCTAssertLessThanOrEqual(parts.count, maxParts, "\(range)")
+            }
+        }
+    }
+
+    func testPlaceholderIDsAreScopedToTheSplit() {
+        XCTAssertEqual(JobSplitter.placeholderID(2, splitId: "abc"), "onh-abc-part-2")
+        XCTAssertNotEqual(JobSplitter.makeSplitID(), JobSplitter.makeSplitID())
+    }
+}
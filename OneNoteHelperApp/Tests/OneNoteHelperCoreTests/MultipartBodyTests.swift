@@ -0,0 +1,89 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+final class MultipartBodyTests: XCTestCase {
+    private var tempDirectory: URL!
+
+    override func setUpWithError() throws {
+        tempDirectory = FileManager.default.temporaryDirectory
+            .appendingPathComponent("MultipartBodyTests-\(UUID().uuidString)", isDirectory: true)
+        try FileManager.default.createDirectory(at: tempDirectory, withIntermediateDirectories: true)
+    }
+
+    override func tearDownWithError() throws {
+        try? FileManager.default.removeItem(at: tempDirectory)
+    }
+
+    /// The body a Graph create-page request gets: presentation HTML, an image held in memory, and a file part.
+    private func makeBody() throws -> (MultipartBody, expected: Data) {
+        let html = Data("<html><body><img src=\"name:img1\" /></body></html>".utf8)
+        let image = Data((0..<10_000).map { UInt8(truncatingIfNeeded: $0 &* 31) })
+        let pdf = Data("%PDF-1.7\n%%EOF\n".utf8)
+        let pdfURL = tempDirectory.appendingPathComponent("doc.pdf")
+        try pdf.write(to: pdfURL)
+
+        let body = MultipartBody(boundary: "test-boundary")
+        body.append(contentType: "text/html", contentDisposition: "form-data; name=\"Presentation\"", data: html)
+        body.append(contentType: "image/png", contentDisposition: "form-data; name=\"img1\"; filename=\"page-001.png\"", data: image)
+        XCTAssertTrue(body.append(contentType: "application/pdf",
+                                  contentDisposition: "form-data; name=\"pdfdoc\"; filename=\"doc.pdf\"",
+                                  fileURL: pdfURL))
+        body.finish()
+
+        var expected = Data()
+        func part(_ disposition: String, _ type: String, _ payload: Data) {
+            expected += Data("--test-boundary\r\nContent-Disposition: \(disposition)\r\nContent-Type: \(type)\r\n\r\n".utf8)
+            expected += payload
+            expected += Data("\r\n".utf8)
+        }
+        part("form-data; name=\"Presentation\"", "text/html", html)
+        part("form-data; name=\"img1\"; filename=\"page-001.png\"", "image/png", image)
+        part("form-data; name=\"pdfdoc\"; filename=\"doc.pdf\"", "application/pdf", pdf)
+        expected += Data("--test-boundary--\r\n".utf8)
+        return (body, expected)
+    }
+
+    func testWrittenFileMatchesContentLengthAndLayout() throws {
+        let (body, expected) = try makeBody()
+        XCTAssertEqual(body.partCount, 3)
+        XCTAssertEqual(body.contentType, "multipart/form-data; boundary=test-boundary")
+        XCTAssertEqual(body.contentLength, expected.count)
+        let url = tempDirectory.appendingPathComponent("request.body")
+        try body.write(to: url)
+        XCTAssertEqual(try Data(contentsOf: url), expected)
+    }
+
+    func testWritingAgainReplacesTheFile() throws {
+        // A body written over a longer leftover file must not keep its tail.
+        let (body, expected) = try makeBody()
+        let url = tempDirectory.appendingPathComponent("request.body")
+        try Data(repeating: 0x41, count: expected.count + 100).write(to: url)
+        try body.write(to: url)
+        XCTAssertEqual(try Data(contentsOf: url), expected)
+    }
+
+    func testUnreadableFileAddsNoPart() {
+        let body = MultipartBody(boundary: "b")
+        XCTAssertFalse(body.append(contentType: "application/pdf", contentDisposition: "form-data; name=\"x\"",
+                                   fileURL: tempDirectory.appendingPathComponent("missing.pdf")))
+        XCTAssertEqual(body.partCount, 0)
+        XCTAssertEqual(body.contentLength, 0)
+    }
+
+    func testSafeFilenameCannotEndTheHeader() {
+        let title = "Report\r\nContent-Type: text/html\r\n\r\n<script>\u{0}\t\"x\"/y\\z:w"
+        let safe = MultipartBody.safeFilename(title)
+        XCTAssertFalse(safe.contains("\r"))
+        XCTAssertFalse(safe.contains("\n"))
+        XCTAssertFalse(safe.contains("\""))
+        XCTAssertNil(safe.unicodeScalars.first { CharacterSet.controlCharacters.contains($0) })
+        XCTAssertEqual(MultipartBody.safeFilename("a\u{2028}b"), "a_b")
+        XCTAssertEqual(MultipartBody.safeFilename("Quarterly report"), "Quarterly report")
+    }
+
+    func testSafeFilenameIsCapped() {
+        XCTAssertEqual(MultipartBody.safeFilename(String(repeating: "é", count: 500)).count, 120)
+        XCTAssertEqual(MultipartBody.safeFilename("abcdef", maxLength: 3), "abc")
+        XCTAssertEqual(MultipartBody.safeFilename("   "), "_")
+    }
+}
@@ -0,0 +1,213 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+/// Stands in for the Graph pages endpoint: keeps the last request with its body and answers 201.
+private final class CapturingGraphProtocol: URLProtocol {
+    struct Captured {
+        let method: String
+        let url: URL
+        let headers: [String: String]
+        let body: Data
+    }
+
+    private static let lock = NSLock()
+    private static var _last: Captured?
+
+    static var last: Captured? {
+        lock.lock()
+        defer { lock.unlock() }
+        return _last
+    }
+
+    override class func canInit(with request: URLRequest) -> Bool { true }
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest { request }
+
+    override func startLoading() {
+        var body = request.httpBody ?? Data()
+        if let stream = request.httpBodyStream {
+            stream.open()
+            var buffer = [UInt8](repeating: 0, count: 64 * 1024)
+            while true {
+                let n = stream.read(&buffer, maxLength: buffer.count)
+                if n <= 0 { break }
+                body.append(buffer, count: n)
+            }
+            stream.close()
+        }
+        Self.lock.lock()
+        Self._last = Captured(method: request.httpMethod ?? "GET", url: request.url!,
+                              headers: request.allHTTPHeaderFields ?? [:], body: body)
+        Self.lock.unlock()
+
+        let response = HTTPURLResponse(url: request.url!, statusCode: 201, httpVersion: "HTTP/1.1",
+                                       headerFields: ["Content-Type": "application/json"])!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        client?.urlProtocol(self, didLoad: Data(#"{"id":"page-1"}"#.utf8))
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {}
+}
+
+final class OneNoteRequestBuilderTests: XCTestCase {
+    private struct Part {
+        let name: String?
+        let filename: String?
+        let contentType: String?
+        let data: Data
+
+        var text: String { String(decoding: data, as: UTF8.self) }
+    }
+
+    private var tempDirectory: URL!
+    private var session: URLSession!
+    private let pdf = Data("%PDF-1.7\n1 0 obj <<>> endobj\n%%EOF\n".utf8)
+
+    override func setUpWithError() throws {
+        tempDirectory = FileManager.default.temporaryDirectory
+            .appendingPathComponent("OneNoteRequestBuilderTests-\(UUID().uuidString)", isDirectory: true)
+        try FileManager.default.createDirectory(at: tempDirectory, withIntermediateDirectories: true)
+        let config = URLSessionConfiguration.ephemeral
+        config.protocolClasses = [CapturingGraphProtocol.self]
+        session = URLSession(configuration: config)
+    }
+
+    override func tearDownWithError() throws {
+        session.invalidateAndCancel()
+        try? FileManager.default.removeItem(at: tempDirectory)
+    }
+
+    private func pdfURL() throws -> URL {
+        let url = tempDirectory.appendingPathComponent("job.pdf")
+        try pdf.write(to: url)
+        return url
+    }
+
+    /// Writes `body` to a file like the outbox does and sends it to the mock endpoint.
+    private func send(_ body: MultipartBody, method: String) throws -> CapturingGraphProtocol.Captured {
+        let bodyURL = tempDirectory.appendingPathComponent("request.body")
+        try body.write(to: bodyURL)
+        var request = URLRequest(url: URL(string: "https://graph.example/v1.0/me/onenote/pages")!)
+        request.httpMethod = method
+        request.setValue(body.contentType, forHTTPHeaderField: "Content-Type")
+        request.httpBodyStream = InputStream(url: bodyURL)
+
+        let done = expectation(description: "response")
+        session.dataTask(with: request) { _, response, _ in
+            XCTAssertEqual((response as? HTTPURLResponse)?.statusCode, 201)
+            done.fulfill()
+        }.resume()
+        wait(for: [done], timeout: 5)
+        return try XCTUnwrap(CapturingGraphProtocol.last)
+    }
+
+    /// Splits a multipart/form-data body into its parts.
+    private func parts(of body: Data, contentType: String?) throws -> [Part] {
+        let boundary = try XCTUnwrap(contentType?.components(separatedBy: "boundary=").last)
+        let delimiter = Data("\r\n--\(boundary)".utf8)
+        let headerEnd = Data("\r\n\r\n".utf8)
+        var rest = Data("\r\n".utf8) + body
+        var result: [Part] = []
+        guard let first = rest.range(of: delimiter) else { return [] }
+        rest = Data(rest[first.upperBound...])
+        while let next = rest.range(of: delimiter) {
+            // Each part: CRLF, headers, blank line, payload.
+            let chunk = Data(rest[rest.startIndex..<next.lowerBound])
+            rest = Data(rest[next.upperBound...])
+            let split = try XCTUnwrap(chunk.range(of: headerEnd))
+            let headerText = String(decoding: chunk[chunk.startIndex..<split.lowerBound], as: UTF8.self)
+            var headers: [String: String] = [:]
+            for line in headerText.components(separatedBy: "\r\n") where line.contains(":") {
+                let kv = line.split(separator: ":", maxSplits: 1)
+                headers[kv[0].lowercased()] = kv[1].trimmingCharacters(in: .whitespaces)
+            }
+            func parameter(_ key: String) -> String? {
+                guard let d = headers["content-disposition"], let r = d.range(of: "\(key)=\"") else { return nil }
+                return d[r.upperBound...].split(separator: "\"", maxSplits: 1).first.map(String.init)
+            }
+            result.append(Part(name: parameter("name"), filename: parameter("filename"),
+                               contentType: headers["content-type"], data: Data(chunk[split.upperBound...])))
+        }
+        XCTAssertEqual(rest, Data("--\r\n".utf8), "closing boundary")
+        return result
+    }
+
+    /// Every `name:<token>` the HTML references.
+    private func references(in html: String) -> Set<String> {
+        var tokens: Set<String> = []
+        var rest = html[...]
+        while let r = rest.range(of: "\"name:") {
+            let after = rest[r.upperBound...]
+            tokens.insert(String(after.prefix { $0 != "\"" }))
+            rest = after
+        }
+        return tokens
+    }
+
+    func testServerRenderCreateRequest() throws {
+        let body = MultipartBody(boundary: "----onenote-test")
+        XCTAssertTrue(OneNoteRequestBuilder.appendServerRender(pdfURL: try pdfURL(), title: "Q3 <report>",
+                                                               attachFile: true, appending: false,
+                                                               page: { "<html><body>\($0)</body></html>" }, to: body))
+        body.finish()
+
+        let captured = try send(body, method: "POST")
+        XCTAssertEqual(captured.method, "POST")
+        XCTAssertEqual(captured.body.count, body.contentLength)
+        let parts = try parts(of: captured.body, contentType: captured.headers["Content-Type"])
+
+        XCTAssertEqual(parts.map(\.name), ["Presentation", "pdfdoc"])
+        XCTAssertEqual(parts[0].contentType, "text/html; charset=utf-8")
+        XCTAssertEqual(parts[1].contentType, "application/pdf")
+        XCTAssertEqual(parts[1].filename, "Q3 <report>.pdf")
+        XCTAssertEqual(parts[1].data, pdf)
+
+        let html = parts[0].text
+        XCTAssertTrue(html.contains("<img data-render-src=\"name:pdfdoc\" alt=\"Q3 &lt;report&gt;\" />"), html)
+        XCTAssertTrue(html.contains("<object data-attachment=\"Q3 &lt;report&gt;.pdf\" data=\"name:pdfdoc\" type=\"application/pdf\" />"), html)
+        XCTAssertEqual(references(in: html), Set(parts.dropFirst().compactMap(\.name)))
+    }
+
+    func testServerRenderAppendRequest() throws {
+        let body = MultipartBody(boundary: "----onenote-test")
+        XCTAssertTrue(OneNoteRequestBuilder.appendServerRender(pdfURL: try pdfURL(), title: "Scan",
+                                                               attachFile: false, appending: true,
+                                                               page: { "<div>\($0)</div>" }, to: body))
+        body.finish()
+
+        let captured = try send(body, method: "PATCH")
+        XCTAssertEqual(captured.method, "PATCH")
+        let parts = try parts(of: captured.body, contentType: captured.headers["Content-Type"])
+        XCTAssertEqual(parts.map(\.name), ["commands", "pdfdoc"])
+        XCTAssertEqual(parts[0].contentType, "application/json; charset=utf-8")
+
+        let commands = try XCTUnwrap(try JSONSerialization.jsonObject(with: parts[0].data) as? [[String: String]])
+        XCTAssertEqual(commands.count, 1)
+        XCTAssertEqual(commands[0]["target"], "body")
+        XCTAssertEqual(commands[0]["action"], "append")
+        let html = try XCTUnwrap(commands[0]["content"])
+        XCTAssertEqual(html, "<div><img data-render-src=\"name:pdfdoc\" alt=\"Scan\" /></div>")
+        XCTAssertEqual(references(in: html), ["pdfdoc"])
+    }
+
+    func testFilenameCannotBreakThePartHeader() throws {
+        let body = MultipartBody(boundary: "----onenote-test")
+        OneNoteRequestBuilder.appendServerRender(pdfURL: try pdfURL(), title: "a\r\nContent-Type: text/html\r\n\"b\"",
+                                                 attachFile: true, appending: false, page: { $0 }, to: body)
+        body.finish()
+
+        let captured = try send(body, method: "POST")
+        let parts = try parts(of: captured.body, contentType: captured.headers["Content-Type"])
+        XCTAssertEqual(parts.map(\.name), ["Presentation", "pdfdoc"])
+        XCTAssertEqual(parts[1].contentType, "application/pdf")
+        XCTAssertEqual(parts[1].filename, "a__Content-Type_ text_html___b_.pdf")
+    }
+
+    func testUnreadablePDFIsRejected() {
+        let body = MultipartBody(boundary: "----onenote-test")
+        XCTAssertFalse(OneNoteRequestBuilder.appendServerRender(pdfURL: tempDirectory.appendingPathComponent("missing.pdf"),
+                                                                title: "x", attachFile: true, appending: false,
+                                                                page: { $0 }, to: body))
+        XCTAssertEqual(body.partCount, 0)
+    }
+}
@@ -0,0 +1,139 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+final class PDFImageColorKernelsTests: XCTestCase {
+    private enum Model {
+        case gray, rgb, cmyk, indexed, lab
+    }
+
+    private static let width = 1024
+    private static let height = 512
+
+    /// Deterministic pseudo-random bytes, so every run converts the same image.
+    private static func noise(_ count: Int) -> Data {
+        var state: UInt32 = 0x9E37_79B9
+        return Data((0..<count).map { _ in
+            state = state &* 1_664_525 &+ 1_013_904_223
+            return UInt8(truncatingIfNeeded: state >> 24)
+        })
+    }
+
+    private static func descriptor(bits: Int, _ model: Model, decode: Bool) -> PDFImageDescriptor {
+        let colorModel: PDFImageColorModel
+        switch model {
+        case .gray: colorModel = .gray
+        case .rgb: colorModel = .rgb
+        case .cmyk: colorModel = .cmyk
+        case .lab: colorModel = .lab(range: SIMD4(-128, 127, -128, 127))
+        case .indexed:
+            let entries = min(256, 1 << bits)
+            colorModel = .indexed(paletteRGB: [UInt8](noise(entries * 3)), hival: entries - 1)
+        }
+        var decodeArray: [Float]?
+        if decode {
+            switch model {
+            case .indexed: decodeArray = [Float((1 << min(bits, 8)) - 1), 0]
+            case .lab: decodeArray = [100, 0, 127, -128, 127, -128]
+            default: decodeArray = Array(repeating: [1, 0], count: colorModel.components).flatMap { $0 }
+            }
+        }
+        return PDFImageDescriptor(width: width, height: height, bitsPerComponent: bits, model: colorModel, decode: decodeArray)
+    }
+
+    /// Times converting one image with the specialization for `bits`, `model` and the Decode mapping.
+    private func benchmark(bits: Int, _ model: Model, decode: Bool) {
+        let d = Self.descriptor(bits: bits, model, decode: decode)
+        let data = Self.noise(d.rowBytes * d.height)
+        measure {
+            var rows = 0
+            XCTAssertTrue(PDFImageConverter.convertRows(d, data: data) { _ in rows += 1 })
+            XCTAssertEqual(rows, d.height)
+        }
+    }
+
+    func testGray1bpc() { benchmark(bits: 1, .gray, decode: false) }
+    func testGray1bpcDecode() { benchmark(bits: 1, .gray, decode: true) }
+    func testRGB1bpc() { benchmark(bits: 1, .rgb, decode: false) }
+    func testRGB1bpcDecode() { benchmark(bits: 1, .rgb, decode: true) }
+    func testCMYK1bpc() { benchmark(bits: 1, .cmyk, decode: false) }
+    func testCMYK1bpcDecode() { benchmark(bits: 1, .cmyk, decode: true) }
+    func testIndexed1bpc() { benchmark(bits: 1, .indexed, decode: false) }
+    func testIndexed1bpcDecode() { benchmark(bits: 1, .indexed, decode: true) }
+    func testLab1bpc() { benchmark(bits: 1, .lab, decode: false) }
+    func testLab1bpcDecode() { benchmark(bits: 1, .lab, decode: true) }
+    func testGray8bpc() { benchmark(bits: 8, .gray, decode: false) }
+    func testGray8bpcDecode() { benchmark(bits: 8, .gray, decode: true) }
+    func testRGB8bpc() { benchmark(bits: 8, .rgb, decode: false) }
+    func testRGB8bpcDecode() { benchmark(bits: 8, .rgb, decode: true) }
+    func testCMYK8bpc() { benchmark(bits: 8, .cmyk, decode: false) }
+    func testCMYK8bpcDecode() { benchmark(bits: 8, .cmyk, decode: true) }
+    func testIndexed8bpc() { benchmark(bits: 8, .indexed, decode: false) }
+    func testIndexed8bpcDecode() { benchmark(bits: 8, .indexed, decode: true) }
+    func testLab8bpc() { benchmark(bits: 8, .lab, decode: false) }
+    func testLab8bpcDecode() { benchmark(bits: 8, .lab, decode: true) }
+    func testGray16bpc() { benchmark(bits: 16, .gray, decode: false) }
+    func testGray16bpcDecode() { benchmark(bits: 16, .gray, decode: true) }
+    func testRGB16bpc() { benchmark(bits: 16, .rgb, decode: false) }
+    func testRGB16bpcDecode() { benchmark(bits: 16, .rgb, decode: true) }
+    func testCMYK16bpc() { benchmark(bits: 16, .cmyk, decode: false) }
+    func testCMYK16bpcDecode() { benchmark(bits: 16, .cmyk, decode: true) }
+    func testIndexed16bpc() { benchmark(bits: 16, .indexed, decode: false) }
+    func testIndexed16bpcDecode() { benchmark(bits: 16, .indexed, decode: true) }
+    func testLab16bpc() { benchmark(bits: 16, .lab, decode: false) }
+    func testLab16bpcDecode() { benchmark(bits: 16, .lab, decode: true) }
+
+    // MARK: - Results
+
+    private func convert(_ d: PDFImageDescriptor, _ bytes: [UInt8]) -> [[UInt8]] {
+        var rows: [[UInt8]] = []
+        XCTAssertTrue(PDFImageConverter.convertRows(d, data: Data(bytes)) { rows.append($0) })
+        return rows
+    }
+
+    func testBitDepthsScaleToFullRange() {
+        let one = PDFImageDescriptor(width: 8, height: 1, bitsPerComponent: 1, model: .gray, decode: nil)
+        XCTAssertEqual(convert(one, [0b1010_0001]), [[255, 0, 255, 0, 0, 0, 0, 255]])
+        let sixteen = PDFImageDescriptor(width: 2, height: 1, bitsPerComponent: 16, model: .gray, decode: nil)
+        XCTAssertEqual(convert(sixteen, [0xFF, 0xFF, 0x80, 0x00]), [[255, 128]])
+    }
+
+    func testDecodeInvertsSamples() {
+        let d = PDFImageDescriptor(width: 3, height: 1, bitsPerComponent: 8, model: .gray, decode: [1, 0])
+        XCTAssertEqual(convert(d, [0, 255, 51]), [[255, 0, 204]])
+    }
+
+    func testCMYKVectorAndScalarPathsAgree() {
+        // 17 pixels: 16 through the SIMD loop, the last through the scalar tail.
+        let pixel: [UInt8] = [30, 120, 200, 40]
+        let d = PDFImageDescriptor(width: 17, height: 1, bitsPerComponent: 8, model: .cmyk, decode: nil)
+        let row = convert(d, Array([[UInt8]](repeating: pixel, count: 17).joined()))[0]
+        let k = 255 - 40
+        let expected: [UInt8] = [UInt8((255 - 30) * k / 255), UInt8((255 - 120) * k / 255), UInt8((255 - 200) * k / 255)]
+        // The SIMD loop rounds x / 255, the scalar tail truncates.
+        for p in 0..<17 {
+            for c in 0..<3 {
+                XCTAssertEqual(Int(row[3 * p + c]), Int(expected[c]), accuracy: 1, "pixel \(p)")
+            }
+        }
+    }
+
+    func testIndexedLooksUpThePalette() {
+        let palette: [UInt8] = [10, 20, 30, 40, 50, 60]
+        let d = PDFImageDescriptor(width: 3, height: 1, bitsPerComponent: 8,
+                                   model: .indexed(paletteRGB: palette, hival: 1), decode: nil)
+        // Out-of-range indices clamp to the last entry.
+        XCTAssertEqual(convert(d, [1, 0, 7]), [[40, 50, 60, 10, 20, 30, 40, 50, 60]])
+    }
+
+    func testLabWhiteIsWhite() {
+        let d = PDFImageDescriptor(width: 1, height: 1, bitsPerComponent: 8,
+                                   model: .lab(range: SIMD4(-128, 127, -128, 127)), decode: nil)
+        let row = convert(d, [255, 128, 128])[0]
+        XCTAssertTrue(row.allSatisfy { $0 >= 254 }, "\(row)")
+    }
+
+    func testShortDataIsRejected() {
+        let d = PDFImageDescriptor(width: 4, height: 4, bitsPerComponent: 8, model: .rgb, decode: nil)
+        XCTAssertFalse(PDFImageConverter.convertRows(d, data: Data(count: 10)) { _ in XCTFail("no rows") })
+    }
+}
@@ -0,0 +1,183 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+/// Stands in for PDFKit: page `i` is a 1-row image `i + 1` pixels wide whose samples are all `i % 256`.
+/// Rendering takes a little time that varies per page, so workers finish out of order.
+private final class FakeRasterBackend: PageRasterBackend {
+    var failingPages: Set<Int> = []
+    var failMakeContext = false
+
+    private let lock = NSLock()
+    private(set) var contextsMade = 0
+    private(set) var rasterized: [Int] = []
+    private(set) var sharedContextUse = false
+    /// Rasters handed out and not yet encoded (see `encoded`), and the most seen at once.
+    private(set) var alive = 0
+    private(set) var maxAlive = 0
+
+    func makeContext() -> PageRasterContext? {
+        lock.lock()
+        defer { lock.unlock() }
+        if failMakeContext { return nil }
+        contextsMade += 1
+        return Context(backend: self)
+    }
+
+    func encoded() {
+        lock.lock()
+        alive -= 1
+        lock.unlock()
+    }
+
+    private final class Context: PageRasterContext {
+        let backend: FakeRasterBackend
+        private var busy = false
+
+        init(backend: FakeRasterBackend) {
+            self.backend = backend
+        }
+
+        func rasterize(pageIndex: Int) -> RasterImage? {
+            backend.lock.lock()
+            if busy { backend.sharedContextUse = true }
+            busy = true
+            backend.rasterized.append(pageIndex)
+            backend.lock.unlock()
+
+            usleep(UInt32(200 + (pageIndex * 7919) % 5 * 400))
+
+            backend.lock.lock()
+            busy = false
+            let fails = backend.failingPages.contains(pageIndex)
+            if !fails {
+                backend.alive += 1
+                backend.maxAlive = max(backend.maxAlive, backend.alive)
+            }
+            backend.lock.unlock()
+            if fails { return nil }
+
+            let width = pageIndex + 1
+            let pixels = [UInt8](repeating: UInt8(pageIndex % 256), count: width * 4)
+            return RasterImage(width: width, height: 1, bytesPerRow: width * 4, pixels: pixels)
+        }
+    }
+}
+
+final class ParallelPageRendererTests: XCTestCase {
+    private func encoder(_ backend: FakeRasterBackend, delay: useconds_t = 0, failing: Set<Int> = [])
+        -> ParallelPageRenderer.Encoder {
+        return { pageIndex, raster in
+            if delay > 0 { usleep(delay) }
+            backend.encoded()
+            if failing.contains(pageIndex) { return nil }
+            return EncodedPage(pageIndex: pageIndex, mimeType: "image/png", fileExtension: "png",
+                               data: Data([raster.pixels[0]]), pixelWidth: raster.width)
+        }
+    }
+
+    func testDeliversEveryPageInRequestedOrder() {
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 4, encode: encoder(backend))
+        let pages = Array((0..<60).reversed()) + [100, 61, 64]
+
+        var delivered: [Int] = []
+        renderer.run(pageIndices: pages) { pageIndex, page in
+            XCTAssertEqual(page?.pageIndex, pageIndex)
+            XCTAssertEqual(page?.pixelWidth, pageIndex + 1)
+            XCTAssertEqual(page?.data, Data([UInt8(pageIndex % 256)]))
+            delivered.append(pageIndex)
+            return true
+        }
+
+        XCTAssertEqual(delivered, pages)
+        XCTAssertEqual(backend.rasterized.sorted(), pages.sorted())
+    }
+
+    func testEachWorkerHasItsOwnContext() {
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 3, encode: encoder(backend))
+        renderer.run(pageIndices: Array(0..<40)) { _, _ in true }
+
+        XCTAssertFalse(backend.sharedContextUse)
+        XCTAssertLessThanOrEqual(backend.contextsMade, 3)
+        XCTAssertGreaterThanOrEqual(backend.contextsMade, 1)
+    }
+
+    func testFewerPagesThanWorkers() {
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 8, encode: encoder(backend))
+        var delivered: [Int] = []
+        renderer.run(pageIndices: [7, 2]) { pageIndex, _ in
+            delivered.append(pageIndex)
+            return true
+        }
+
+        XCTAssertEqual(delivered, [7, 2])
+        XCTAssertLessThanOrEqual(backend.contextsMade, 2)
+    }
+
+    func testFailedPagesAreDeliveredAsNilInPlace() {
+        let backend = FakeRasterBackend()
+        backend.failingPages = [3, 9]
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 4, encode: encoder(backend, failing: [5]))
+
+        var delivered: [(Int, Bool)] = []
+        renderer.run(pageIndices: Array(0..<12)) { pageIndex, page in
+            delivered.append((pageIndex, page != nil))
+            return true
+        }
+
+        XCTAssertEqual(delivered.map { $0.0 }, Array(0..<12))
+        XCTAssertEqual(delivered.filter { !$0.1 }.map { $0.0 }, [3, 5, 9])
+    }
+
+    func testNoContextDeliversNilForEveryPage() {
+        let backend = FakeRasterBackend()
+        backend.failMakeContext = true
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 2, encode: encoder(backend))
+
+        var delivered: [Int] = []
+        renderer.run(pageIndices: [0, 1, 2]) { pageIndex, page in
+            XCTAssertNil(page)
+            delivered.append(pageIndex)
+            return true
+        }
+
+        XCTAssertEqual(delivered, [0, 1, 2])
+        XCTAssertTrue(backend.rasterized.isEmpty)
+    }
+
+    func testStopsSchedulingWhenOnPageReturnsFalse() {
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 2, encode: encoder(backend, delay: 2000))
+
+        var delivered: [Int] = []
+        renderer.run(pageIndices: Array(0..<200)) { pageIndex, _ in
+            delivered.append(pageIndex)
+            return delivered.count < 3
+        }
+
+        XCTAssertEqual(delivered, [0, 1, 2])
+        XCTAssertLessThan(backend.rasterized.count, 200)
+    }
+
+    func testRawBitmapsInFlightAreBounded() {
+        // Slow encoding makes rendering run ahead; it may not get more than workers + 2 bitmaps ahead.
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, workerCount: 2, encode: encoder(backend, delay: 5000))
+        renderer.run(pageIndices: Array(0..<30)) { _, _ in true }
+
+        XCTAssertLessThanOrEqual(backend.maxAlive, 4)
+        XCTAssertEqual(backend.alive, 0)
+    }
+
+    func testEmptyJobReturnsImmediately() {
+        let backend = FakeRasterBackend()
+        let renderer = ParallelPageRenderer(backend: backend, encode: encoder(backend))
+        renderer.run(pageIndices: []) { _, _ in
+            XCTFail("no page to deliver")
+            return true
+        }
+        XCTAssertEqual(backend.contextsMade, 0)
+    }
+}
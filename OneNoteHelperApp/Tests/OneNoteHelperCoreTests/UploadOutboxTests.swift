@@ -0,0 +1,230 @@
+import XCTest
+@testable import OneNoteHelperCore
+
+/// Fake Graph for the outbox: answers each request from a script keyed by body file and records what was sent.
+private final class FakeTransport {
+    struct Call {
+        let method: String
+        let url: String
+        let bodyFile: String
+        let bodyBytes: Int
+    }
+
+    private let lock = NSLock()
+    private var _calls: [Call] = []
+    private var replies: [String: [UploadOutbox.SendResult]] = [:]
+
+    var calls: [Call] {
+        lock.lock()
+        defer { lock.unlock() }
+        return _calls
+    }
+
+    /// Replies for `bodyFile`, used in order; `.sent` with an empty body once they run out.
+    func script(_ bodyFile: String, _ results: UploadOutbox.SendResult...) {
+        lock.lock()
+        replies[bodyFile, default: []] += results
+        lock.unlock()
+    }
+
+    func reset() {
+        lock.lock()
+        _calls = []
+        lock.unlock()
+    }
+
+    func send(_ request: UploadOutbox.Request, url: String, bodyURL: URL) -> UploadOutbox.SendResult {
+        let bytes = (try? Data(contentsOf: bodyURL))?.count ?? -1
+        lock.lock()
+        defer { lock.unlock() }
+        _calls.append(Call(method: request.method, url: url, bodyFile: request.bodyFile, bodyBytes: bytes))
+        guard var queue = replies[request.bodyFile], !queue.isEmpty else { return .sent(Data()) }
+        let result = queue.removeFirst()
+        replies[request.bodyFile] = queue
+        return result
+    }
+}
+
+final class UploadOutboxTests: XCTestCase {
+    private var directory: URL!
+    private var transport: FakeTransport!
+    private var finished: [(UploadOutbox.Entry, Bool)] = []
+
+    override func setUpWithError() throws {
+        directory = FileManager.default.temporaryDirectory
+            .appendingPathComponent("UploadOutboxTests-\(UUID().uuidString)", isDirectory: true)
+        transport = FakeTransport()
+        finished = []
+    }
+
+    override func tearDownWithError() throws {
+        UserDefaults.standard.removeObject(forKey: UploadOutbox.maxAttemptsKey)
+        try? FileManager.default.removeItem(at: directory)
+    }
+
+    private func makeOutbox() -> UploadOutbox {
+        let outbox = UploadOutbox()
+        let transport = self.transport!
+        outbox.transport = { transport.send($0, url: $1, bodyURL: $2) }
+        outbox.onFinished = { [unowned self] entry, ok in finished.append((entry, ok)) }
+        outbox.start(directory: directory)
+        return outbox
+    }
+
+    private func body(_ text: String) -> MultipartBody {
+        let body = MultipartBody(boundary: "----onenote-test")
+        body.append(contentType: "text/html; charset=utf-8", contentDisposition: "form-data; name=\"Presentation\"",
+                    data: Data(text.utf8))
+        body.finish()
+        return body
+    }
+
+    private let createURL = "https://graph.example/v1.0/me/onenote/pages"
+    private let patchURL = "https://graph.example/v1.0/me/onenote/pages/\(UploadOutbox.pagePlaceholder)/content"
+
+    /// A split job: the create, then two PATCHes into the created page.
+    private func enqueueSplitJob(_ outbox: UploadOutbox) throws -> UploadOutbox.Entry {
+        try outbox.enqueue(label: "job.pdf", user: "u", sourceFiles: ["/queue/job.pdf"], requests: [
+            UploadOutbox.PreparedRequest(method: "POST", url: createURL, body: body("first"), createsPage: true, splitId: "s1"),
+            UploadOutbox.PreparedRequest(method: "PATCH", url: patchURL, body: body("second"), splitId: "s1"),
+            UploadOutbox.PreparedRequest(method: "PATCH", url: patchURL, body: body("third"), splitId: "s1")
+        ])
+    }
+
+    private func created(_ id: String) -> UploadOutbox.SendResult {
+        .sent(Data(#"{"id":"\#(id)"}"#.utf8))
+    }
+
+    func testPartialFailureResendsOnlyUnsentRequests() throws {
+        let outbox = makeOutbox()
+        transport.script("request-0.body", created("page-1"))
+        transport.script("request-2.body", .retry("HTTP 503"))
+        let entry = try enqueueSplitJob(outbox)
+        XCTAssertEqual(entry.splitId, "s1")
+
+        guard case .deferred = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected a retry") }
+        XCTAssertEqual(Set(transport.calls.map(\.bodyFile)), ["request-0.body", "request-1.body", "request-2.body"])
+        XCTAssertTrue(outbox.isPending(sourceFile: "/queue/job.pdf"))
+        XCTAssertTrue(finished.isEmpty)
+
+        transport.reset()
+        guard case .sent = outbox.run(entry.id) else { return XCTFail("expected the retry to finish the job") }
+        XCTAssertEqual(transport.calls.map(\.bodyFile), ["request-2.body"])
+        XCTAssertEqual(outbox.pendingCount, 0)
+        XCTAssertFalse(FileManager.default.fileExists(atPath: directory.appendingPathComponent(entry.id).path))
+        XCTAssertEqual(finished.count, 1)
+        XCTAssertEqual(finished.first?.1, true)
+    }
+
+    func testCreatedPageIdIsUsedInLaterRequests() throws {
+        let outbox = makeOutbox()
+        transport.script("request-0.body", created("page-1"))
+        let entry = try enqueueSplitJob(outbox)
+
+        guard case .sent = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected the job to be sent") }
+        let calls = transport.calls
+        XCTAssertEqual(calls.count, 3)
+        // The create goes first; the PATCHes follow in either order.
+        XCTAssertEqual(calls[0].method, "POST")
+        XCTAssertEqual(calls[0].url, createURL)
+        for call in calls.dropFirst() {
+            XCTAssertEqual(call.method, "PATCH")
+            XCTAssertEqual(call.url, "https://graph.example/v1.0/me/onenote/pages/page-1/content")
+        }
+        XCTAssertEqual(calls.map(\.bodyBytes).sorted(), [body("first"), body("second"), body("third")].map(\.contentLength).sorted())
+        XCTAssertTrue(finished.isEmpty, "the first attempt reports to its caller")
+    }
+
+    func testCreateWithoutPageIdFails() throws {
+        let outbox = makeOutbox()
+        transport.script("request-0.body", .sent(Data("{}".utf8)))
+        let entry = try enqueueSplitJob(outbox)
+
+        guard case .failed = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected a failure") }
+        XCTAssertEqual(transport.calls.map(\.bodyFile), ["request-0.body"])
+        XCTAssertEqual(outbox.pendingCount, 0)
+    }
+
+    func testGivesUpAfterMaxAttempts() throws {
+        UserDefaults.standard.set(2, forKey: UploadOutbox.maxAttemptsKey)
+        let outbox = makeOutbox()
+        transport.script("request-0.body", .retry("HTTP 503"), .retry("HTTP 503"), .retry("HTTP 503"))
+        let entry = try enqueueSplitJob(outbox)
+
+        guard case .deferred = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected a retry") }
+        guard case .failed(let reason) = outbox.run(entry.id) else { return XCTFail("expected to give up") }
+        XCTAssertTrue(reason.contains("gave up after 2 attempts"), reason)
+        XCTAssertEqual(transport.calls.map(\.bodyFile), ["request-0.body", "request-0.body"])
+        XCTAssertEqual(outbox.pendingCount, 0)
+        XCTAssertFalse(outbox.isPending(sourceFile: "/queue/job.pdf"))
+        XCTAssertEqual(finished.first?.1, false)
+    }
+
+    func testRejectedRequestIsNotRetried() throws {
+        let outbox = makeOutbox()
+        transport.script("request-0.body", .failed("HTTP 400"))
+        let entry = try enqueueSplitJob(outbox)
+
+        guard case .failed = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected a failure") }
+        XCTAssertEqual(outbox.pendingCount, 0)
+    }
+
+    func testRestartReloadsTheManifest() throws {
+        let first = makeOutbox()
+        transport.script("request-0.body", created("page-1"))
+        transport.script("request-1.body", .retry("timed out"))
+        transport.script("request-2.body", .retry("timed out"))
+        let entry = try enqueueSplitJob(first)
+        guard case .deferred = first.run(entry.id, firstAttempt: true) else { return XCTFail("expected a retry") }
+
+        // A later session: the entry comes back with its progress, and an unfinished write is cleaned up.
+        let partial = directory.appendingPathComponent("interrupted.partial", isDirectory: true)
+        try FileManager.default.createDirectory(at: partial, withIntermediateDirectories: true)
+        transport.reset()
+        let second = makeOutbox()
+        XCTAssertEqual(second.pendingCount, 1)
+        XCTAssertTrue(second.isPending(sourceFile: "/queue/job.pdf"))
+        XCTAssertFalse(FileManager.default.fileExists(atPath: partial.path))
+
+        guard case .sent = second.run(entry.id) else { return XCTFail("expected the retry to finish the job") }
+        let calls = transport.calls
+        XCTAssertEqual(Set(calls.map(\.bodyFile)), ["request-1.body", "request-2.body"])
+        XCTAssertTrue(calls.allSatisfy { $0.url == "https://graph.example/v1.0/me/onenote/pages/page-1/content" })
+        XCTAssertEqual(finished.last?.1, true)
+    }
+
+    func testOpenEntrySendsRequestsAsTheyAreAdded() throws {
+        let outbox = makeOutbox()
+        transport.script("request-0.body", created("page-1"))
+        let entry = try outbox.open(label: "long.pdf", user: "u", sourceFiles: ["/queue/long.pdf"], splitId: "s2")
+
+        try outbox.add([UploadOutbox.PreparedRequest(method: "POST", url: createURL, body: body("pages 1-6"),
+                                                     createsPage: true, splitId: "s2")], to: entry.id)
+        XCTAssertNil(outbox.sendAdded(entry.id))
+        // Not attempted (or retried) on its own while open.
+        guard case .deferred = outbox.run(entry.id) else { return XCTFail("an open entry must not be run") }
+
+        try outbox.add([UploadOutbox.PreparedRequest(method: "PATCH", url: patchURL, body: body("pages 7-12"), splitId: "s2")],
+                       to: entry.id)
+        XCTAssertNil(outbox.sendAdded(entry.id))
+        XCTAssertEqual(transport.calls.map(\.bodyFile), ["request-0.body", "request-1.body"])
+        XCTAssertEqual(transport.calls.last?.url, "https://graph.example/v1.0/me/onenote/pages/page-1/content")
+
+        outbox.close(entry.id)
+        guard case .sent = outbox.run(entry.id, firstAttempt: true) else { return XCTFail("expected the job to be sent") }
+        XCTAssertEqual(transport.calls.count, 2)
+        XCTAssertEqual(outbox.pendingCount, 0)
+    }
+
+    func testOpenEntryIsDroppedOnRestart() throws {
+        let first = makeOutbox()
+        let entry = try first.open(label: "long.pdf", user: "u", sourceFiles: ["/queue/long.pdf"], splitId: nil)
+        try first.add([UploadOutbox.PreparedRequest(method: "POST", url: createURL, body: body("pages 1-6"),
+                                                    createsPage: true)], to: entry.id)
+
+        let second = makeOutbox()
+        XCTAssertEqual(second.pendingCount, 0)
+        XCTAssertFalse(FileManager.default.fileExists(atPath: directory.appendingPathComponent(entry.id).path))
+        XCTAssertTrue(transport.calls.isEmpty)
+    }
+}
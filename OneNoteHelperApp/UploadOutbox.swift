@@ -0,0 +1,426 @@
+import Foundation
+
+/// Prepared uploads persisted on disk, so a network or Graph failure retries only the upload instead of sending
+/// the job to `Failed` (where reprocessing repeats conversion and rendering).
+///
+/// Each entry is a folder in `Outbox/` holding one file per request body (the complete multipart body) and a
+/// `manifest.json` with the requests, which of them were already sent, and the retry state. Failed attempts
+/// are retried with exponential backoff and jitter (`OutboxRetryBaseSeconds`, default 30, capped at
+/// `OutboxRetryMaxSeconds`, default 3600) up to `OutboxMaxAttempts` (default 10) times, also after an app
+/// restart. For a split job only the requests not sent yet are retried; the id of a page created by an earlier
+/// attempt is kept in the manifest and substituted for `pagePlaceholder` in later request URLs.
+///
+/// A pipelined job (see `open`) adds its requests while it is still rendering and sends each batch as it is
+/// added; the entry only gets the normal attempt and retry handling once the job closes it.
+final class UploadOutbox {
+    static let retryBaseKey = "OutboxRetryBaseSeconds"
+    static let retryMaxKey = "OutboxRetryMaxSeconds"
+    static let maxAttemptsKey = "OutboxMaxAttempts"
+
+    static let shared = UploadOutbox()
+
+    /// Stands for the created page's id in request URLs until the creating request has succeeded.
+    static let pagePlaceholder = "{page}"
+
+    static var retryBase: TimeInterval {
+        let v = UserDefaults.standard.double(forKey: retryBaseKey)
+        return v > 0 ? v : 30
+    }
+
+    static var retryMax: TimeInterval {
+        let v = UserDefaults.standard.double(forKey: retryMaxKey)
+        return v > 0 ? v : 3600
+    }
+
+    static var maxAttempts: Int {
+        let v = UserDefaults.standard.integer(forKey: maxAttemptsKey)
+        return v > 0 ? v : 10
+    }
+
+    struct Request: Codable {
+        let method: String
+        let url: String
+        let contentType: String
+        /// Body file, relative to the entry folder.
+        let bodyFile: String
+        /// The response carries the id of a new page that later requests append to.
+        let createsPage: Bool
+        var sent = false
+    }
+
+    struct Entry: Codable {
+        let id: String
+        let label: String
+        let user: String
+        /// Queue files (PDF and metadata) to move to Done/Failed when the entry finishes; empty for URL imports.
+        let sourceFiles: [String]
+        var requests: [Request]
+        var pageId: String?
+        /// Split id baked into the placeholder ids of a split job's bodies (see JobSplitter.placeholderID), so
+        /// retries of the stored bodies keep targeting the same placeholders.
+        var splitId: String?
+        var attempts = 0
+        var nextAttemptAt = Date()
+        var lastError: String?
+        /// True while the job is still adding requests (see `open`); nil for entries stored in one go.
+        var isOpen: Bool?
+    }
+
+    /// A request ready to be persisted.
+    struct PreparedRequest {
+        let method: String
+        let url: String
+        let body: MultipartBody
+        var createsPage = false
+        var splitId: String?
+    }
+
+    enum SendResult {
+        case sent(Data)
+        /// Network errors, throttling, server errors: worth another attempt later.
+        case retry(String)
+        /// Rejected (e.g. 400): retrying the same body can't succeed.
+        case failed(String)
+    }
+
+    enum Attempt {
+        case sent
+        case failed(String)
+        case deferred(retryIn: TimeInterval)
+    }
+
+    /// Sends one request synchronously (called on a background thread).
+    var transport: ((Request, _ url: String, _ bodyURL: URL) -> SendResult)?
+    /// Called when an entry finishes on a later attempt (the first attempt reports to its caller instead).
+    var onFinished: ((Entry, Bool) -> Void)?
+    var log: ((String) -> Void)?
+
+    private let lock = NSLock()
+    private var directory: URL?
+    private var entries: [String: Entry] = [:]
+    private var running: Set<String> = []
+
+    /// Loads the entries left by an earlier run and schedules their next attempts.
+    func start(directory: URL) {
+        let fm = FileManager.default
+        try? fm.createDirectory(at: directory, withIntermediateDirectories: true)
+        lock.lock()
+        self.directory = directory
+        lock.unlock()
+
+        let folders = (try? fm.contentsOfDirectory(at: directory, includingPropertiesForKeys: nil)) ?? []
+        var restored: [Entry] = []
+        for folder in folders {
+            // Interrupted while being written: the job never reached its first attempt.
+            if folder.pathExtension == "partial" {
+                try? fm.removeItem(at: folder)
+                continue
+            }
+            guard let data = try? Data(contentsOf: folder.appendingPathComponent("manifest.json")),
+                  let entry = try? JSONDecoder().decode(Entry.self, from: data) else { continue }
+            // Interrupted while the job was still rendering: the rest of its pages were never stored. The job
+            // runs again from the queue; pages it had already sent stay on the page they went to.
+            if entry.isOpen == true {
+                let sent = entry.requests.filter(\.sent).count
+                log?("Outbox: dropping \(entry.label), interrupted while being prepared (\(sent) request(s) sent)")
+                try? fm.removeItem(at: folder)
+                continue
+            }
+            restored.append(entry)
+        }
+
+        lock.lock()
+        for entry in restored {
+            entries[entry.id] = entry
+        }
+        lock.unlock()
+        for entry in restored {
+            let sent = entry.requests.filter(\.sent).count
+            log?("Outbox: resuming \(entry.label) (\(sent)/\(entry.requests.count) request(s) sent, attempt \(entry.attempts + 1))")
+            schedule(entry.id, after: max(5, entry.nextAttemptAt.timeIntervalSinceNow))
+        }
+    }
+
+    /// True while an entry for `path` (a source file) is waiting for a retry.
+    func isPending(sourceFile path: String) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return entries.values.contains { $0.sourceFiles.contains(path) }
+    }
+
+    var pendingCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return entries.count
+    }
+
+    /// Writes the request bodies and the manifest. The folder only gets its final name once complete.
+    func enqueue(label: String, user: String, sourceFiles: [String], requests: [PreparedRequest]) throws -> Entry {
+        lock.lock()
+        let directory = self.directory
+        lock.unlock()
+        guard let directory else { throw CocoaError(.fileNoSuchFile) }
+
+        let fm = FileManager.default
+        let id = UUID().uuidString
+        let partial = directory.appendingPathComponent(id + ".partial", isDirectory: true)
+        try fm.createDirectory(at: partial, withIntermediateDirectories: true)
+        do {
+            var stored: [Request] = []
+            for (i, request) in requests.enumerated() {
+                let file = "request-\(i).body"
+                try request.body.write(to: partial.appendingPathComponent(file))
+                stored.append(Request(method: request.method, url: request.url, contentType: request.body.contentType,
+                                      bodyFile: file, createsPage: request.createsPage))
+            }
+            let entry = Entry(id: id, label: label, user: user, sourceFiles: sourceFiles, requests: stored,
+                              splitId: requests.lazy.compactMap(\.splitId).first)
+            try JSONEncoder().encode(entry).write(to: partial.appendingPathComponent("manifest.json"), options: .atomic)
+            try fm.moveItem(at: partial, to: directory.appendingPathComponent(id, isDirectory: true))
+
+            lock.lock()
+            entries[id] = entry
+            lock.unlock()
+            return entry
+        } catch {
+            try? fm.removeItem(at: partial)
+            throw error
+        }
+    }
+
+    /// Starts an entry whose requests are added while the job is still producing them: `add` stores a batch,
+    /// `sendAdded` sends what is stored so far, and `close` hands the entry to `run` once the job is done. Until
+    /// then the entry is neither retried nor reported; the caller drives it from one thread.
+    func open(label: String, user: String, sourceFiles: [String], splitId: String?) throws -> Entry {
+        lock.lock()
+        let directory = self.directory
+        lock.unlock()
+        guard let directory else { throw CocoaError(.fileNoSuchFile) }
+
+        let id = UUID().uuidString
+        let folder = directory.appendingPathComponent(id, isDirectory: true)
+        try FileManager.default.createDirectory(at: folder, withIntermediateDirectories: true)
+        let entry = Entry(id: id, label: label, user: user, sourceFiles: sourceFiles, requests: [], splitId: splitId, isOpen: true)
+        do {
+            try JSONEncoder().encode(entry).write(to: folder.appendingPathComponent("manifest.json"), options: .atomic)
+        } catch {
+            try? FileManager.default.removeItem(at: folder)
+            throw error
+        }
+        lock.lock()
+        entries[id] = entry
+        lock.unlock()
+        return entry
+    }
+
+    /// Writes `requests` to an open entry, after the ones it already has.
+    func add(_ requests: [PreparedRequest], to id: String) throws {
+        lock.lock()
+        guard var entry = entries[id], entry.isOpen == true, let directory else {
+            lock.unlock()
+            throw CocoaError(.fileNoSuchFile)
+        }
+        lock.unlock()
+
+        let folder = directory.appendingPathComponent(id, isDirectory: true)
+        for request in requests {
+            let file = "request-\(entry.requests.count).body"
+            try request.body.write(to: folder.appendingPathComponent(file))
+            entry.requests.append(Request(method: request.method, url: request.url, contentType: request.body.contentType,
+                                          bodyFile: file, createsPage: request.createsPage))
+        }
+        try JSONEncoder().encode(entry).write(to: folder.appendingPathComponent("manifest.json"), options: .atomic)
+        lock.lock()
+        entries[id] = entry
+        lock.unlock()
+    }
+
+    /// Sends the requests an open entry has not sent yet, the first one before the others. Nil when everything
+    /// stored so far has been sent.
+    func sendAdded(_ id: String) -> SendResult? {
+        lock.lock()
+        guard var entry = entries[id], entry.isOpen == true, let directory else {
+            lock.unlock()
+            return .retry("no open outbox entry")
+        }
+        lock.unlock()
+
+        let result = send(&entry, folder: directory.appendingPathComponent(id, isDirectory: true))
+        lock.lock()
+        entries[id] = entry
+        lock.unlock()
+        return result
+    }
+
+    /// The job has added all its requests: from now on the entry is attempted and retried like any other.
+    func close(_ id: String) {
+        lock.lock()
+        guard var entry = entries[id], let directory else {
+            lock.unlock()
+            return
+        }
+        entry.isOpen = nil
+        entries[id] = entry
+        lock.unlock()
+        save(entry, folder: directory.appendingPathComponent(id, isDirectory: true))
+    }
+
+    /// Drops an entry without sending the rest of it (the job failed while it was open).
+    func discard(_ id: String) {
+        lock.lock()
+        entries[id] = nil
+        let directory = self.directory
+        lock.unlock()
+        if let directory {
+            try? FileManager.default.removeItem(at: directory.appendingPathComponent(id, isDirectory: true))
+        }
+    }
+
+    /// Sends the entry's outstanding requests. Finished entries (sent, rejected, or out of attempts) are removed;
+    /// otherwise the next attempt is scheduled. `onFinished` is only called for attempts after the first.
+    @discardableResult
+    func run(_ id: String, firstAttempt: Bool = false) -> Attempt {
+        lock.lock()
+        guard var entry = entries[id], entry.isOpen != true, let directory, !running.contains(id) else {
+            lock.unlock()
+            return .deferred(retryIn: 0)
+        }
+        running.insert(id)
+        lock.unlock()
+        defer {
+            lock.lock()
+            running.remove(id)
+            lock.unlock()
+        }
+
+        let folder = directory.appendingPathComponent(id, isDirectory: true)
+        let outcome = send(&entry, folder: folder)
+
+        let attempt: Attempt
+        switch outcome {
+        case nil, .sent?:
+            attempt = .sent
+        case .failed(let reason)?:
+            attempt = .failed(reason)
+        case .retry(let reason)?:
+            entry.attempts += 1
+            entry.lastError = reason
+            if entry.attempts >= Self.maxAttempts {
+                attempt = .failed("\(reason) (gave up after \(entry.attempts) attempts)")
+            } else {
+                let backoff = min(Self.retryMax, Self.retryBase * pow(2, Double(entry.attempts - 1)))
+                let delay = backoff * Double.random(in: 0.5...1.5)
+                entry.nextAttemptAt = Date().addingTimeInterval(delay)
+                save(entry, folder: folder)
+                lock.lock()
+                entries[id] = entry
+                lock.unlock()
+                let sent = entry.requests.filter(\.sent).count
+                log?("Outbox: \(entry.label) attempt \(entry.attempts) failed (\(reason)); \(sent)/\(entry.requests.count) request(s) sent; retry in \(Int(delay))s")
+                schedule(id, after: delay)
+                return .deferred(retryIn: delay)
+            }
+        }
+
+        lock.lock()
+        entries[id] = nil
+        lock.unlock()
+        try? FileManager.default.removeItem(at: folder)
+        if !firstAttempt {
+            if case .failed(let reason) = attempt {
+                log?("Outbox: \(entry.label) failed: \(reason)")
+            } else {
+                log?("Outbox: \(entry.label) uploaded after \(entry.attempts + 1) attempt(s)")
+            }
+            let ok: Bool
+            if case .sent = attempt { ok = true } else { ok = false }
+            onFinished?(entry, ok)
+        }
+        return attempt
+    }
+
+    /// Sends the unsent requests, recording progress in the manifest. Nil when everything has been sent.
+    private func send(_ entry: inout Entry, folder: URL) -> SendResult? {
+        guard let transport else { return .retry("no transport") }
+
+        // The first request creates (or first appends to) the page; the others depend on it.
+        if let first = entry.requests.first, !first.sent {
+            switch transport(first, Self.resolvedURL(first, pageId: entry.pageId), folder.appendingPathComponent(first.bodyFile)) {
+            case .sent(let response):
+                if first.createsPage {
+                    let json = (try? JSONSerialization.jsonObject(with: response)) as? [String: Any]
+                    guard let id = json?["id"] as? String, !id.isEmpty else {
+                        return .failed("created page id missing from response")
+                    }
+                    entry.pageId = id
+                }
+                entry.requests[0].sent = true
+                save(entry, folder: folder)
+            case let other:
+                return other
+            }
+        }
+
+        let pending = entry.requests.indices.filter { !entry.requests[$0].sent }
+        guard !pending.isEmpty else { return nil }
+
+        // Later requests target their own placeholders (see JobSplitter), so they can run concurrently.
+        final class Progress {
+            let lock = NSLock()
+            var sent: [Int] = []
+            var retry: String?
+            var failed: String?
+        }
+        let progress = Progress()
+        let gate = DispatchSemaphore(value: JobSplitter.concurrency)
+        let group = DispatchGroup()
+        let requests = entry.requests
+        let pageId = entry.pageId
+        for i in pending {
+            gate.wait()
+            group.enter()
+            DispatchQueue.global(qos: .utility).async {
+                defer {
+                    gate.signal()
+                    group.leave()
+                }
+                let request = requests[i]
+                let result = transport(request, Self.resolvedURL(request, pageId: pageId), folder.appendingPathComponent(request.bodyFile))
+                progress.lock.lock()
+                switch result {
+                case .sent:
+                    progress.sent.append(i)
+                case .retry(let reason):
+                    progress.retry = progress.retry ?? "request \(i + 1): \(reason)"
+                case .failed(let reason):
+                    progress.failed = progress.failed ?? "request \(i + 1): \(reason)"
+                }
+                progress.lock.unlock()
+            }
+        }
+        group.wait()
+
+        for i in progress.sent {
+            entry.requests[i].sent = true
+        }
+        save(entry, folder: folder)
+        if let failed = progress.failed { return .failed(failed) }
+        if let retry = progress.retry { return .retry(retry) }
+        return nil
+    }
+
+    private static func resolvedURL(_ request: Request, pageId: String?) -> String {
+        request.url.replacingOccurrences(of: pagePlaceholder, with: pageId ?? pagePlaceholder)
+    }
+
+    private func save(_ entry: Entry, folder: URL) {
+        guard let data = try? JSONEncoder().encode(entry) else { return }
+        try? data.write(to: folder.appendingPathComponent("manifest.json"), options: .atomic)
+    }
+
+    private func schedule(_ id: String, after delay: TimeInterval) {
+        DispatchQueue.global(qos: .utility).asyncAfter(deadline: .now() + max(0, delay)) { [weak self] in
+            self?.run(id)
+        }
+    }
+}
@@ -100,17 +100,42 @@ int main(int argc, char *argv[]) {
     (void)copies;
     (void)options;
 
-    const char *tmpdir = getenv("TMPDIR");
-    if (!tmpdir || !tmpdir[0]) tmpdir = "/private/var/spool/cups/tmp";
+    const char *rootDir = "/Users/Shared/OneNoteHelper";
+    const char *incomingDir = "/Users/Shared/OneNoteHelper/Incoming";
+    const char *processingDir = "/Users/Shared/OneNoteHelper/Processing";
+    const char *doneDir = "/Users/Shared/OneNoteHelper/Done";
+    const char *failedDir = "/Users/Shared/OneNoteHelper/Failed";
 
-    // Write incoming job data to a temp file (no assumption about format).
+    const char *dirs[] = { rootDir, incomingDir, processingDir, doneDir, failedDir };
+    for (size_t i = 0; i < sizeof(dirs)/sizeof(dirs[0]); i++) {
+        if (ensure_dirs_recursive(dirs[i], 0777) != 0) {
+            fprintf(stderr, "onenote backend: failed to create dir '%s': %s\n", dirs[i], strerror(errno));
+            return CUPS_BACKEND_FAILED;
+        }
+        (void)chmod(dirs[i], 01777);
+    }
+
+    time_t now = time(NULL);
+    char baseName[256];
+    snprintf(baseName, sizeof(baseName), "job-%s-%ld", job_id, (long)now);
+
+    // Spool straight into Incoming as <base>.spool so the helper can start on linearized PDFs
+    // (page 1) while the rest is still being written. The helper only picks up .pdf/.ps + .json,
+    // so the file is renamed once complete. Fall back to a private temp file if that fails.
     char templatePath[1024];
-    snprintf(templatePath, sizeof(templatePath), "%s/onenote-print-XXXXXX", tmpdir);
+    snprintf(templatePath, sizeof(templatePath), "%s/%s.spool", incomingDir, baseName);
 
-    int outfd = mkstemp(templatePath);
+    int outfd = open(templatePath, O_WRONLY | O_CREAT | O_EXCL, 0644);
     if (outfd < 0) {
-        fprintf(stderr, "onenote backend: failed to create temp file '%s': %s\n", templatePath, strerror(errno));
-        return CUPS_BACKEND_FAILED;
+        const char *tmpdir = getenv("TMPDIR");
+        if (!tmpdir || !tmpdir[0]) tmpdir = "/private/var/spool/cups/tmp";
+
+        snprintf(templatePath, sizeof(templatePath), "%s/onenote-print-XXXXXX", tmpdir);
+        outfd = mkstemp(templatePath);
+        if (outfd < 0) {
+            fprintf(stderr, "onenote backend: failed to create temp file '%s': %s\n", templatePath, strerror(errno));
+            return CUPS_BACKEND_FAILED;
+        }
     }
 
     int infd = STDIN_FILENO;
@@ -118,6 +143,7 @@ int main(int argc, char *argv[]) {
         infd = open(file, O_RDONLY);
         if (infd < 0) {
             close(outfd);
+            (void)unlink(templatePath);
             fprintf(stderr, "onenote backend: failed to open input file '%s': %s\n", file, strerror(errno));
             return CUPS_BACKEND_FAILED;
         }
@@ -133,6 +159,7 @@ int main(int argc, char *argv[]) {
             if (wn < 0) {
                 if (infd != STDIN_FILENO) close(infd);
                 close(outfd);
+                (void)unlink(templatePath);
                 fprintf(stderr, "onenote backend: failed to write temp file: %s\n", strerror(errno));
                 return CUPS_BACKEND_FAILED;
             }
@@ -144,6 +171,7 @@ int main(int argc, char *argv[]) {
     if (n < 0) {
         if (infd != STDIN_FILENO) close(infd);
         close(outfd);
+        (void)unlink(templatePath);
         fprintf(stderr, "onenote backend: failed to read input data: %s\n", strerror(errno));
         return CUPS_BACKEND_FAILED;
     }
@@ -165,27 +193,10 @@ int main(int argc, char *argv[]) {
     struct passwd *pw = getpwnam(user);
     if (!pw || !pw->pw_dir) {
         fprintf(stderr, "onenote backend: getpwnam(%s) failed\n", user);
+        (void)unlink(templatePath);
         return CUPS_BACKEND_FAILED;
     }
 
-    const char *rootDir = "/Users/Shared/OneNoteHelper";
-    const char *incomingDir = "/Users/Shared/OneNoteHelper/Incoming";
-    const char *processingDir = "/Users/Shared/OneNoteHelper/Processing";
-    const char *doneDir = "/Users/Shared/OneNoteHelper/Done";
-    const char *failedDir = "/Users/Shared/OneNoteHelper/Failed";
-
-    const char *dirs[] = { rootDir, incomingDir, processingDir, doneDir, failedDir };
-    for (size_t i = 0; i < sizeof(dirs)/sizeof(dirs[0]); i++) {
-        if (ensure_dirs_recursive(dirs[i], 0777) != 0) {
-            fprintf(stderr, "onenote backend: failed to create dir '%s': %s\n", dirs[i], strerror(errno));
-            return CUPS_BACKEND_FAILED;
-        }
-        (void)chmod(dirs[i], 01777);
-    }
-
-    time_t now = time(NULL);
-    char baseName[256];
-    snprintf(baseName, sizeof(baseName), "job-%s-%ld", job_id, (long)now);
 
     char destDoc[PATH_MAX];
     char destJson[PATH_MAX];